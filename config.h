@@ -168,7 +168,8 @@
     !defined(VFS_DF_SUPPORT)         && \
     !defined(VFS_EEPROM_SUPPORT)     && \
     !defined(VFS_EEPROM_RAW_SUPPORT) && \
-    !defined(VFS_DC3840_SUPPORT)
+    !defined(VFS_DC3840_SUPPORT)     && \
+    !defined(VFS_RAM_SUPPORT)
 #  define VFS_TEENSY 1
 #endif
 
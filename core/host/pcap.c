@@ -0,0 +1,509 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <byteswap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "config.h"
+#include "protocols/uip/uip.h"
+#include "protocols/uip/uip_arp.h"
+#include "core/host/tap.h"
+#include "core/host/pcap.h"
+
+#define die(a...) do { fprintf(stderr, a); exit (-1); } while(0)
+
+#define PCAP_MAGIC       0xa1b2c3d4
+#define PCAP_MAGIC_NSEC  0xa1b23c4d
+#define PCAP_ETHERNET    1
+
+/* the replay waits no longer than a timer tick, so the timers keep going */
+#define PCAP_TICK        20000
+
+#define PCAP_TCP_FIN     0x01
+#define PCAP_TCP_SYN     0x02
+#define PCAP_TCP_ACK     0x10
+
+struct pcap_file_hdr
+{
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+struct pcap_rec_hdr
+{
+  uint32_t ts_sec;
+  uint32_t ts_frac;
+  uint32_t caplen;
+  uint32_t len;
+};
+
+struct pcap_frame
+{
+  struct pcap_rec_hdr rec;
+  uint8_t data[UIP_CONF_BUFFER_SIZE];
+};
+
+struct pcap_flow
+{
+  uip_ipaddr_t ripaddr;
+  uint16_t rport;
+  uint16_t lport;
+  uint32_t isn;
+  uint32_t nxt;
+};
+
+struct pcap_stat
+{
+  uint16_t type;
+  uint8_t proto;
+  uint16_t port;
+  unsigned long packets;
+  uint64_t total;
+  uint64_t max;
+};
+
+int pcap_replay;
+
+static FILE *pcap_in, *pcap_out;
+static int pcap_swapped, pcap_nsec, pcap_timed;
+
+/* record header read ahead, while waiting for the packet to be due */
+static struct pcap_rec_hdr pcap_rec;
+static int pcap_pending;
+
+/* capture time of the first packet and the time it was replayed at */
+static uint64_t pcap_first_ts, pcap_first_usec;
+
+/* frames sent during tap_input, kept out of the timed section */
+static struct pcap_frame pcap_queue[PCAP_QUEUE];
+static uint8_t pcap_queued;
+static int pcap_timing;
+
+/* sequence numbers of the connections the stack accepted */
+static struct pcap_flow pcap_flows[PCAP_FLOWS];
+static uint8_t pcap_flows_next;
+
+static unsigned long pcap_packets, pcap_skipped;
+static struct pcap_stat pcap_stats[PCAP_STATS];
+static uint8_t pcap_stats_used;
+
+#if defined(__i386__) || defined(__x86_64__)
+#define PCAP_UNIT "cycles"
+
+static uint64_t
+pcap_cycles(void)
+{
+  return __builtin_ia32_rdtsc();
+}
+#else
+#define PCAP_UNIT "ns"
+
+static uint64_t
+pcap_cycles(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+static uint64_t
+pcap_usec(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static uint32_t
+pcap_get32(uint32_t val)
+{
+  return pcap_swapped ? bswap_32(val) : val;
+}
+
+
+int
+pcap_open(void)
+{
+  struct pcap_file_hdr hdr;
+  const char *name = getenv(PCAP_ENV_IN);
+
+  if (name == NULL)
+    return -1;
+
+  pcap_in = fopen(name, "r");
+  if (pcap_in == NULL)
+    die("Couldn't open %s\n", name);
+  if (fread(&hdr, sizeof(hdr), 1, pcap_in) != 1)
+    die("%s: short pcap header\n", name);
+
+  if (hdr.magic != PCAP_MAGIC && hdr.magic != PCAP_MAGIC_NSEC)
+    pcap_swapped = 1;
+  pcap_nsec = pcap_get32(hdr.magic) == PCAP_MAGIC_NSEC;
+  if (pcap_get32(hdr.magic) != PCAP_MAGIC && !pcap_nsec)
+    die("%s: not a pcap file\n", name);
+  if (pcap_get32(hdr.linktype) != PCAP_ETHERNET)
+    die("%s: not an ethernet capture\n", name);
+
+  name = getenv(PCAP_ENV_OUT);
+  if (name)
+    {
+      struct pcap_file_hdr out = {
+	.magic = PCAP_MAGIC,
+	.version_major = 2,
+	.version_minor = 4,
+	.snaplen = UIP_CONF_BUFFER_SIZE,
+	.linktype = PCAP_ETHERNET,
+      };
+
+      pcap_out = fopen(name, "w");
+      if (pcap_out == NULL)
+	die("Couldn't create %s\n", name);
+      fwrite(&out, sizeof(out), 1, pcap_out);
+    }
+
+  pcap_timed = getenv(PCAP_ENV_TIMED) != NULL;
+  pcap_replay = 1;
+
+  /* a regular file always polls readable, so pcap_read is called
+     on every pass of the main loop */
+  return fileno(pcap_in);
+}
+
+
+static void
+pcap_flush(void)
+{
+  for (uint8_t i = 0; i < pcap_queued; i++)
+    {
+      fwrite(&pcap_queue[i].rec, sizeof(pcap_queue[i].rec), 1, pcap_out);
+      fwrite(pcap_queue[i].data, pcap_queue[i].rec.caplen, 1, pcap_out);
+    }
+  pcap_queued = 0;
+}
+
+
+static struct uip_tcpip_hdr *
+pcap_tcp(void)
+{
+  struct uip_eth_hdr *eth = (struct uip_eth_hdr *) uip_buf;
+  struct uip_tcpip_hdr *tcp = (struct uip_tcpip_hdr *) &uip_buf[UIP_LLH_LEN];
+
+#if UIP_CONF_IPV6
+  if (eth->type != HTONS(UIP_ETHTYPE_IP6))
+#else
+  if (eth->type != HTONS(UIP_ETHTYPE_IP))
+#endif
+    return NULL;
+  if (uip_len < UIP_LLH_LEN + UIP_IPTCPH_LEN || tcp->proto != UIP_PROTO_TCP)
+    return NULL;
+  return tcp;
+}
+
+
+static struct pcap_flow *
+pcap_flow(uip_ipaddr_t ripaddr, uint16_t rport, uint16_t lport)
+{
+  for (uint8_t i = 0; i < PCAP_FLOWS; i++)
+    if (pcap_flows[i].rport == rport && pcap_flows[i].lport == lport
+	&& uip_ipaddr_cmp(pcap_flows[i].ripaddr, ripaddr))
+      return &pcap_flows[i];
+  return NULL;
+}
+
+
+static uint32_t
+pcap_get_seq(const uint8_t *seq)
+{
+  return (uint32_t) seq[0] << 24 | (uint32_t) seq[1] << 16
+    | (uint32_t) seq[2] << 8 | seq[3];
+}
+
+
+/* The stack picks its own initial sequence number, so a trace cannot
+   know the numbers to acknowledge.  Acknowledgements in the trace count
+   from an ISN of 0 and are moved onto the ISN of the SYN-ACK sent last
+   to that client port, but never beyond what the stack has sent.  The
+   checksum is adjusted as in RFC 1624. */
+static void
+pcap_track_ack(void)
+{
+  struct uip_tcpip_hdr *tcp = pcap_tcp();
+
+  if (tcp == NULL || (tcp->flags & (PCAP_TCP_SYN | PCAP_TCP_ACK))
+      != PCAP_TCP_ACK)
+    return;
+
+  struct pcap_flow *flow = pcap_flow(tcp->srcipaddr, tcp->srcport,
+				     tcp->destport);
+  if (flow == NULL)
+    return;
+
+  uint32_t old = pcap_get_seq(tcp->ackno);
+  uint32_t new = old + flow->isn;
+  if ((int32_t) (new - flow->nxt) > 0)
+    new = flow->nxt;
+
+  uint32_t sum = (uint16_t) ~HTONS(tcp->tcpchksum);
+  sum += (uint16_t) ~(old >> 16) + (uint16_t) ~old + (new >> 16)
+    + (new & 0xffff);
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  tcp->ackno[0] = new >> 24;
+  tcp->ackno[1] = new >> 16;
+  tcp->ackno[2] = new >> 8;
+  tcp->ackno[3] = new;
+  tcp->tcpchksum = HTONS((uint16_t) ~sum);
+}
+
+
+static void
+pcap_track_seq(void)
+{
+  struct uip_tcpip_hdr *tcp = pcap_tcp();
+
+  if (tcp == NULL)
+    return;
+
+  uint32_t seq = pcap_get_seq(tcp->seqno);
+  struct pcap_flow *flow = pcap_flow(tcp->destipaddr, tcp->destport,
+				     tcp->srcport);
+
+  if (tcp->flags & PCAP_TCP_SYN)
+    {
+      if (flow == NULL)
+	{
+	  /* the oldest connection makes room */
+	  flow = &pcap_flows[pcap_flows_next++ % PCAP_FLOWS];
+	  uip_ipaddr_copy(flow->ripaddr, tcp->destipaddr);
+	  flow->rport = tcp->destport;
+	  flow->lport = tcp->srcport;
+	}
+      flow->isn = seq;
+      flow->nxt = seq + 1;
+      return;
+    }
+  if (flow == NULL)
+    return;
+
+#if UIP_CONF_IPV6
+  uint16_t len = (tcp->len[0] << 8) + tcp->len[1];
+#else
+  uint16_t len = (tcp->len[0] << 8) + tcp->len[1] - UIP_IPH_LEN;
+#endif
+  seq += len - (tcp->tcpoffset >> 4) * 4;
+  if (tcp->flags & PCAP_TCP_FIN)
+    seq++;
+  if ((int32_t) (seq - flow->nxt) > 0)
+    flow->nxt = seq;
+}
+
+
+static struct pcap_stat *
+pcap_classify(void)
+{
+  struct uip_eth_hdr *eth = (struct uip_eth_hdr *) uip_buf;
+  struct uip_udpip_hdr *ip = (struct uip_udpip_hdr *) &uip_buf[UIP_LLH_LEN];
+  uint16_t type = HTONS(eth->type);
+  uint8_t proto = 0;
+  uint16_t port = 0;
+
+#if UIP_CONF_IPV6
+  if (type == UIP_ETHTYPE_IP6 && uip_len >= UIP_LLH_LEN + UIP_IPUDPH_LEN)
+#else
+  if (type == UIP_ETHTYPE_IP && uip_len >= UIP_LLH_LEN + UIP_IPUDPH_LEN)
+#endif
+    {
+      proto = ip->proto;
+      if (proto == UIP_PROTO_TCP || proto == UIP_PROTO_UDP)
+	port = HTONS(ip->destport);
+    }
+
+  for (uint8_t i = 0; i < pcap_stats_used; i++)
+    if (pcap_stats[i].type == type && pcap_stats[i].proto == proto
+	&& pcap_stats[i].port == port)
+      return &pcap_stats[i];
+
+  /* the last entry collects everything not fitting in anymore */
+  if (pcap_stats_used == PCAP_STATS - 1)
+    return &pcap_stats[PCAP_STATS - 1];
+
+  struct pcap_stat *stat = &pcap_stats[pcap_stats_used++];
+  stat->type = type;
+  stat->proto = proto;
+  stat->port = port;
+  return stat;
+}
+
+
+static void
+pcap_report(void)
+{
+  uint64_t usec = pcap_usec() - pcap_first_usec;
+
+  fprintf(stderr, "pcap: %lu packets in %.3f s, %.0f packets/s\n",
+	  pcap_packets, usec / 1e6, usec ? pcap_packets * 1e6 / usec : 0.0);
+  fprintf(stderr, "pcap: %-12s %10s %12s %12s\n",
+	  "class", "packets", PCAP_UNIT "/pkt", "max");
+
+  for (uint8_t i = 0; i < PCAP_STATS; i++)
+    {
+      struct pcap_stat *stat = &pcap_stats[i];
+      char name[16];
+
+      if (stat->packets == 0)
+	continue;
+
+      if (i == PCAP_STATS - 1)
+	snprintf(name, sizeof(name), "other");
+      else if (stat->type == UIP_ETHTYPE_ARP)
+	snprintf(name, sizeof(name), "arp");
+      else if (stat->proto == UIP_PROTO_TCP)
+	snprintf(name, sizeof(name), "tcp/%u", stat->port);
+      else if (stat->proto == UIP_PROTO_UDP)
+	snprintf(name, sizeof(name), "udp/%u", stat->port);
+      else if (stat->proto == UIP_PROTO_ICMP)
+	snprintf(name, sizeof(name), "icmp");
+      else if (stat->proto == UIP_PROTO_ICMP6)
+	snprintf(name, sizeof(name), "icmp6");
+      else if (stat->proto)
+	snprintf(name, sizeof(name), "ip/%u", stat->proto);
+      else
+	snprintf(name, sizeof(name), "ether/%04x", stat->type);
+
+      fprintf(stderr, "pcap: %-12s %10lu %12llu %12llu\n", name,
+	      stat->packets, (unsigned long long) (stat->total / stat->packets),
+	      (unsigned long long) stat->max);
+    }
+
+  if (pcap_skipped)
+    fprintf(stderr, "pcap: %lu packets larger than the buffer skipped\n",
+	    pcap_skipped);
+
+  if (pcap_out)
+    fclose(pcap_out);
+  exit(0);
+}
+
+
+void
+pcap_read(void)
+{
+  uip_len = 0;
+
+  if (!pcap_pending)
+    {
+      if (fread(&pcap_rec, sizeof(pcap_rec), 1, pcap_in) != 1)
+	pcap_report();
+      pcap_pending = 1;
+    }
+
+  uint32_t frac = pcap_get32(pcap_rec.ts_frac);
+  uint64_t ts = pcap_get32(pcap_rec.ts_sec) * 1000000ULL
+    + (pcap_nsec ? frac / 1000 : frac);
+
+  if (pcap_first_usec == 0)
+    {
+      pcap_first_ts = ts;
+      pcap_first_usec = pcap_usec();
+    }
+  else if (pcap_timed)
+    {
+      int64_t wait = (int64_t) (ts - pcap_first_ts)
+	- (int64_t) (pcap_usec() - pcap_first_usec);
+
+      if (wait > PCAP_TICK)
+	{
+	  usleep(PCAP_TICK);
+	  return;
+	}
+      if (wait > 0)
+	usleep(wait);
+    }
+
+  pcap_pending = 0;
+
+  uint32_t caplen = pcap_get32(pcap_rec.caplen);
+  if (caplen > UIP_CONF_BUFFER_SIZE)
+    {
+      fseek(pcap_in, caplen, SEEK_CUR);
+      pcap_skipped++;
+      return;
+    }
+  if (fread(uip_buf, caplen, 1, pcap_in) != 1)
+    pcap_report();
+
+  uip_len = caplen;
+  pcap_track_ack();
+  struct pcap_stat *stat = pcap_classify();
+
+  pcap_timing = 1;
+  uint64_t start = pcap_cycles();
+  tap_input();
+  uint64_t cycles = pcap_cycles() - start;
+  pcap_timing = 0;
+  pcap_flush();
+
+  pcap_packets++;
+  stat->packets++;
+  stat->total += cycles;
+  if (cycles > stat->max)
+    stat->max = cycles;
+}
+
+
+void
+pcap_write(void)
+{
+  uint64_t now = pcap_usec();
+  struct pcap_rec_hdr rec = {
+    .ts_sec = now / 1000000,
+    .ts_frac = now % 1000000,
+    .caplen = uip_len,
+    .len = uip_len,
+  };
+
+  pcap_track_seq();
+
+  if (pcap_out == NULL)
+    return;
+
+  if (pcap_timing)
+    {
+      /* a full queue has to go out now, keeping the frames in order */
+      if (pcap_queued == PCAP_QUEUE)
+	pcap_flush();
+
+      struct pcap_frame *frame = &pcap_queue[pcap_queued++];
+      frame->rec = rec;
+      memcpy(frame->data, uip_buf, uip_len);
+      return;
+    }
+
+  fwrite(&rec, sizeof(rec), 1, pcap_out);
+  fwrite(uip_buf, uip_len, 1, pcap_out);
+}
@@ -0,0 +1,40 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef CORE_HOST_PCAP_H
+#define CORE_HOST_PCAP_H
+
+/* environment variables controlling the replay */
+#define PCAP_ENV_IN     "ESEX_PCAP_IN"
+#define PCAP_ENV_OUT    "ESEX_PCAP_OUT"
+#define PCAP_ENV_TIMED  "ESEX_PCAP_TIMED"
+
+/* number of packet classes kept apart in the statistics */
+#define PCAP_STATS      16
+
+/* frames sent while a packet is processed, written out afterwards */
+#define PCAP_QUEUE      4
+
+/* TCP connections whose acknowledgements are mapped onto the stack */
+#define PCAP_FLOWS      16
+
+extern int pcap_replay;
+
+int pcap_open(void);
+void pcap_read(void);
+void pcap_write(void);
+
+#endif  /* CORE_HOST_PCAP_H */
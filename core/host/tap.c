@@ -31,6 +31,7 @@
 #include "config.h"
 #include "core/debug.h"
 #include "core/host/tap.h"
+#include "core/host/pcap.h"
 #include "protocols/uip/uip.h"
 #include "protocols/uip/uip_router.h"
 #include "protocols/uip/uip_arp.h"
@@ -81,6 +82,13 @@ open_tap(void)
 {
   char tap_name[16] = "esex%d";
 
+#ifdef TAP_PCAP_SUPPORT
+  /* feed a capture file instead of the device, if asked to */
+  tap_fd = pcap_open();
+  if (tap_fd >= 0)
+    return;
+#endif
+
   tap_fd = tap_alloc(tap_name);
   if (tap_fd < 0)
     die("Couldn't open tap device");
@@ -99,8 +107,23 @@ void
 tap_read (void)
 {
   uip_stack_set_active(STACK_TAP);
+
+#ifdef TAP_PCAP_SUPPORT
+  if (pcap_replay)
+    {
+      pcap_read();
+      return;
+    }
+#endif
+
   uip_len = read (tap_fd, uip_buf, UIP_CONF_BUFFER_SIZE);
+  tap_input();
+}
 
+
+void
+tap_input (void)
+{
   /* process packet */
   struct uip_eth_hdr *packet = (struct uip_eth_hdr *)&uip_buf;
 
@@ -167,6 +190,14 @@ tap_send (void)
   eh->vid_lo = CONF_8021Q_VID & 0xFF;
 #endif
 
+#ifdef TAP_PCAP_SUPPORT
+  if (pcap_replay)
+    {
+      pcap_write();
+      return;
+    }
+#endif
+
   write (tap_fd, uip_buf, uip_len);
 }
 
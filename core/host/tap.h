@@ -23,6 +23,7 @@ void open_tap(void);
 extern int tap_fd;
 
 void tap_read(void);
+void tap_input(void);
 void tap_send(void);
 uint8_t tap_txstart(void);
 
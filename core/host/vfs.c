@@ -17,6 +17,7 @@
  */
 
 #include <glib.h>
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -68,9 +69,19 @@ vfs_host_open (const char *filename)
   g_free (p);
 
   if (fd < 0)
-    return NULL;
+    {
+      if (errno != ENOENT && errno != ENOTDIR)
+	vfs_open_failed = 1;
+      return NULL;
+    }
+
+  struct vfs_file_handle_t *fh = vfs_handle_alloc ();
+  if (fh == NULL)
+    {
+      close (fd);
+      return NULL;
+    }
 
-  struct vfs_file_handle_t *fh = g_malloc (sizeof (struct vfs_file_handle_t));
   fh->fh_type = VFS_HOST;
   fh->u.host.fd = fd;
 
@@ -81,7 +92,7 @@ void
 vfs_host_close (struct vfs_file_handle_t *fh)
 {
   close (fh->u.host.fd);
-  g_free (fh);
+  vfs_handle_free (fh);
 }
 
 vfs_size_t 
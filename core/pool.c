@@ -0,0 +1,68 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#include <stddef.h>
+
+#include "config.h"
+#include "core/pool.h"
+
+struct pool_t *pool_first;
+
+void *
+pool_alloc(struct pool_t *pool)
+{
+  void *ptr = pool->free;
+
+  if (ptr != NULL)
+    pool->free = *(void **) ptr;
+  else if (pool->fresh < pool->end)
+  {
+    ptr = pool->fresh;
+    pool->fresh += pool->size;
+  }
+  else
+  {
+    if (pool->fails < UINT8_MAX)
+      pool->fails++;
+    return NULL;
+  }
+
+  if (pool->high == 0)
+  {
+    /* first allocation ever, make the pool known to the statistics */
+    pool->next = pool_first;
+    pool_first = pool;
+  }
+
+  if (++pool->used > pool->high)
+    pool->high = pool->used;
+
+  return ptr;
+}
+
+void
+pool_free(struct pool_t *pool, void *ptr)
+{
+  if (ptr == NULL)
+    return;
+
+  *(void **) ptr = pool->free;
+  pool->free = ptr;
+  pool->used--;
+}
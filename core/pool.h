@@ -0,0 +1,86 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+/* Fixed-size object pools.
+ *
+ * A pool hands out blocks of one size from a static array, so objects that
+ * are allocated and released all the time (file handles, cron jobs, ...)
+ * neither fragment the heap nor compete with the stack for it.  Released
+ * blocks are kept in a singly linked free list, blocks never used so far
+ * are taken from the end of the array, both in constant time.
+ *
+ * The pools are meant to be used from the main loop only, pool_alloc and
+ * pool_free must not be called from interrupt context. */
+
+struct pool_t
+{
+  uint8_t *base;                /* first block of the storage array */
+  uint8_t *end;                 /* first byte after the storage array */
+  uint8_t *fresh;               /* first block never handed out so far */
+  void *free;                   /* list of released blocks */
+  uint16_t size;                /* size of a single block */
+  uint8_t count;                /* number of blocks */
+  uint8_t used;                 /* blocks currently allocated */
+  uint8_t high;                 /* high-water mark of used */
+  uint8_t fails;                /* allocations refused, saturates at 255 */
+  const char *name;             /* name for the statistics, in flash */
+  struct pool_t *next;          /* list of pools in use, see pool_first */
+};
+
+/* Define the pool NAME of COUNT blocks with room for SIZE bytes each.
+ * The storage is reserved statically, so the pool shows up in .bss. */
+#define POOL_DEFINE(name, size, count)                               \
+  static union                                                       \
+  {                                                                  \
+    void *link;                                                      \
+    uint8_t data[(size)];                                            \
+  } name##_blocks[(count)];                                          \
+  static const char name##_name[] PROGMEM = #name;                   \
+  struct pool_t name = {                                             \
+    (uint8_t *) name##_blocks,                                       \
+    (uint8_t *) name##_blocks + sizeof(name##_blocks),               \
+    (uint8_t *) name##_blocks,                                       \
+    NULL,                                                            \
+    sizeof(name##_blocks[0]),                                        \
+    (count), 0, 0, 0,                                                \
+    name##_name,                                                     \
+    NULL,                                                            \
+  }
+
+/* Return a block of POOL or NULL if all blocks are in use. */
+void *pool_alloc(struct pool_t *pool);
+
+/* Hand the block PTR back to POOL, PTR may be NULL. */
+void pool_free(struct pool_t *pool, void *ptr);
+
+/* Tell whether PTR is a block of POOL. */
+#define pool_contains(pool, ptr)                                     \
+  ((uint8_t *) (ptr) >= (pool)->base && (uint8_t *) (ptr) < (pool)->end)
+
+/* First pool that has been used at least once, the others are chained
+ * via the next member.  Used by the "pool stats" command. */
+extern struct pool_t *pool_first;
+
+#endif /* _POOL_H */
@@ -0,0 +1,63 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#include <stdio.h>
+#include <avr/pgmspace.h>
+
+#include "config.h"
+#include "core/pool.h"
+
+#include "protocols/ecmd/ecmd-base.h"
+
+typedef struct
+{
+  uint8_t magic;
+  struct pool_t *pos;
+} pool_stats_state_t;
+
+int16_t
+parse_cmd_pool_stats(char *cmd, char *output, uint16_t len)
+{
+  /* use the bytes of cmd to keep our position between the calls */
+  pool_stats_state_t *state = (pool_stats_state_t *) cmd;
+  if (state->magic != 23)
+  {
+    state->magic = 23;
+    state->pos = pool_first;
+  }
+
+  struct pool_t *pool = state->pos;
+  if (pool == NULL)
+    return ECMD_FINAL_OK;
+  state->pos = pool->next;
+
+  /* name used/high/count, size of a block and refused allocations */
+  int16_t ret = snprintf_P(output, len, PSTR("%S %u/%u/%u size %u fails %u"),
+                           pool->name, pool->used, pool->high, pool->count,
+                           pool->size, pool->fails);
+  return state->pos ? ECMD_AGAIN(ret) : ECMD_FINAL(ret);
+}
+
+/*
+  -- Ethersex META --
+  block(Miscelleanous)
+  ecmd_ifdef(POOL_SUPPORT)
+    ecmd_feature(pool_stats, "pool stats",, List the object pools with used/high/total blocks, block size and failed allocations)
+  ecmd_endif()
+*/
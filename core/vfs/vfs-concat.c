@@ -36,7 +36,9 @@ usage(int exitval)
 {
   fprintf(exitval ? stderr : stdout,
           "Usage: vfs-concat IMAGE BLOCKSZ FILE\n"
-          "Concatenate FILE to existing ethersex IMAGE.\n\n");
+          "       vfs-concat --index IMAGE BLOCKSZ\n"
+          "Concatenate FILE to existing ethersex IMAGE, or fill in the\n"
+          "directory of all files embedded in IMAGE.\n\n");
   exit(exitval);
 }
 
@@ -71,6 +73,116 @@ crc_calc(uint8_t * data, int len)
 }
 
 
+static int
+dirent_cmp(const void *a, const void *b)
+{
+  const struct vfs_inline_dirent_t *x = a, *y = b;
+
+  if (x->hash != y->hash)
+    return x->hash < y->hash ? -1 : 1;
+
+  /* the firmware used to scan from the end of the flash, so the file
+   * embedded last wins if a name is used twice */
+  return x->offset < y->offset ? 1 : -1;
+}
+
+
+static int
+index_image(const char *image, int pagesz)
+{
+  static uint8_t buf_image[MAX_IMAGE_SIZE];
+  struct vfs_inline_dirent_t e[UINT8_MAX];
+  struct vfs_inline_dir_t *dir = NULL;
+  int image_len, count = 0;
+  FILE *f;
+
+  if ((f = fopen(image, "rb")) == NULL)
+  {
+    fprintf(stderr, "vfs-concat: Unable to read %s.\n", image);
+    return 1;
+  }
+
+  image_len = fread(buf_image, 1, MAX_IMAGE_SIZE, f);
+  fclose(f);
+
+  for (int i = 0; i + (int) sizeof(*dir) <= image_len; i++)
+    if (memcmp(buf_image + i, VFS_INLINE_DIR_MAGIC,
+               sizeof(VFS_INLINE_DIR_MAGIC)) == 0)
+    {
+      dir = (struct vfs_inline_dir_t *) (buf_image + i);
+      break;
+    }
+
+  if (dir == NULL)
+  {
+    fprintf(stderr, "vfs-concat: No directory found in %s.\n", image);
+    return 1;
+  }
+
+  /* walk the embedded files the same way the firmware does, but skip over
+   * the contents of each file found */
+  for (int offset = 0; offset + (int) sizeof(union vfs_inline_node_t) < image_len;)
+  {
+    union vfs_inline_node_t node;
+
+    memcpy(&node, buf_image + offset + 1, sizeof(node));
+    if (buf_image[offset] != VFS_INLINE_MAGIC ||
+        node.s.crc != crc_calc(node.raw, sizeof(node) - 1) ||
+        (uint8_t *) dir > buf_image + offset)
+    {
+      offset += pagesz;
+      continue;
+    }
+
+    /* the directory holds at most UINT8_MAX entries, more files are
+     * only counted and make it fall back to the flash scan below */
+    if (count < UINT8_MAX)
+    {
+      e[count].hash = vfs_inline_hash(node.s.fn);
+      e[count].offset = offset;
+    }
+    count++;
+
+    offset += 1 + sizeof(node) + node.s.len;
+    offset = (offset + pagesz - 1) / pagesz * pagesz;
+  }
+
+  if (count > dir->size)
+  {
+    fprintf(stderr, "vfs-concat: %d files, but the directory only has "
+            "%d entries. Files will be searched in flash.\n",
+            count, dir->size);
+    count = 0;
+  }
+
+  qsort(e, count, sizeof(e[0]), dirent_cmp);
+  memcpy(dir->e, e, count * sizeof(e[0]));
+  dir->count = count;
+
+  fprintf(stderr, "vfs-concat: %d files indexed.\n", count);
+  fwrite(buf_image, 1, image_len, stdout);
+
+  return 0;
+}
+
+
+static uint16_t
+crc16_calc(uint8_t * data, int len)
+{
+  /* same polynomial as _crc16_update() of avr-libc */
+  uint16_t crc = 0xFFFF;
+
+  for (int i = 0; i < len; i++)
+  {
+    crc ^= data[i];
+    for (int j = 0; j < 8; j++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+  }
+
+  return crc;
+}
+
+
 int
 main(int argc, char **argv)
 {
@@ -86,6 +198,17 @@ main(int argc, char **argv)
   if (argc != 4)
     usage(1);
 
+  if (strcmp(argv[1], "--index") == 0)
+  {
+    pagesz = atoi(argv[3]);
+    if (pagesz == 0 || pagesz % 2 || pagesz < 64 || pagesz > 256)
+    {
+      fprintf(stderr, "vfs-concat: Invalid page size: %d.\n", pagesz);
+      return 1;
+    }
+    return index_image(argv[2], pagesz);
+  }
+
   pagesz = atoi(argv[2]);
   if (pagesz == 0 || pagesz % 2 || pagesz < 64 || pagesz > 256)
   {
@@ -144,6 +267,7 @@ main(int argc, char **argv)
 
   strncpy(node.s.fn, argv[3], VFS_INLINE_FNLEN);
   node.s.len = file_len;
+  node.s.sum = crc16_calc(buf_file, file_len);
   node.s.crc = crc_calc(node.raw, sizeof(node) - 1);
 
   fwrite(&node, sizeof(node), 1, stdout);
@@ -98,4 +98,16 @@ vfs_file_append(const char *filename, uint8_t* buf, uint16_t len)
     return 0;
 }
 
+uint32_t
+vfs_name_hash (const char *name, uint8_t *len)
+{
+  /* FNV-1a */
+  uint32_t hash = 2166136261UL;
+  uint8_t i;
+  for (i = 0; name[i]; i ++)
+    hash = (hash ^ (uint8_t) name[i]) * 16777619UL;
+  *len = i;
+  return hash;
+}
+
 #endif  /* VFS_TEENSY */
@@ -36,5 +36,8 @@ struct vfs_file_handle_t * vfs_open_or_creat(const char* filename);
 /* Opens/creates a file and appends buffer to it */
 uint8_t vfs_file_append(const char *filename, uint8_t* buf, uint16_t len);
 
+/* Hash NAME for the lookup caches, its length is stored to LEN. */
+uint32_t vfs_name_hash (const char *name, uint8_t *len);
+
 
 #endif	/* VFS_UTIL_H */
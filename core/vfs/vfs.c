@@ -21,8 +21,24 @@
  */
 
 #include <avr/pgmspace.h>
+#include <string.h>
 #include "core/debug.h"
 #include "core/vfs/vfs.h"
+#include "core/vfs/vfs-util.h"
+
+POOL_DEFINE(vfs_handle_pool, sizeof(struct vfs_file_handle_t), VFS_HANDLES);
+
+uint8_t vfs_open_failed;
+
+struct vfs_file_handle_t *
+vfs_handle_alloc(void)
+{
+  struct vfs_file_handle_t *fh = pool_alloc(&vfs_handle_pool);
+  if (fh == NULL)
+    vfs_open_failed = 1;
+  return fh;
+}
+
 #ifndef VFS_TEENSY
 
 const struct vfs_func_t vfs_funcs[] PROGMEM = {
@@ -50,35 +66,123 @@ const struct vfs_func_t vfs_funcs[] PROGMEM = {
 #ifdef VFS_DC3840_SUPPORT
   VFS_DC3840_FUNCS,
 #endif
+#ifdef VFS_RAM_SUPPORT
+  VFS_RAM_FUNCS,
+#endif
 #ifdef VFS_HOST_SUPPORT
   VFS_HOST_FUNCS,
 #endif
 };
 
 
+#if VFS_LOOKUP_CACHE > 0
+/* Names that were not found by any module, so repeated requests for
+ * missing files (e.g. favicon.ico or the index.html fallback of httpd) do
+ * not walk all modules again. */
+static struct
+{
+  uint32_t hash;
+  uint8_t len;
+} vfs_lookup_cache[VFS_LOOKUP_CACHE];
+static uint8_t vfs_lookup_cache_next;
+
+void
+vfs_lookup_cache_flush(void)
+{
+  memset(vfs_lookup_cache, 0, sizeof(vfs_lookup_cache));
+}
+#endif /* VFS_LOOKUP_CACHE > 0 */
+
+
+/* If FILENAME starts with the name of a module followed by a slash, return
+ * that module and strip the prefix.  Otherwise return VFS_LAST. */
+static uint8_t
+vfs_mount_lookup(const char **filename)
+{
+  const char *fn = *filename;
+  if (*fn == '/')
+    fn++;
+
+  for (uint8_t i = 0; i < VFS_LAST; i++)
+  {
+    const char *name = (const char *) pgm_read_word(&vfs_funcs[i].mod_name);
+    uint8_t len = strlen(name);
+    if (strncmp(fn, name, len) == 0 && fn[len] == '/')
+    {
+      *filename = fn + len + 1;
+      return i;
+    }
+  }
+
+  return VFS_LAST;
+}
+
+
 struct vfs_file_handle_t *
 vfs_open(const char *filename)
 {
-  for (uint8_t i = 0; i < VFS_LAST; i++)
+  struct vfs_file_handle_t *(*open) (const char *);
+  struct vfs_file_handle_t *fh;
+
+  uint8_t i = vfs_mount_lookup(&filename);
+  if (i != VFS_LAST)
+  {
+    open = VFS_FUNC_P(i, open);
+    return open ? open(filename) : NULL;
+  }
+
+#if VFS_LOOKUP_CACHE > 0
+  uint8_t len;
+  uint32_t hash = vfs_name_hash(filename, &len);
+  for (i = 0; i < VFS_LOOKUP_CACHE; i++)
+    if (vfs_lookup_cache[i].hash == hash && vfs_lookup_cache[i].len == len)
+      return NULL;
+#endif
+
+  /* try all modules in order, inlined files are the fallback */
+  vfs_open_failed = 0;
+  for (i = 0; i < VFS_LAST; i++)
   {
-    struct vfs_func_t funcs;
-    memcpy_P(&funcs, &vfs_funcs[i], sizeof(struct vfs_func_t));
-    if (funcs.open)
-      return funcs.open(filename);
+    open = VFS_FUNC_P(i, open);
+    if (open && (fh = open(filename)) != NULL)
+      return fh;
   }
 
+#if VFS_LOOKUP_CACHE > 0
+  /* only remember names that no module has, not temporary failures */
+  if (vfs_open_failed)
+    return NULL;
+
+  vfs_lookup_cache[vfs_lookup_cache_next].hash = hash;
+  vfs_lookup_cache[vfs_lookup_cache_next].len = len;
+  if (++vfs_lookup_cache_next == VFS_LOOKUP_CACHE)
+    vfs_lookup_cache_next = 0;
+#endif
+
   return NULL;
 }
 
 struct vfs_file_handle_t *
 vfs_create(const char *name)
 {
-  for (uint8_t i = 0; i < VFS_LAST; i++)
+  struct vfs_file_handle_t *(*create) (const char *);
+
+#if VFS_LOOKUP_CACHE > 0
+  vfs_lookup_cache_flush();
+#endif
+
+  uint8_t i = vfs_mount_lookup(&name);
+  if (i != VFS_LAST)
   {
-    struct vfs_func_t funcs;
-    memcpy_P(&funcs, &vfs_funcs[i], sizeof(struct vfs_func_t));
-    if (funcs.create)
-      return funcs.create(name);
+    create = VFS_FUNC_P(i, create);
+    return create ? create(name) : NULL;
+  }
+
+  for (i = 0; i < VFS_LAST; i++)
+  {
+    create = VFS_FUNC_P(i, create);
+    if (create)
+      return create(name);
   }
 
   return NULL;
@@ -89,17 +193,28 @@ vfs_size_t
 vfs_read_write_size(uint8_t flag, struct vfs_file_handle_t * handle,
                     void *buf, vfs_size_t length)
 {
-  struct vfs_func_t funcs;
-  memcpy_P(&funcs, &vfs_funcs[handle->fh_type], sizeof(struct vfs_func_t));
-
-  if (flag == 0 && funcs.read)
-    return funcs.read(handle, buf, length);
-
-  if (flag == 1 && funcs.write)
-    return funcs.write(handle, buf, length);
+  uint8_t type = handle->fh_type;
 
-  if (flag == 2 && funcs.size)
-    return funcs.size(handle);
+  if (flag == 0)
+  {
+    vfs_size_t(*read) (struct vfs_file_handle_t *, void *, vfs_size_t) =
+      VFS_FUNC_P(type, read);
+    if (read)
+      return read(handle, buf, length);
+  }
+  else if (flag == 1)
+  {
+    vfs_size_t(*write) (struct vfs_file_handle_t *, void *, vfs_size_t) =
+      VFS_FUNC_P(type, write);
+    if (write)
+      return write(handle, buf, length);
+  }
+  else
+  {
+    vfs_size_t(*size) (struct vfs_file_handle_t *) = VFS_FUNC_P(type, size);
+    if (size)
+      return size(handle);
+  }
 
   return 0;
 }
@@ -109,18 +224,29 @@ uint8_t
 vfs_fseek_truncate_close(uint8_t flag, struct vfs_file_handle_t * handle,
                          vfs_size_t length, uint8_t whence)
 {
-  struct vfs_func_t funcs;
-  memcpy_P(&funcs, &vfs_funcs[handle->fh_type], sizeof(struct vfs_func_t));
-
-  if (flag == 0 && funcs.fseek)
-    /* handle, offset, whence */
-    return funcs.fseek(handle, length, whence);
-
-  if (flag == 1 && funcs.truncate)
-    return funcs.truncate(handle, length);
+  uint8_t type = handle->fh_type;
 
-  if (flag == 2 && funcs.close)
-    funcs.close(handle);
+  if (flag == 0)
+  {
+    uint8_t(*fseek) (struct vfs_file_handle_t *, vfs_size_t, uint8_t) =
+      VFS_FUNC_P(type, fseek);
+    if (fseek)
+      /* handle, offset, whence */
+      return fseek(handle, length, whence);
+  }
+  else if (flag == 1)
+  {
+    uint8_t(*truncate) (struct vfs_file_handle_t *, vfs_size_t) =
+      VFS_FUNC_P(type, truncate);
+    if (truncate)
+      return truncate(handle, length);
+  }
+  else
+  {
+    void (*close) (struct vfs_file_handle_t *) = VFS_FUNC_P(type, close);
+    if (close)
+      close(handle);
+  }
 
   return 0;
 }
@@ -128,17 +254,51 @@ vfs_fseek_truncate_close(uint8_t flag, struct vfs_file_handle_t * handle,
 uint8_t
 vfs_unlink(const char *name)
 {
-  for (uint8_t i = 0; i < VFS_LAST; i++)
+  uint8_t(*unlink) (const char *);
+
+#if VFS_LOOKUP_CACHE > 0
+  vfs_lookup_cache_flush();
+#endif
+
+  uint8_t i = vfs_mount_lookup(&name);
+  if (i != VFS_LAST)
   {
-    struct vfs_func_t funcs;
-    memcpy_P(&funcs, &vfs_funcs[i], sizeof(struct vfs_func_t));
-    if (funcs.unlink)
-      return funcs.unlink(name);
+    unlink = VFS_FUNC_P(i, unlink);
+    return unlink ? unlink(name) : 0;
+  }
+
+  for (i = 0; i < VFS_LAST; i++)
+  {
+    unlink = VFS_FUNC_P(i, unlink);
+    if (unlink)
+      return unlink(name);
   }
 
   return 0;
 }
 
+uint8_t
+vfs_etag(struct vfs_file_handle_t *handle, uint32_t * etag)
+{
+  switch (handle->fh_type)
+  {
+#ifdef VFS_INLINE_SUPPORT
+    case VFS_INLINE:
+      return vfs_inline_etag(handle, etag);
+#endif
+#ifdef VFS_DF_SUPPORT
+    case VFS_DF:
+      return vfs_df_etag(handle, etag);
+#endif
+#if defined(VFS_SD_SUPPORT) && FAT_DATETIME_SUPPORT
+    case VFS_SD:
+      return vfs_sd_etag(handle, etag);
+#endif
+    default:
+      return 0;
+  }
+}
+
 #endif /* not VFS_TEENSY */
 
 /*
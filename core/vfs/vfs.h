@@ -25,6 +25,7 @@
 
 #include <avr/pgmspace.h>
 #include "config.h"
+#include "core/pool.h"
 
 enum vfs_type_t
 {
@@ -52,6 +53,9 @@ enum vfs_type_t
 #ifdef VFS_DC3840_SUPPORT
   VFS_DC3840,
 #endif
+#ifdef VFS_RAM_SUPPORT
+  VFS_RAM,
+#endif
 #ifdef VFS_HOST_SUPPORT
   VFS_HOST,
 #endif
@@ -79,6 +83,7 @@ typedef uint32_t vfs_size_t;
 #include "hardware/i2c/master/vfs_eeprom.h"
 #include "hardware/i2c/master/vfs_eeprom_raw.h"
 #include "hardware/camera/vfs_dc3840.h"
+#include "hardware/serial_ram/23k256/vfs_ram.h"
 #include "core/host/vfs.h"
 
 struct vfs_file_handle_t
@@ -95,10 +100,22 @@ struct vfs_file_handle_t
     vfs_file_handle_sd_t sd;
     vfs_file_handle_inline_t il;
     vfs_file_handle_dc3840_t dc3840;
+    vfs_file_handle_ram_t ram;
     vfs_file_handle_host_t host;
   } u;
 };
 
+/* File handles are taken from a pool of VFS_HANDLES blocks, modules use
+ * these instead of malloc and free. */
+extern struct pool_t vfs_handle_pool;
+struct vfs_file_handle_t *vfs_handle_alloc(void);
+#define vfs_handle_free(fh)	pool_free(&vfs_handle_pool, fh)
+
+/* Set by the open function of a module if it could not tell whether the
+ * file exists, e.g. no handle was left or the medium could not be read.
+ * vfs_open does not remember such a name as missing. */
+extern uint8_t vfs_open_failed;
+
 struct vfs_func_t
 {
   /* VFS module name, i.e. the "mount point" */
@@ -147,7 +164,9 @@ extern const struct vfs_func_t vfs_funcs[];
 #define SEEK_END 2
 
 /* Generic variant of open that automagically finds the suitable
-   VFS module. */
+   VFS module.  A filename starting with a module name and a slash, e.g.
+   "sd/index.html", is only looked up in that module.  Otherwise all
+   modules are tried in turn. */
 struct vfs_file_handle_t *vfs_open(const char *filename);
 
 /* Generic variante of create, that automatically finds a suitable
@@ -160,11 +179,28 @@ uint8_t vfs_fseek_truncate_close(uint8_t flag,
 
 uint8_t vfs_unlink(const char *filename);
 
+/* Store a validator of the file's contents to ETAG, that changes whenever
+ * the contents change.  Returns 0 if the module cannot provide one, and
+ * VFS_ETAG_WEAK if different contents might share the same value. */
+#define VFS_ETAG_STRONG	1
+#define VFS_ETAG_WEAK	2
+uint8_t vfs_etag(struct vfs_file_handle_t *handle, uint32_t * etag);
+
+#if VFS_LOOKUP_CACHE > 0
+/* Forget about files not found so far, call this if a module's contents
+ * changed without vfs_create or vfs_unlink, e.g. after a card change. */
+void vfs_lookup_cache_flush(void);
+#endif
+
 vfs_size_t vfs_read_write_size(uint8_t flag, struct vfs_file_handle_t *handle,
                                void *buf, vfs_size_t length);
 
+/* Fetch a single function pointer of module TYPE from flash. */
+#define VFS_FUNC_P(type,call)	              \
+  ((__typeof__ (vfs_funcs[0].call)) pgm_read_word(&vfs_funcs[type].call))
+
 #define VFS_FUNC(handle,call)	              \
-  ((pgm_read_word(((void *)&(vfs_funcs[(handle)->fh_type].call))))
+  VFS_FUNC_P((handle)->fh_type, call)
 
 /* Generation of forwarder functions. */
 
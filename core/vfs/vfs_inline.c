@@ -22,6 +22,8 @@
 #include <avr/pgmspace.h>
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "core/eeprom.h"
 #include "core/vfs/vfs.h"
@@ -32,37 +34,115 @@
 #define __pgm_read_byte pgm_read_byte_near
 #endif
 
+/* the directory counts its entries in a byte */
+#if VFS_INLINE_DIR_ENTRIES > UINT8_MAX || VFS_INLINE_DIR_ENTRIES < 1
+#error "VFS_INLINE_DIR_ENTRIES must be between 1 and 255"
+#endif
+
+const struct vfs_inline_dir_t vfs_inline_dir PROGMEM = {
+  VFS_INLINE_DIR_MAGIC, VFS_INLINE_DIR_ENTRIES, 0,
+  { [VFS_INLINE_DIR_ENTRIES - 1] = { 0, 0 } }
+};
+
+/* Number of usable directory entries, zero if the directory is empty or
+ * broken. */
+static uint8_t vfs_inline_dir_count;
+
+
+/* Read the node at OFFSET and check its magic and checksum. */
+static uint8_t
+vfs_inline_node (vfs_size_t offset, union vfs_inline_node_t *node)
+{
+  if (__pgm_read_byte (offset) != VFS_INLINE_MAGIC)
+    return 0;
+
+  for (uint8_t i = 0; i < sizeof (*node); i ++)
+    node->raw[i] = __pgm_read_byte (offset + i + 1);
+
+  return node->s.crc == crc_checksum (node->raw, sizeof (*node) - 1);
+}
+
+
+static struct vfs_file_handle_t *
+vfs_inline_handle (vfs_size_t offset, union vfs_inline_node_t *node)
+{
+  /* Found file, create a handle. */
+  struct vfs_file_handle_t *fh = vfs_handle_alloc();
+  if (fh == NULL)
+    return NULL;
+
+  fh->fh_type = VFS_INLINE;
+  fh->u.il.offset = offset + sizeof (union vfs_inline_node_t) + 1;
+  fh->u.il.pos = 0;
+  fh->u.il.len = node->s.len;
+  return fh;
+}
+
+
+/* Check the nodes referenced by the directory once, so open does not need
+ * to verify the checksum again. */
+void
+vfs_inline_init (void)
+{
+  uint8_t count = pgm_read_byte (&vfs_inline_dir.count);
+  if (count > VFS_INLINE_DIR_ENTRIES)
+    return;
+
+  for (uint8_t i = 0; i < count; i ++) {
+    union vfs_inline_node_t node;
+    vfs_size_t offset = pgm_read_dword (&vfs_inline_dir.e[i].offset);
+
+    if (!vfs_inline_node (offset, &node) ||
+	vfs_inline_hash (node.s.fn) != pgm_read_word (&vfs_inline_dir.e[i].hash))
+      return;			/* Directory is stale, keep scanning. */
+  }
+
+  vfs_inline_dir_count = count;
+}
+
 
 struct vfs_file_handle_t *
 vfs_inline_open (const char *filename)
 {
-  vfs_size_t offset = FLASHEND - SPM_PAGESIZE + 1;
-  for (; offset; offset -= SPM_PAGESIZE) {
-    if (__pgm_read_byte (offset) != VFS_INLINE_MAGIC)
-      continue;
+  union vfs_inline_node_t node;
+
+  if (vfs_inline_dir_count) {
+    uint16_t hash = vfs_inline_hash (filename);
+    uint8_t lo = 0, hi = vfs_inline_dir_count;
+
+    /* Find the first entry with a matching hash. */
+    while (lo < hi) {
+      uint8_t mid = (uint8_t) ((lo + hi) / 2);
+      if (pgm_read_word (&vfs_inline_dir.e[mid].hash) < hash)
+	lo = (uint8_t) (mid + 1);
+      else
+	hi = mid;
+    }
 
-    union vfs_inline_node_t node;
-    uint8_t i;
+    for (; lo < vfs_inline_dir_count; lo ++) {
+      if (pgm_read_word (&vfs_inline_dir.e[lo].hash) != hash)
+	break;
+
+      vfs_size_t offset = pgm_read_dword (&vfs_inline_dir.e[lo].offset);
+      for (uint8_t i = 0; i < sizeof (node); i ++)
+	node.raw[i] = __pgm_read_byte (offset + i + 1);
 
-    for (i = 0; i < sizeof (node); i ++)
-      node.raw[i] = __pgm_read_byte (offset + i + 1);
+      if (strncmp (node.s.fn, filename, VFS_INLINE_FNLEN) == 0)
+	return vfs_inline_handle (offset, &node);
+    }
+
+    return NULL;		/* File not found. */
+  }
 
-    if (node.s.crc != crc_checksum (node.raw, sizeof (node) - 1))
+  vfs_size_t offset = FLASHEND - SPM_PAGESIZE + 1;
+  for (; offset; offset -= SPM_PAGESIZE) {
+    if (!vfs_inline_node (offset, &node))
       continue;
 
     if (strncmp (node.s.fn, filename, VFS_INLINE_FNLEN))
       continue;
 
-    /* Found file, create a handle. */
-    struct vfs_file_handle_t *fh = malloc (sizeof (struct vfs_file_handle_t));
-    if (fh == NULL)
-      return NULL;
-
-    fh->fh_type = VFS_INLINE;
-    fh->u.il.offset = offset + sizeof (union vfs_inline_node_t) + 1;
-    fh->u.il.pos = 0;
-    fh->u.il.len = node.s.len;
-    return fh;
+    return vfs_inline_handle (offset, &node);
   }
 
   return NULL;			/* File not found. */
@@ -72,7 +152,7 @@ vfs_inline_open (const char *filename)
 void
 vfs_inline_close (struct vfs_file_handle_t *fh)
 {
-  free (fh);
+  vfs_handle_free (fh);
 }
 #endif	/* VFS_TEENSY */
 
@@ -128,3 +208,20 @@ vfs_inline_size (struct vfs_file_handle_t *fh)
   return fh->u.il.len;
 }
 #endif	/* VFS_TEENSY */
+
+uint8_t
+vfs_inline_etag (struct vfs_file_handle_t *fh, uint32_t *etag)
+{
+  vfs_size_t sum = fh->u.il.offset - sizeof (union vfs_inline_node_t)
+    + offsetof (union vfs_inline_node_t, s.sum);
+
+  *etag = ((uint32_t) __pgm_read_byte (sum + 1) << 24)
+    | ((uint32_t) __pgm_read_byte (sum) << 16) | fh->u.il.len;
+  return VFS_ETAG_STRONG;
+}
+
+/*
+  -- Ethersex META --
+  header(core/vfs/vfs_inline.h)
+  init(vfs_inline_init)
+*/
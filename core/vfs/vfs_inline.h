@@ -31,19 +31,48 @@ union vfs_inline_node_t {
   struct __attribute__((__packed__)) {
     char fn[VFS_INLINE_FNLEN];
     uint16_t len;
+    uint16_t sum;		/* CRC16 of the contents, used as ETag */
     uint8_t crc;
   } s ;
 
   unsigned char raw[0];
 };
 
+/* Directory of the inlined files, sorted by name hash.  The firmware only
+ * reserves SIZE entries, they are filled in by "vfs-concat --index" after
+ * all files have been embedded.  A COUNT of zero makes vfs_inline_open fall
+ * back to scanning the flash. */
+#define VFS_INLINE_DIR_MAGIC "vfs-inline-dir"
+
+struct __attribute__((__packed__)) vfs_inline_dirent_t {
+  uint16_t hash;
+  uint32_t offset;		/* Offset of the node's magic byte. */
+};
+
+struct __attribute__((__packed__)) vfs_inline_dir_t {
+  char magic[sizeof (VFS_INLINE_DIR_MAGIC)];
+  uint8_t size;
+  uint8_t count;
+  struct vfs_inline_dirent_t e[];
+};
+
+static inline uint16_t
+vfs_inline_hash (const char *fn)
+{
+  uint16_t hash = 5381;
+  for (uint8_t i = 0; i < VFS_INLINE_FNLEN && fn[i]; i ++)
+    hash = (uint16_t) ((hash << 5) + hash) ^ (uint8_t) fn[i];
+  return hash;
+}
+
 typedef struct {
   vfs_size_t offset;		/* Offset in program memory. */
   uint16_t pos;			/* Position in file. */
   uint16_t len;			/* Length of file. */
 } vfs_file_handle_inline_t;
 
-/* vfs_sd_ Prototypes. */
+/* vfs_inline_ Prototypes. */
+void vfs_inline_init (void);
 struct vfs_file_handle_t *vfs_inline_open (const char *filename);
 void vfs_inline_close (struct vfs_file_handle_t *);
 vfs_size_t vfs_inline_read  (struct vfs_file_handle_t *, void *buf,
@@ -51,6 +80,7 @@ vfs_size_t vfs_inline_read  (struct vfs_file_handle_t *, void *buf,
 vfs_size_t vfs_inline_size (struct vfs_file_handle_t *);
 uint8_t vfs_inline_fseek (struct vfs_file_handle_t *, vfs_size_t offset,
 			  uint8_t whence);
+uint8_t vfs_inline_etag (struct vfs_file_handle_t *, uint32_t *etag);
 
 
 #define VFS_INLINE_FUNCS {		\
@@ -37,9 +37,10 @@
 
 #define vfs_open	vfs_inline_open
 #define vfs_read	vfs_inline_read
-#define vfs_close(i)	free(i)
+#define vfs_close(i)	vfs_handle_free(i)
 #define vfs_fseek(fh,p,w)   (((w) == SEEK_SET) ? ((fh)->u.il.pos = (p)) : -1)
 #define vfs_size(fh)	((fh)->u.il.len)
 #define vfs_rewind(fh)  ((fh)->u.il.pos = 0)
+#define vfs_etag	vfs_inline_etag
 
 #endif  /* VFS_TEENSY_H */
@@ -37,7 +37,7 @@ vfs_dc3840_open (const char *filename)
   //  return NULL;		/* Failed to aquire image. */
 
   /* The camera has taken a picture, create a handle. */
-  struct vfs_file_handle_t *fh = malloc (sizeof (struct vfs_file_handle_t));
+  struct vfs_file_handle_t *fh = vfs_handle_alloc();
   if (fh == NULL)
     return NULL;
 
@@ -49,7 +49,7 @@ vfs_dc3840_open (const char *filename)
 void
 vfs_dc3840_close (struct vfs_file_handle_t *fh)
 {
-  free (fh);
+  vfs_handle_free (fh);
 }
 
 vfs_size_t
@@ -32,6 +32,10 @@
 
 static uint8_t i2c_24cxx_address;
 
+/* set after a page write, the chip is busy with its internal write cycle
+ * until it acknowledges its address again */
+static uint8_t i2c_24cxx_busy;
+
 void
 i2c_24CXX_init(void)
 {
@@ -41,12 +45,32 @@ i2c_24CXX_init(void)
 #endif
 }
 
+/* Wait for the end of a pending write cycle.  The chip does not answer
+ * while it is busy, so the first successful select is the next access. */
+static uint8_t
+i2c_24CXX_select(void)
+{
+  uint16_t polls = i2c_24cxx_busy ? 500 : 1;
+
+  i2c_24cxx_busy = 0;
+  while (polls--)
+  {
+    if (i2c_master_select(i2c_24cxx_address, TW_WRITE))
+      return 1;
+  }
+
+#ifdef DEBUG_I2C
+  debug_printf("NOT WRITTEN!!\n");
+#endif
+  return 0;
+}
+
 uint8_t
 i2c_24CXX_set_addr(uint16_t addr)
 {
   uint8_t ret;
 
-  if (!i2c_master_select(i2c_24cxx_address, TW_WRITE))
+  if (!i2c_24CXX_select())
   {
     ret = 0;
     goto end;
@@ -153,27 +177,11 @@ i2c_24CXX_write_block_int(uint16_t addr, uint8_t * ptr, uint8_t len)
   debug_printf("\n");
 #endif
 end:
-  TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWSTO);   // Stopbedingung senden
-  loop_until_bit_is_set(TWCR, TWSTO);           // warten bis TWI fertig
-
-  /* Here we start to do the polling of the write cycle */
-  uint16_t polls = 500;
-  while (polls--)
-  {
-    if (i2c_master_select(i2c_24cxx_address, TW_WRITE))
-    {
-      break;
-    }
-  }
-
-#ifdef DEBUG_I2C
-  if (!polls)
-  {
-    debug_printf("NOT WRITTEN!!\n");
-  }
-#endif
-
+  /* The STOP starts the write cycle.  Instead of polling for its end right
+   * here, the next access does it, which leaves the time in between to the
+   * caller, e.g. for preparing the next page. */
   i2c_master_stop();
+  i2c_24cxx_busy = 1;
   return ret;
 }
 
@@ -22,8 +22,8 @@
  * http://www.gnu.org/copyleft/gpl.html
  */
 
+#include <stddef.h>
 #include <avr/io.h>
-#include <util/twi.h>
         
 #include "config.h"
 #include "core/debug.h"
@@ -34,29 +34,18 @@
 int16_t
 i2c_lm75_read_temp(uint8_t address){
   uint8_t temp[2];
-  uint16_t ret;
 
 #ifdef DEBUG_I2C
   debug_printf("I2C: lm75 read\n");
 #endif
-  if (!i2c_master_select(address, TW_READ)) { ret = 0xffff; goto end; }
-
-  if (i2c_master_transmit_with_ack() != TW_MR_DATA_ACK) { ret = 0xffff; goto end; }
-  temp[0] = TWDR;
+  if (i2c_master_transfer(address, NULL, 0, temp, 2) != I2C_OK)
+    return 0xffff;
 #ifdef DEBUG_I2C
   debug_printf("I2C: lm75 read value1: %d\n", temp[0]);
+  debug_printf("I2C: lm75 read value2: %d\n", temp[1]);
 #endif
 
-  if (i2c_master_transmit() != TW_MR_DATA_NACK) { ret = 0xffff; goto end; }
-  temp[1] = (TWDR & 0x80);
-#ifdef DEBUG_I2C
-  debug_printf("I2C: lm75 read value2: %d\n",temp[1]);
-#endif
-	
-  ret = ( (temp[0] << 8) | temp[1] ) / 128*5;
-end:
-  i2c_master_stop();
-  return ret;
+  return ( (temp[0] << 8) | (temp[1] & 0x80) ) / 128*5;
 }
 
 #endif /* I2C_LM75_SUPPORT */
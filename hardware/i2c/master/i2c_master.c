@@ -18,12 +18,22 @@
 }}} */
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/delay.h>
 #include <util/twi.h>
 
 #include "config.h"
 #include "core/debug.h"
 #include "i2c_master.h"
 
+/* Polls of 10us before a transaction or a single bus operation is given up */
+#define I2C_MASTER_POLLS ((uint16_t) I2C_MASTER_TIMEOUT * 100)
+
+#ifdef I2C_MASTER_ASYNC_SUPPORT
+static void i2c_master_wait(struct i2c_xfer *x);
+#endif
+
 void
 i2c_master_init(void)
 {
@@ -57,13 +67,48 @@ i2c_master_detect(uint8_t range_start, uint8_t range_end)
   return i2c_address;
 }
 
+/* Free a bus that is held by a slave, e.g. one that was reset in the
+ * middle of a read: clock SCL until it releases SDA, then send a stop
+ * condition by hand.  The pins are driven open drain. */
+static void
+i2c_master_recover(void)
+{
+  TWCR = 0;
+  I2CDEBUG("bus hung, recovering\n");
+
+  for (uint8_t i = 0; i < 9 && !PIN_HIGH(SDA); i++)
+  {
+    PIN_CLEAR(SCL);
+    DDR_CONFIG_OUT(SCL);
+    _delay_us(5);
+    DDR_CONFIG_IN(SCL);
+    PIN_SET(SCL);
+    _delay_us(5);
+  }
+
+  PIN_CLEAR(SDA);
+  DDR_CONFIG_OUT(SDA);
+  _delay_us(5);
+  DDR_CONFIG_IN(SDA);
+  PIN_SET(SDA);
+  _delay_us(5);
+}
+
 // Wartet bis TWI-Operstion beendet ist
 // R�ckgabewert = TWI-Statusbits
 uint8_t
 i2c_master_do(uint8_t mode)
 {
     TWCR = mode;                    // �bertragung starten
-    loop_until_bit_is_set(TWCR,TWINT);
+    for (uint16_t n = 0; bit_is_clear(TWCR, TWINT); n++)
+    {
+      if (n == I2C_MASTER_POLLS)
+      {
+        i2c_master_recover();
+        return TW_BUS_ERROR;
+      }
+      _delay_us(10);
+    }
     return TW_STATUS;           // Returncode = Statusbits
 }
 
@@ -72,7 +117,15 @@ void
 i2c_master_stop(void)
 {
     TWCR=((1<<TWEN)|(1<<TWINT)|(1<<TWSTO));     // Stopbedingung senden
-    loop_until_bit_is_clear(TWCR, TWSTO);
+    for (uint16_t n = 0; bit_is_set(TWCR, TWSTO); n++)
+    {
+      if (n == I2C_MASTER_POLLS)
+      {
+        i2c_master_recover();
+        break;
+      }
+      _delay_us(10);
+    }
     i2c_master_disable();
 }
 
@@ -80,6 +133,10 @@ i2c_master_stop(void)
 uint8_t
 i2c_master_select(uint8_t address, uint8_t mode)
 {
+#ifdef I2C_MASTER_ASYNC_SUPPORT
+  /* let queued transactions finish first */
+  i2c_master_wait(NULL);
+#endif
   i2c_master_enable();
   #ifdef DEBUG_I2C
     debug_printf("i2c master select adr+mode 0x%X\n", (address << 1) | mode);
@@ -97,8 +154,257 @@ i2c_master_select(uint8_t address, uint8_t mode)
     return 0;
 }
 
+#ifndef I2C_MASTER_ASYNC_SUPPORT
+uint8_t
+i2c_master_transfer(uint8_t addr, const void *wbuf, uint8_t wlen,
+                    void *rbuf, uint8_t rlen)
+{
+  const uint8_t *w = wbuf;
+  uint8_t *r = rbuf;
+  uint8_t status = I2C_NACK;
+  uint8_t tmp;
+
+  if (wlen || !rlen)
+  {
+    if (!i2c_master_select(addr, TW_WRITE))
+      goto end;
+    for (uint8_t i = 0; i < wlen; i++)
+    {
+      TWDR = w[i];
+      if (i2c_master_transmit() != TW_MT_DATA_ACK)
+        goto end;
+    }
+  }
+
+  if (rlen)
+  {
+    tmp = i2c_master_start();
+    if (tmp != TW_START && tmp != TW_REP_START)
+      goto end;
+    TWDR = (addr << 1) | TW_READ;
+    if (i2c_master_transmit() != TW_MR_SLA_ACK)
+      goto end;
+    for (uint8_t i = 0; i < rlen; i++)
+    {
+      /* acknowledge all bytes but the last one */
+      if (i + 1 < rlen)
+        tmp = i2c_master_transmit_with_ack() != TW_MR_DATA_ACK;
+      else
+        tmp = i2c_master_transmit() != TW_MR_DATA_NACK;
+      if (tmp)
+        goto end;
+      r[i] = TWDR;
+    }
+  }
+  status = I2C_OK;
+
+end:
+  i2c_master_stop();
+  return status;
+}
+
+#else /* I2C_MASTER_ASYNC_SUPPORT */
+
+/* Queue of transactions, the head is the one on the bus */
+static struct i2c_xfer *i2c_xfer_head, *i2c_xfer_tail;
+
+#define I2C_IDLE	0
+#define I2C_BUSY	1
+#define I2C_DONE	2
+static volatile uint8_t i2c_xfer_state;
+static volatile uint8_t i2c_xfer_status;
+static uint8_t i2c_xfer_pos;
+static uint8_t i2c_xfer_ticks;
+
+#define I2C_TWCR_GO	(_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+
+static void
+i2c_xfer_finish(uint8_t status)
+{
+  TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+  i2c_xfer_status = status;
+  i2c_xfer_state = I2C_DONE;
+}
+
+ISR(TWI_vect)
+{
+  struct i2c_xfer *x = i2c_xfer_head;
+  uint8_t pos = i2c_xfer_pos;
+
+  switch (TW_STATUS)
+  {
+    case TW_START:
+      TWDR = (x->addr << 1) | (x->wlen || !x->rlen ? TW_WRITE : TW_READ);
+      TWCR = I2C_TWCR_GO;
+      pos = 0;
+      break;
+
+    case TW_REP_START:
+      TWDR = (x->addr << 1) | TW_READ;
+      TWCR = I2C_TWCR_GO;
+      pos = 0;
+      break;
+
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+      if (pos < x->wlen)
+      {
+        TWDR = x->wbuf[pos++];
+        TWCR = I2C_TWCR_GO;
+      }
+      else if (x->rlen)
+        TWCR = I2C_TWCR_GO | _BV(TWSTA);
+      else
+        i2c_xfer_finish(I2C_OK);
+      break;
+
+    case TW_MR_DATA_ACK:
+      x->rbuf[pos++] = TWDR;
+      /* fall through */
+    case TW_MR_SLA_ACK:
+      /* acknowledge all bytes but the last one */
+      if (pos + 1 < x->rlen)
+        TWCR = I2C_TWCR_GO | _BV(TWEA);
+      else
+        TWCR = I2C_TWCR_GO;
+      break;
+
+    case TW_MR_DATA_NACK:
+      x->rbuf[pos++] = TWDR;
+      i2c_xfer_finish(I2C_OK);
+      break;
+
+    case TW_MT_SLA_NACK:
+    case TW_MT_DATA_NACK:
+    case TW_MR_SLA_NACK:
+      i2c_xfer_finish(I2C_NACK);
+      break;
+
+    case TW_MT_ARB_LOST:
+      /* the bus is not ours, so do not send a stop condition */
+      TWCR = _BV(TWINT) | _BV(TWEN);
+      i2c_xfer_status = I2C_ARB_LOST;
+      i2c_xfer_state = I2C_DONE;
+      break;
+
+    default:
+      i2c_xfer_finish(I2C_BUS_ERROR);
+      break;
+  }
+
+  i2c_xfer_pos = pos;
+}
+
+/* Give up the transaction on the bus, if any. */
+static void
+i2c_master_abort(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (i2c_xfer_state != I2C_BUSY)
+      return;
+    TWCR = 0;
+    i2c_xfer_status = I2C_TIMEOUT;
+    i2c_xfer_state = I2C_DONE;
+  }
+  i2c_master_recover();
+}
+
+void
+i2c_master_submit(struct i2c_xfer *x)
+{
+  x->next = NULL;
+  x->status = I2C_PENDING;
+  if (i2c_xfer_tail)
+    i2c_xfer_tail->next = x;
+  else
+    i2c_xfer_head = x;
+  i2c_xfer_tail = x;
+
+  i2c_master_process();
+}
+
+void
+i2c_master_process(void)
+{
+  if (i2c_xfer_state == I2C_DONE)
+  {
+    struct i2c_xfer *x = i2c_xfer_head;
+    i2c_xfer_head = x->next;
+    if (i2c_xfer_head == NULL)
+      i2c_xfer_tail = NULL;
+    i2c_xfer_state = I2C_IDLE;
+
+    x->status = i2c_xfer_status;
+    I2CDEBUG("xfer 0x%02x done, status %d\n", x->addr, x->status);
+    if (x->done)
+      x->done(x);
+  }
+
+  if (i2c_xfer_state == I2C_IDLE && i2c_xfer_head)
+  {
+    /* the stop condition of the previous transaction takes a few us */
+    for (uint8_t n = 0; bit_is_set(TWCR, TWSTO) && n < 100; n++)
+      _delay_us(1);
+
+    i2c_xfer_ticks = 0;
+    i2c_xfer_state = I2C_BUSY;
+    TWCR = I2C_TWCR_GO | _BV(TWSTA);
+  }
+}
+
+void
+i2c_master_periodic(void)
+{
+  if (i2c_xfer_state == I2C_BUSY && ++i2c_xfer_ticks > I2C_MASTER_TIMEOUT / 20)
+    i2c_master_abort();
+}
+
+/* Wait for X to be done or for the queue to run empty if X is NULL.  The
+ * main loop is blocked meanwhile, so timeouts are handled here. */
+static void
+i2c_master_wait(struct i2c_xfer *x)
+{
+  struct i2c_xfer *current = NULL;
+  uint16_t n = 0;
+
+  while (x ? x->status == I2C_PENDING : i2c_xfer_head != NULL)
+  {
+    if (current != i2c_xfer_head)
+    {
+      current = i2c_xfer_head;
+      n = 0;
+    }
+    else if (++n == I2C_MASTER_POLLS)
+      i2c_master_abort();
+    _delay_us(10);
+    i2c_master_process();
+  }
+}
+
+uint8_t
+i2c_master_transfer(uint8_t addr, const void *wbuf, uint8_t wlen,
+                    void *rbuf, uint8_t rlen)
+{
+  struct i2c_xfer x = {
+    .addr = addr,
+    .wlen = wlen,
+    .rlen = rlen,
+    .wbuf = wbuf,
+    .rbuf = rbuf,
+  };
+
+  i2c_master_submit(&x);
+  i2c_master_wait(&x);
+  return x.status;
+}
+
+#endif /* I2C_MASTER_ASYNC_SUPPORT */
+
 /*
   -- Ethersex META --
   header(hardware/i2c/master/i2c_master.h)
   initearly(i2c_master_init)
+  ifdef(`conf_I2C_MASTER_ASYNC', `mainloop(i2c_master_process)')
+  ifdef(`conf_I2C_MASTER_ASYNC', `timer(1, i2c_master_periodic())')
 */
@@ -38,7 +38,43 @@ uint8_t  i2c_master_select(uint8_t address, uint8_t mode);
 #define i2c_master_transmit() i2c_master_do(_BV(TWEN) | _BV(TWINT)) 
 #define i2c_master_transmit_with_ack() i2c_master_do(_BV(TWEN) | _BV(TWINT) | _BV(TWEA) ) 
 
+#include <stdint.h>
 #include "config.h"
+
+/* A transaction writes WLEN bytes of WBUF to the slave at ADDR, then reads
+ * RLEN bytes to RBUF after a repeated start.  Either part may be empty. */
+struct i2c_xfer
+{
+  struct i2c_xfer *next;
+  uint8_t addr;
+  uint8_t wlen;
+  uint8_t rlen;
+  const uint8_t *wbuf;
+  uint8_t *rbuf;
+  /* called from the main loop once the transaction is over */
+  void (*done) (struct i2c_xfer *);
+  uint8_t status;
+};
+
+/* values of status */
+#define I2C_OK		0
+#define I2C_NACK	1	/* slave did not acknowledge */
+#define I2C_ARB_LOST	2	/* another master took over the bus */
+#define I2C_BUS_ERROR	3
+#define I2C_TIMEOUT	4	/* bus hung, it has been recovered */
+#define I2C_PENDING	0xff
+
+/* Run a transaction and wait for it, returns its status. */
+uint8_t i2c_master_transfer(uint8_t addr, const void *wbuf, uint8_t wlen,
+                            void *rbuf, uint8_t rlen);
+
+#ifdef I2C_MASTER_ASYNC_SUPPORT
+/* Queue the transaction X, which must stay valid until X->done is called.
+ * The callback must not wait for other transactions itself. */
+void i2c_master_submit(struct i2c_xfer *x);
+void i2c_master_process(void);
+void i2c_master_periodic(void);
+#endif
 #ifdef DEBUG_I2C
 # include "core/debug.h"
 # define I2CDEBUG(a...)  debug_printf("i2c: " a)
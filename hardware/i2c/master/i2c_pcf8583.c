@@ -48,6 +48,18 @@
 #endif /* I2C_PCF8583_SYNC_PERIOD */
 
 static uint16_t sync_timer;
+
+#if defined(I2C_MASTER_ASYNC_SUPPORT) && defined(CLOCK_DATETIME_SUPPORT)
+/* The periodic sync runs as a chain of queued transactions: the time
+ * registers, the year from NVRAM and, if years have passed, the updated
+ * year.  sync_step is 0 while no sync is under way. */
+static struct i2c_xfer sync_xfer;
+static pcf8583_reg_t sync_dt;
+static uint8_t sync_wbuf[3];
+static uint8_t sync_rbuf[6];
+static uint8_t sync_step;
+#define I2C_PCF8583_QUEUED_SYNC
+#endif
 #endif /* I2C_PCF8583_SYNC */
 
 uint8_t
@@ -287,28 +299,114 @@ i2c_pcf8583_get(void)
 #endif /* CLOCK_DATETIME_SUPPORT */
 }
 
+#ifdef CLOCK_DATETIME_SUPPORT
+static void
+i2c_pcf8583_sync_clock(const pcf8583_reg_t * dt)
+{
+  clock_datetime_t d;
+
+  d.sec = dt->sec;
+  d.min = dt->min;
+  d.hour = dt->hour;
+  d.dow = dt->wday;
+  d.day = dt->day;
+  d.month = dt->mon;
+  d.year = dt->year;
+  d.isdst = 0;
+
+  clock_set_time_raw_hr(clock_mktime(&d, 1), (dt->hsec) >> 1);
+}
+#endif /* CLOCK_DATETIME_SUPPORT */
+
 void
 i2c_pcf8583_sync(void)
 {
 #ifdef CLOCK_DATETIME_SUPPORT
   pcf8583_reg_t dt;
-  clock_datetime_t d;
 
-  if (!i2c_pcf8583_get_rtc(&dt))
+  if (i2c_pcf8583_get_rtc(&dt))
+    i2c_pcf8583_sync_clock(&dt);
+#endif /* CLOCK_DATETIME_SUPPORT */
+}
+
+#ifdef I2C_PCF8583_QUEUED_SYNC
+static void
+i2c_pcf8583_sync_submit(uint8_t wlen, uint8_t rlen)
+{
+  sync_xfer.addr = PCF8583_ADR;
+  sync_xfer.wbuf = sync_wbuf;
+  sync_xfer.wlen = wlen;
+  sync_xfer.rbuf = sync_rbuf;
+  sync_xfer.rlen = rlen;
+  i2c_master_submit(&sync_xfer);
+}
+
+static void
+i2c_pcf8583_sync_done(struct i2c_xfer *x)
+{
+  if (x->status != I2C_OK)
+  {
+    I2CDEBUG("pcf8583 sync failed in step %d\n", sync_step);
+    sync_step = 0;
     return;
-  d.sec = dt.sec;
-  d.min = dt.min;
-  d.hour = dt.hour;
-  d.dow = dt.wday;
-  d.day = dt.day;
-  d.month = dt.mon;
-  d.year = dt.year;
-  d.isdst = 0;
+  }
 
-  clock_set_time_raw_hr(clock_mktime(&d, 1), (dt.hsec) >> 1);
-#endif /* CLOCK_DATETIME_SUPPORT */
+  uint16_t year;
+  switch (sync_step++)
+  {
+    case 1:
+      /* same layout as read by i2c_pcf8583_get_rtc */
+      sync_dt.hsec = BCD2BIN(sync_rbuf[0]);
+      sync_dt.sec = BCD2BIN(sync_rbuf[1]);
+      sync_dt.min = BCD2BIN(sync_rbuf[2]);
+      sync_dt.hour = BCD2BIN(sync_rbuf[3] & 0x3f);
+      sync_dt.day = BCD2BIN(sync_rbuf[4] & 0x3f);
+      sync_dt.mon = BCD2BIN(sync_rbuf[5] & 0x1f);
+      sync_dt.wday = sync_rbuf[5] >> 5;
+      /* the year counter of the chip, kept until the year is read */
+      sync_dt.year = sync_rbuf[4] >> 6;
+
+      sync_wbuf[0] = PCF8583_YEAR_REG;
+      i2c_pcf8583_sync_submit(1, 2);
+      return;
+
+    case 2:
+      year = ((uint16_t) sync_rbuf[0] << 8) | sync_rbuf[1];
+      if (year == 0xffff)
+        break;
+      /* Increment passed years */
+      year += (sync_dt.year - (year & 0x03)) & 0x03;
+      sync_dt.year = year;
+
+      if (sync_rbuf[1] != LO8(year) || sync_rbuf[0] != HI8(year))
+      {
+        sync_wbuf[1] = HI8(year);
+        sync_wbuf[2] = LO8(year);
+        i2c_pcf8583_sync_submit(3, 0);
+        return;
+      }
+      /* fall through */
+    default:
+      i2c_pcf8583_sync_clock(&sync_dt);
+      break;
+  }
+  sync_step = 0;
 }
 
+/* Like i2c_pcf8583_sync, but without waiting for the bus. */
+static void
+i2c_pcf8583_sync_queued(void)
+{
+  if (sync_step)
+    return;
+
+  sync_step = 1;
+  sync_xfer.done = i2c_pcf8583_sync_done;
+  sync_wbuf[0] = PCF8583_100S_REG;
+  i2c_pcf8583_sync_submit(1, 6);
+}
+#endif /* I2C_PCF8583_QUEUED_SYNC */
+
 uint8_t
 i2c_pcf8583_reset_rtc(void)
 {
@@ -495,7 +593,11 @@ i2c_pcf8583_tick(void)
     if (++sync_timer >= I2C_PCF8583_SYNC_PERIOD)
     {
       sync_timer = 0;
+#ifdef I2C_PCF8583_QUEUED_SYNC
+      i2c_pcf8583_sync_queued();
+#else
       i2c_pcf8583_sync();
+#endif
     }
   }
 #endif
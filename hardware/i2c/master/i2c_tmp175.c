@@ -20,8 +20,8 @@
  * http://www.gnu.org/copyleft/gpl.html
  */
 
+#include <stddef.h>
 #include <avr/io.h>
-#include <util/twi.h>
 #include <util/delay.h>
 
 #include "config.h"
@@ -33,6 +33,7 @@
 int16_t
 i2c_tmp175_read_temp(uint8_t address)
 {
+  uint8_t reg = I2C_SLA_TMP175_DR;      //read the temerature register (=0x00)
   uint8_t temp[2];
   int16_t ret = 0xffff;
 
@@ -41,47 +42,20 @@ i2c_tmp175_read_temp(uint8_t address)
                "addr 0x%X (%d) daddr 0x%X (%d)\n", address,
                I2C_SLA_TMP175_DR);
 #endif
-  if (!i2c_master_select(address, TW_WRITE))
-    goto end;
-
-  TWDR = I2C_SLA_TMP175_DR;     //read the temerature register (=0x00)
-
-  if (i2c_master_transmit_with_ack() != TW_MT_DATA_ACK)
-    goto end;
-
-#ifdef I2C_GENERIC_DELAYS
-  _delay_ms(10);                //for slow devices
-#endif
-
-  /* Do a repeated start condition */
-  if (i2c_master_start() != TW_REP_START)
-    goto end;
-  TWDR = (address << 1) | TW_READ;
-  if (i2c_master_transmit() != TW_MR_SLA_ACK)
-    goto end;
-
 #ifdef I2C_GENERIC_DELAYS
+  if (i2c_master_transfer(address, &reg, 1, NULL, 0) != I2C_OK)
+    return ret;
   _delay_ms(10);                //for slow devices
+  if (i2c_master_transfer(address, NULL, 0, temp, 2) != I2C_OK)
+    return ret;
+#else
+  if (i2c_master_transfer(address, &reg, 1, temp, 2) != I2C_OK)
+    return ret;
 #endif
 
-  if (i2c_master_transmit_with_ack() != TW_MR_DATA_ACK)
-    goto end;
-  temp[0] = TWDR;
-
 #ifdef DEBUG_I2C
   debug_printf("I2C::tmp175 read_word_data", "temp0: 0x%X (%d)\n", temp[0],
                temp[0]);
-#endif
-
-#ifdef I2C_GENERIC_DELAYS
-  _delay_ms(10);                // for slow devices
-#endif
-
-  if (i2c_master_transmit_with_ack() != TW_MR_DATA_ACK)
-    goto end;
-  temp[1] = TWDR;
-
-#ifdef DEBUG_I2C
   debug_printf("I2C::tmp175 read_word_data", "temp1: 0x%X (%d)\n", temp[1],
                temp[1]);
 #endif
@@ -89,14 +63,11 @@ i2c_tmp175_read_temp(uint8_t address)
   // @see datasheet p6/20
   // temp[0] highbyte
   // temp[1] lowbyte
-  ret = 0x0000;
   ret = ((temp[0] << 8) | (temp[1] >> 4));
 
 #ifdef DEBUG_I2C
   debug_printf("I2C::tmp175 read_word_data", "ret: 0x%X (%d)\n", ret, ret);
 #endif
 
-end:
-  i2c_master_stop();
   return ret;
 }
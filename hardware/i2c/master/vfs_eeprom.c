@@ -42,6 +42,121 @@
 #define vfs_eeprom_write_page(page, data, len) i2c_24CXX_write_block(page * SFS_PAGE_SIZE, data, len)
 #define vfs_eeprom_write_slice(page, offset, data, len) i2c_24CXX_write_block(page * SFS_PAGE_SIZE + offset , data, len)
 
+#define SFS_DATA_SIZE (SFS_PAGE_SIZE - 4)
+
+/* Size and last data page of the recently used files, so neither filesize
+ * nor an append has to walk the page chain on the EEPROM. */
+struct vfs_eeprom_meta
+{
+  vfs_eeprom_inode_t file_page; /* 0 if the entry is unused */
+  vfs_eeprom_inode_t last_page; /* the file page if there is no data */
+  vfs_size_t size;
+};
+
+static struct vfs_eeprom_meta vfs_eeprom_meta[SFS_FILE_CACHE];
+static uint8_t vfs_eeprom_meta_next;
+
+static void vfs_eeprom_meta_drop(vfs_eeprom_inode_t file_page);
+
+/* The data page written last is kept in RAM until another page is
+ * written, the file is read, closed or another file is used, or no
+ * write touched it for a second, so small appends to the same page
+ * share one write cycle of the chip.  A new page is linked into its
+ * file only after it has been written. */
+static struct
+{
+  vfs_eeprom_inode_t page;      /* 0 if the buffer is clean */
+  vfs_eeprom_inode_t file;      /* file page the data page belongs to */
+  vfs_eeprom_inode_t link;      /* page to link to it, 0 if linked */
+  uint8_t idle;                 /* seconds passed without a write */
+  struct vfs_eeprom_page_data data;
+} vfs_eeprom_wbuf;
+
+/* Write the buffered page to the EEPROM.  Returns 1 if it could not be
+ * written, the data is lost then. */
+static uint8_t
+vfs_eeprom_flush(void)
+{
+  vfs_eeprom_inode_t page = vfs_eeprom_wbuf.page;
+  vfs_eeprom_len_t len = 4 + vfs_eeprom_wbuf.data.page_len;
+
+  if (page == 0)
+    return 0;
+  vfs_eeprom_wbuf.page = 0;
+
+  vfs_eeprom_debug("flush page %d, link from %d\n", page,
+                   vfs_eeprom_wbuf.link);
+  if (vfs_eeprom_write_page(page, (uint8_t *) & vfs_eeprom_wbuf.data, len)
+      == len)
+  {
+    if (vfs_eeprom_wbuf.link == 0
+        || vfs_eeprom_write_slice(vfs_eeprom_wbuf.link, 1,
+                                  (uint8_t *) & page, 2) == 2)
+      return 0;
+
+    /* not linked, try to give the page back */
+    uint8_t zero = 0;
+    vfs_eeprom_write_page(page, &zero, 1);
+  }
+
+  /* the cached size and last page may be wrong now */
+  vfs_eeprom_meta_drop(vfs_eeprom_wbuf.file);
+  return 1;
+}
+
+void
+vfs_eeprom_periodic(void)
+{
+  /* the first tick may follow the write at once, flush on the second */
+  if (vfs_eeprom_wbuf.page && vfs_eeprom_wbuf.idle++)
+    vfs_eeprom_flush();
+}
+
+static struct vfs_eeprom_meta *
+vfs_eeprom_meta_get(vfs_eeprom_inode_t file_page)
+{
+  struct vfs_eeprom_page_data data_page;
+  struct vfs_eeprom_meta *meta;
+
+  for (uint8_t i = 0; i < SFS_FILE_CACHE; i++)
+    if (vfs_eeprom_meta[i].file_page == file_page)
+      return &vfs_eeprom_meta[i];
+
+  /* the page chain on the EEPROM has to be complete */
+  vfs_eeprom_flush();
+
+  meta = &vfs_eeprom_meta[vfs_eeprom_meta_next];
+  if (++vfs_eeprom_meta_next >= SFS_FILE_CACHE)
+    vfs_eeprom_meta_next = 0;
+
+  /* not cached, count the allocated pages */
+  vfs_eeprom_read_slice(file_page, 0, (uint8_t *) & data_page, 4);
+  vfs_eeprom_inode_t next_page = data_page.next_page;
+  meta->file_page = file_page;
+  meta->last_page = file_page;
+  meta->size = 0;
+  while (next_page)
+  {
+    vfs_eeprom_debug("filesize; skip page: %d\n", next_page);
+    vfs_eeprom_read_page(next_page, (uint8_t *) & data_page, 4);
+    meta->last_page = next_page;
+    meta->size += data_page.page_len;
+    if (data_page.page_len < SFS_DATA_SIZE)
+      break;
+    next_page = data_page.next_page;
+  }
+  vfs_eeprom_debug("filesize; size: %d\n", meta->size);
+  return meta;
+}
+
+static void
+vfs_eeprom_meta_drop(vfs_eeprom_inode_t file_page)
+{
+  for (uint8_t i = 0; i < SFS_FILE_CACHE; i++)
+    if (vfs_eeprom_meta[i].file_page == file_page)
+      vfs_eeprom_meta[i].file_page = 0;
+}
+
 void
 vfs_eeprom_init(void)
 {
@@ -98,7 +213,9 @@ vfs_eeprom_find_free_page(vfs_eeprom_inode_t suggested)
   {
     if (!vfs_eeprom_read_page(tmp, buf, 1))
       return 0;
-    if (buf[0] != SFS_MAGIC_SUPERBLOCK &&
+    /* the buffered page may not have been written yet */
+    if (tmp != vfs_eeprom_wbuf.page &&
+        buf[0] != SFS_MAGIC_SUPERBLOCK &&
         buf[0] != SFS_MAGIC_FILE &&
         buf[0] != SFS_MAGIC_DATA)
     {
@@ -123,7 +240,10 @@ vfs_eeprom_find_file(const char *filename, vfs_eeprom_inode_t * prev_inode)
 
   if (!vfs_eeprom_read_page(0, buf,
                             sizeof(struct vfs_eeprom_page_superblock)))
+  {
+    vfs_open_failed = 1;        /* EEPROM busy or not answering */
     return 0;
+  }
 
   if (prev_inode)
     *prev_inode = 0;
@@ -132,7 +252,11 @@ vfs_eeprom_find_file(const char *filename, vfs_eeprom_inode_t * prev_inode)
 
   while (inode)
   {
-    vfs_eeprom_read_page(inode, buf, SFS_PAGE_SIZE);
+    if (!vfs_eeprom_read_page(inode, buf, SFS_PAGE_SIZE))
+    {
+      vfs_open_failed = 1;
+      return 0;
+    }
     vfs_eeprom_debug("magic: %i ?=? %i\n", file->magic, SFS_MAGIC_FILE);
     vfs_eeprom_debug("file: %s \n", file->filename);
     if (file->magic != SFS_MAGIC_FILE)
@@ -161,6 +285,8 @@ vfs_eeprom_find_file(const char *filename, vfs_eeprom_inode_t * prev_inode)
 struct vfs_file_handle_t *
 vfs_eeprom_create(const char *filename)
 {
+  vfs_eeprom_flush();
+
   vfs_eeprom_inode_t inode = vfs_eeprom_find_file(filename, NULL);
   vfs_eeprom_inode_t next_file = 0;
 
@@ -199,13 +325,15 @@ vfs_eeprom_create(const char *filename)
     }
   }
 
+  vfs_eeprom_meta_drop(inode);
+
   memset(buf, 0, SFS_PAGE_SIZE);
   file->magic = SFS_MAGIC_FILE;
   file->next_file = next_file,
     strncpy(file->filename, filename, sizeof(file->filename));
   vfs_eeprom_write_page(inode, buf, SFS_PAGE_SIZE);
 
-  struct vfs_file_handle_t *handle = malloc(sizeof(struct vfs_file_handle_t));
+  struct vfs_file_handle_t *handle = vfs_handle_alloc();
   if (!handle)
     return NULL;
   handle->fh_type = VFS_EEPROM;
@@ -223,7 +351,7 @@ vfs_eeprom_open(const char *filename)
   if (inode == 0)
     return NULL;
 
-  struct vfs_file_handle_t *handle = malloc(sizeof(struct vfs_file_handle_t));
+  struct vfs_file_handle_t *handle = vfs_handle_alloc();
   if (!handle)
     return NULL;
   handle->fh_type = VFS_EEPROM;
@@ -236,36 +364,17 @@ vfs_eeprom_open(const char *filename)
 void
 vfs_eeprom_close(struct vfs_file_handle_t *handle)
 {
+  vfs_eeprom_flush();
   if (handle)
-    free(handle);
+    vfs_handle_free(handle);
 }
 
 vfs_size_t
 vfs_eeprom_filesize(struct vfs_file_handle_t *handle)
 {
-  unsigned char buf[SFS_PAGE_SIZE];
-  struct vfs_eeprom_page_file *file_page =
-    (struct vfs_eeprom_page_file *) buf;
-  struct vfs_eeprom_page_data *data_page =
-    (struct vfs_eeprom_page_data *) buf;
-
   if (!handle)
     return 0;
-  vfs_eeprom_read_page(handle->u.ee.file_page, buf, SFS_PAGE_SIZE);
-  /* count the already allocated pages */
-  vfs_eeprom_inode_t next_page = file_page->next_page;
-  vfs_size_t size = 0;
-  while (next_page)
-  {
-    vfs_eeprom_debug("filesize; skip page: %d\n", next_page);
-    vfs_eeprom_read_page(next_page, buf, 4);
-    size += data_page->page_len;
-    if (data_page->page_len < sizeof(data_page->data))
-      break;
-    next_page = data_page->next_page;
-  }
-  vfs_eeprom_debug("filesize; size: %d\n", size);
-  return size;
+  return vfs_eeprom_meta_get(handle->u.ee.file_page)->size;
 }
 
 vfs_size_t
@@ -281,6 +390,7 @@ vfs_eeprom_read(struct vfs_file_handle_t * handle, void *buffer,
 
   if (!handle)
     return 0;
+  vfs_eeprom_flush();
   vfs_eeprom_read_page(handle->u.ee.file_page, (uint8_t *) buf,
                        SFS_PAGE_SIZE);
 
@@ -339,7 +449,7 @@ uint8_t
 vfs_eeprom_fseek(struct vfs_file_handle_t * handle, vfs_size_t offset,
                  uint8_t whence)
 {
-  uint16_t new_pos;
+  vfs_size_t new_pos;
 
   switch (whence)
   {
@@ -367,119 +477,114 @@ vfs_eeprom_fseek(struct vfs_file_handle_t * handle, vfs_size_t offset,
 }
 
 
+/* Find the data page holding byte OFFSET of the file.  Returns 0 if
+ * OFFSET is the end of the file and its last page is full, the page
+ * the new one has to be linked to is stored to PREV then. */
+static vfs_eeprom_inode_t
+vfs_eeprom_locate(struct vfs_eeprom_meta *meta, vfs_size_t offset,
+                  vfs_eeprom_inode_t * prev)
+{
+  vfs_eeprom_inode_t index = offset / SFS_DATA_SIZE;
+  vfs_eeprom_inode_t pages = (meta->size + SFS_DATA_SIZE - 1) / SFS_DATA_SIZE;
+
+  if (index >= pages)
+  {
+    *prev = meta->last_page;
+    return 0;
+  }
+  if (index == pages - 1)
+    return meta->last_page;
+
+  vfs_eeprom_inode_t page;
+  vfs_eeprom_read_slice(meta->file_page, 1, (uint8_t *) & page, 2);
+  while (index--)
+  {
+    vfs_eeprom_debug("write; skip page: %d\n", page);
+    vfs_eeprom_read_slice(page, 1, (uint8_t *) & page, 2);
+  }
+  return page;
+}
+
 vfs_size_t
 vfs_eeprom_write(struct vfs_file_handle_t * handle, void *data,
                  vfs_size_t len)
 {
-  unsigned char buf[SFS_PAGE_SIZE];
-  struct vfs_eeprom_page_file *file_page =
-    (struct vfs_eeprom_page_file *) buf;
-  struct vfs_eeprom_page_data *data_page =
-    (struct vfs_eeprom_page_data *) buf;
-
-  vfs_size_t written_len = len;
+  struct vfs_eeprom_page_data *data_page = &vfs_eeprom_wbuf.data;
+  vfs_size_t count = 0;
 
   if (!handle)
     return 0;
   vfs_eeprom_debug("write; file %d, offset %d, len %d\n",
                    handle->u.ee.file_page, handle->u.ee.offset, len);
-  /* First we must determine if we need a new blocks at the end */
-  vfs_eeprom_inode_t pages_allocated = 0;
 
-  vfs_eeprom_read_page(handle->u.ee.file_page, buf, SFS_PAGE_SIZE);
-  /* count the already allocated pages */
-  vfs_eeprom_inode_t next_page = file_page->next_page;
-  vfs_eeprom_inode_t last_page = handle->u.ee.file_page;
-  vfs_eeprom_inode_t write_page = 0;
+  vfs_eeprom_inode_t file = handle->u.ee.file_page;
+  if (vfs_eeprom_wbuf.file != file && vfs_eeprom_flush())
+    return 0;
 
-  vfs_eeprom_inode_t pages_skip =
-    handle->u.ee.offset / sizeof(data_page->data);
-  vfs_eeprom_debug("write; skip %d pages\n", pages_skip);
+  struct vfs_eeprom_meta *meta = vfs_eeprom_meta_get(file);
+  vfs_size_t offset = handle->u.ee.offset;
+  vfs_eeprom_len_t page_offset = offset % SFS_DATA_SIZE;
+  vfs_eeprom_inode_t link = 0;
+  vfs_eeprom_inode_t page = vfs_eeprom_locate(meta, offset, &link);
 
-  while (next_page)
+  while (count < len)
   {
-    vfs_eeprom_debug("write; skip page: %d\n", next_page);
-    vfs_eeprom_read_page(next_page, buf, 4);
-    pages_allocated++;
-    last_page = next_page;
-
-
-    if (!write_page)
+    uint8_t fresh = 0;
+    if (page == 0)
     {
-      /* Save here the last filled page */
-      if (pages_skip == 0 || data_page->page_len < sizeof(data_page->data))
-        write_page = next_page;
-
-      if (pages_skip)
-        pages_skip--;
+      page = vfs_eeprom_find_free_page(link + 1);
+      if (page == 0)
+      {
+        vfs_eeprom_debug("no space left on device\n");
+        break;
+      }
+      fresh = 1;
     }
-    next_page = data_page->next_page;
-  }
 
-  /* our last page is full or the file page, we must use the first allocated page */
-  if (last_page == handle->u.ee.file_page)
-    write_page = 0;
-
-  vfs_eeprom_inode_t pages_needed =
-    (handle->u.ee.offset + len) / sizeof(data_page->data) + 1;
-  vfs_eeprom_debug("pages allocated: %d, needed: %d, append %d pages to %d\n",
-                   pages_allocated, pages_needed,
-                   pages_needed - pages_allocated, last_page);
-  if (pages_needed > pages_allocated)
-    pages_needed -= pages_allocated;
-  else
-    pages_needed = 0;
-
-  while (pages_needed--)
-  {
-    vfs_eeprom_inode_t new_node = vfs_eeprom_find_free_page(last_page + 1);
-    if (new_node == 0)
+    if (page != vfs_eeprom_wbuf.page)
     {
-      vfs_eeprom_debug("no space left on device\n");
-      return 0;
+      if (vfs_eeprom_flush())
+        break;
+
+      if (fresh)
+      {
+        data_page->magic = SFS_MAGIC_DATA;
+        data_page->next_page = 0;
+        data_page->page_len = 0;
+      }
+      else
+        vfs_eeprom_read_page(page, (uint8_t *) data_page, SFS_PAGE_SIZE);
+
+      vfs_eeprom_wbuf.page = page;
+      vfs_eeprom_wbuf.file = file;
+      vfs_eeprom_wbuf.link = fresh ? link : 0;
     }
-    /* Our last page was full, use the first allocated one */
-    if (write_page == 0)
-      write_page = new_node;
-
-    data_page->magic = SFS_MAGIC_DATA;
-    data_page->next_page = 0;
-    data_page->page_len = 0;
-    vfs_eeprom_write_page(new_node, buf, 4);
-    vfs_eeprom_write_slice(last_page, 1, (unsigned char *) &new_node, 2);
-    last_page = new_node;
-    vfs_eeprom_debug("write; alloc page %d\n", new_node);
-  }
-
-  vfs_eeprom_debug("write; first write page is %d\n", write_page);
-  vfs_eeprom_read_page(write_page, buf, SFS_PAGE_SIZE);
-  vfs_eeprom_inode_t write_offset =
-    handle->u.ee.offset % sizeof(data_page->data);
-  handle->u.ee.offset += len;
-
-  while (len)
-  {
-    vfs_eeprom_len_t copy_len = len;
-    if ((len + write_offset) > sizeof(data_page->data))
-      copy_len = sizeof(data_page->data) - write_offset;
 
+    vfs_eeprom_len_t copy_len = SFS_DATA_SIZE - page_offset;
+    if (len - count < copy_len)
+      copy_len = len - count;
     vfs_eeprom_debug("write; copy %d byte to page %d at %d\n", copy_len,
-                     write_page, write_offset);
-    data_page->page_len = write_offset + copy_len;
-    vfs_eeprom_debug("%d, %d, %d, %d\n", write_page, 4 + write_offset,
-                     data_page->page_len, copy_len);
-
-    vfs_eeprom_write_slice(write_page, 4 + write_offset, data, copy_len);
-    vfs_eeprom_write_slice(write_page, 3, &data_page->page_len, 1);
-    write_offset = 0;
-    write_page = data_page->next_page;
-    /* Read the next page */
-    vfs_eeprom_read_page(write_page, buf, SFS_PAGE_SIZE);
-    data += copy_len;
-    len -= copy_len;
+                     page, page_offset);
+    memcpy(data_page->data + page_offset, data + count, copy_len);
+    vfs_eeprom_wbuf.idle = 0;
+    if (page_offset + copy_len > data_page->page_len)
+      data_page->page_len = page_offset + copy_len;
+
+    count += copy_len;
+    if (offset + count > meta->size)
+    {
+      meta->size = offset + count;
+      meta->last_page = page;
+    }
+
+    /* continue on the next page, a new one is linked to this page */
+    link = page;
+    page = data_page->next_page;
+    page_offset = 0;
   }
 
-  return written_len;
+  handle->u.ee.offset += count;
+  return count;
 }
 
 uint8_t
@@ -491,6 +596,8 @@ vfs_eeprom_unlink(const char *filename)
   struct vfs_eeprom_page_data *data_page =
     (struct vfs_eeprom_page_data *) buf;
 
+  vfs_eeprom_flush();
+
   vfs_eeprom_inode_t prev_inode;
   vfs_eeprom_inode_t inode = vfs_eeprom_find_file(filename, &prev_inode);
 
@@ -507,13 +614,15 @@ vfs_eeprom_unlink(const char *filename)
 
   memset(buf, 0, SFS_PAGE_SIZE);
   vfs_eeprom_write_page(inode, buf, SFS_PAGE_SIZE);
+  vfs_eeprom_meta_drop(inode);
 
   while (next_page)
   {
     vfs_eeprom_read_page(next_page, buf, 4);
+    vfs_eeprom_inode_t page = next_page;
     next_page = data_page->next_page;
-    memset(buf, 0, SFS_PAGE_SIZE);
-    vfs_eeprom_write_page(inode, buf, SFS_PAGE_SIZE);
+    memset(buf, 0, 4);
+    vfs_eeprom_write_page(page, buf, 4);
   }
 
   return 0;
@@ -523,4 +632,5 @@ vfs_eeprom_unlink(const char *filename)
   -- Ethersex META --
   header(hardware/i2c/master/vfs_eeprom.h)
   initearly(vfs_eeprom_init)
+  timer(50, vfs_eeprom_periodic())
 */
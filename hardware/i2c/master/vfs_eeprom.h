@@ -32,6 +32,9 @@
 #ifndef SFS_PAGE_COUNT
 	#define SFS_PAGE_COUNT 1
 #endif
+#ifndef SFS_FILE_CACHE
+	#define SFS_FILE_CACHE 2
+#endif
 
 #define SFS_MAGIC_SUPERBLOCK 0x5
 #define SFS_MAGIC_FILE 0x23
@@ -73,12 +76,13 @@ struct vfs_eeprom_page_data {
 
 typedef struct {
   uint16_t file_page; /* the inode, were the file starts */ 
-  uint16_t offset; /* the offset from the first  */
+  vfs_size_t offset; /* the offset from the first  */
 } vfs_file_handle_eeprom_t;
 
 
 struct vfs_file_handle_t * vfs_eeprom_open(const char * filename);
 void vfs_eeprom_init(void);
+void vfs_eeprom_periodic(void);
 void vfs_eeprom_close(struct vfs_file_handle_t *handle);
 vfs_size_t vfs_eeprom_write(struct vfs_file_handle_t *handle, void *buf, vfs_size_t len);
 vfs_size_t vfs_eeprom_read(struct vfs_file_handle_t *handle, void *buffer, vfs_size_t size);
@@ -33,7 +33,7 @@ struct vfs_file_handle_t *
 vfs_eeprom_raw_open (const char *filename)
 {
   if (isdigit(filename[0])) {
-    struct vfs_file_handle_t *fh = malloc (sizeof (struct vfs_file_handle_t));
+    struct vfs_file_handle_t *fh = vfs_handle_alloc();
     if (fh == NULL)
       return NULL;
 
@@ -48,7 +48,7 @@ vfs_eeprom_raw_open (const char *filename)
 
 void vfs_eeprom_raw_close (struct vfs_file_handle_t *t) 
 {
-  free(t);
+  vfs_handle_free(t);
 }
 
 vfs_size_t
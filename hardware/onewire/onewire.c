@@ -98,15 +98,21 @@ uint8_t noinline
 reset_onewire(uint8_t busmask)
 {
   uint8_t data1, data2;
+
+  /* only the presence detect needs exact timing. the reset pulse itself may
+   * be stretched by an interrupt, so it is not run with interrupts off */
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
     /* pull bus low */
     OW_CONFIG_OUTPUT(busmask);
     OW_LOW(busmask);
+  }
 
-    /* wait 480us */
-    _delay_loop_2(OW_RESET_TIMEOUT_1);
+  /* wait 480us */
+  _delay_loop_2(OW_RESET_TIMEOUT_1);
 
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
     /* release bus */
     OW_CONFIG_INPUT(busmask);
 
@@ -115,10 +121,13 @@ reset_onewire(uint8_t busmask)
 
     /* sample data */
     data1 = OW_GET_INPUT(busmask);
+  }
 
-    /* wait 390us */
-    _delay_loop_2(OW_RESET_TIMEOUT_3);
+  /* wait 390us */
+  _delay_loop_2(OW_RESET_TIMEOUT_3);
 
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
     /* sample data again */
     data2 = OW_GET_INPUT(busmask);
 
@@ -128,6 +137,9 @@ reset_onewire(uint8_t busmask)
     OW_HIGH(busmask);
     OW_CONFIG_OUTPUT(busmask);
   }
+#ifdef ONEWIRE_POLLING_SUPPORT
+  ow_global.bustime += OW_RESET_BUSTIME;
+#endif
   return (uint8_t) (~data1 & data2 & busmask);
 }
 
@@ -163,6 +175,9 @@ ow_write_0(uint8_t busmask)
     _delay_loop_2(OW_WRITE_0_TIMEOUT);
     OW_HIGH(busmask);
   }
+#ifdef ONEWIRE_POLLING_SUPPORT
+  ow_global.bustime += OW_SLOT_BUSTIME;
+#endif
 }
 
 
@@ -189,12 +204,19 @@ ow_read(uint8_t busmask)
 
     /* sample data now */
     data = (uint8_t) (OW_GET_INPUT(busmask) > 0);
+  }
 
-    /* wait for remaining slot time */
-    _delay_loop_2(OW_READ_TIMEOUT_3);
+  /* wait for remaining slot time, the bus is idle now, so interrupts may
+   * be served meanwhile */
+  _delay_loop_2(OW_READ_TIMEOUT_3);
 
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
     OW_CONFIG_OUTPUT(busmask);
   }
+#ifdef ONEWIRE_POLLING_SUPPORT
+  ow_global.bustime += OW_SLOT_BUSTIME;
+#endif
   return data;
 }
 
@@ -258,18 +280,25 @@ ow_skip_rom(void)
 
 int8_t noinline
 ow_match_rom(ow_rom_code_t * rom)
+{
+  return ow_match_rom_bus(ONEWIRE_BUSMASK, rom);
+}
+
+
+int8_t noinline
+ow_match_rom_bus(uint8_t busmask, ow_rom_code_t * rom)
 {
   /* reset the bus */
-  if (!reset_onewire(ONEWIRE_BUSMASK))
+  if (!reset_onewire(busmask))
     return -1;
 
   /* transmit command byte */
-  ow_write_byte(ONEWIRE_BUSMASK, OW_ROM_MATCH_ROM);
+  ow_write_byte(busmask, OW_ROM_MATCH_ROM);
 
   /* transmit rom code */
   for (uint8_t i = 0; i < 8; i++)
     for (uint8_t j = 0; j < 8; j++)
-      ow_write(ONEWIRE_BUSMASK, (uint8_t) (rom->bytewise[i] & _BV(j)));
+      ow_write(busmask, (uint8_t) (rom->bytewise[i] & _BV(j)));
 
   return 1;
 }
@@ -682,6 +711,9 @@ ow_discover_sensor(void)
             if (ow_global.current_rom.raw == ow_sensors[i].ow_rom_code.raw)
             {
               ow_sensors[i].present = 1;
+#if ONEWIRE_BUSCOUNT > 1
+              ow_sensors[i].bus = ow_global.bus;
+#endif
               /* skip everything else to retain a regular update rate */
               break;
             }
@@ -699,6 +731,9 @@ ow_discover_sensor(void)
                 OW_DEBUG_POLL("stored new sensor in pos %d\n", i);
                 ow_sensors[i].ow_rom_code.raw = ow_global.current_rom.raw;
                 ow_sensors[i].present = 1;
+#if ONEWIRE_BUSCOUNT > 1
+                ow_sensors[i].bus = ow_global.bus;
+#endif
                 /* read temperature asap
                  * eeproms will be checked for later */
                 break;
@@ -749,86 +784,153 @@ ow_discover_sensor(void)
 }
 
 
-/* this function will be called once every second */
-void
-ow_periodic(void)
+/* read the scratchpad of a single polled sensor. only the bus the sensor
+ * has been discovered on is addressed.
+ *
+ * return values: see ow_temp_read_scratchpad()
+ */
+static int8_t
+ow_read_sensor(uint8_t i, ow_temp_scratchpad_t * sp)
 {
-  /* start discovery of 1-wire devices every DISCOVER_INTERVAL */
-  if (--ow_discover_interval == 0)
+#if ONEWIRE_BUSCOUNT > 1
+  uint8_t busmask = (uint8_t) (1 << (ow_sensors[i].bus + ONEWIRE_STARTPIN));
+#else
+  uint8_t busmask = ONEWIRE_BUSMASK;
+#endif
+
+  if (ow_match_rom_bus(busmask, &ow_sensors[i].ow_rom_code) < 0)
+    return -1;
+
+  /* transmit command byte */
+  ow_write_byte(busmask, OW_FUNC_READ_SP);
+
+  for (uint8_t j = 0; j < 9; j++)
+    sp->bytewise[j] = ow_read_byte(busmask);
+
+  /* check CRC (last byte) */
+  if (sp->crc != crc_checksum(&sp->bytewise, 8))
+    return -2;
+
+#ifdef ONEWIRE_ECMD_LIST_POWER_SUPPORT
+  if (ow_match_rom_bus(busmask, &ow_sensors[i].ow_rom_code) > 0)
   {
-    /* only start a bus discovery if there is no conversion underway*/
-    if (!ow_global.converting)
-    {
-      ow_discover_interval = OW_DISCOVER_INTERVAL;
-      ow_discover_sensor();
-    }
-    else
-      /* wait with discovery until conversion has ended */
-      ow_discover_interval++;
+    ow_write_byte(busmask, OW_FUNC_READ_POWER);
+    ow_sensors[i].power = ow_read(busmask);
   }
+#endif
+
+  return 1;
+}
+
+
+/* called from the mainloop. after a conversion has finished, the sensors
+ * are read one per call, so the mainloop is never blocked for longer than
+ * a single scratchpad read */
+void
+ow_mainloop(void)
+{
+  if (!ow_global.reading)
+    return;
+
+  uint8_t i = ow_global.read_index;
+  while (i < OW_SENSORS_COUNT &&
+         (!ow_sensors[i].present ||
+          !ow_temp_sensor(&ow_sensors[i].ow_rom_code)))
+    i++;
 
-  if (ow_global.converting && --ow_global.convert_delay == 0)
+  if (i >= OW_SENSORS_COUNT)
   {
+    /* round finished, allow the next discovery or conversion */
+    ow_global.reading = 0;
     ow_global.converting = 0;
-    for (uint8_t i = 0; i < OW_SENSORS_COUNT; i++)
-    {
-      if (ow_temp_sensor(&ow_sensors[i].ow_rom_code))
-      {
-        int8_t ret;
-        ow_temp_scratchpad_t sp;
-        ret = ow_temp_read_scratchpad(&ow_sensors[i].ow_rom_code, &sp);
+    return;
+  }
+  ow_global.read_index = (uint8_t) (i + 1);
 
-        if (ret != 1)
-        {
-          OW_DEBUG_POLL("scratchpad read failed: %d\n", ret);
-          continue;
-        }
-#ifdef ONEWIRE_ECMD_LIST_POWER_SUPPORT
-        ow_sensors[i].power = ow_temp_power(&ow_sensors[i].ow_rom_code);
-#endif
+  ow_global.bustime = 0;
+
+  int8_t ret;
+  ow_temp_scratchpad_t sp;
+  ret = ow_read_sensor(i, &sp);
+
+  if (ow_global.bustime > ow_global.stats.max_bustime)
+    ow_global.stats.max_bustime = ow_global.bustime;
+
+  if (ret != 1)
+  {
+    OW_DEBUG_POLL("scratchpad read failed: %d\n", ret);
+    ow_global.stats.errors++;
+    return;
+  }
+  ow_global.stats.reads++;
 
-        int16_t temp = ow_temp_normalize(&ow_sensors[i].ow_rom_code, &sp);
+  int16_t temp = ow_temp_normalize(&ow_sensors[i].ow_rom_code, &sp);
 
 #ifdef DEBUG_OW_POLLING
-        char temperature[6];
-        itoa_fixedpoint(((int8_t) HI8(temp)) * 10 +
-            HI8(((temp & 0x00ff) * 10) + 0x80), 1, temperature);
+  char temperature[6];
+  itoa_fixedpoint(((int8_t) HI8(temp)) * 10 +
+      HI8(((temp & 0x00ff) * 10) + 0x80), 1, temperature);
 
-        OW_DEBUG_POLL("temperature: %s°C on device "
-            "%02x%02x%02x%02x%02x%02x%02x%02x"
+  OW_DEBUG_POLL("temperature: %s°C on device "
+      "%02x%02x%02x%02x%02x%02x%02x%02x"
 #ifdef ONEWIRE_ECMD_LIST_POWER_SUPPORT
-            " %d"
+      " %d"
 #endif
-            "\n", temperature
-            , ow_sensors[i].ow_rom_code.bytewise[0]
-            , ow_sensors[i].ow_rom_code.bytewise[1]
-            , ow_sensors[i].ow_rom_code.bytewise[2]
-            , ow_sensors[i].ow_rom_code.bytewise[3]
-            , ow_sensors[i].ow_rom_code.bytewise[4]
-            , ow_sensors[i].ow_rom_code.bytewise[5]
-            , ow_sensors[i].ow_rom_code.bytewise[6]
-            , ow_sensors[i].ow_rom_code.bytewise[7]
+      "\n", temperature
+      , ow_sensors[i].ow_rom_code.bytewise[0]
+      , ow_sensors[i].ow_rom_code.bytewise[1]
+      , ow_sensors[i].ow_rom_code.bytewise[2]
+      , ow_sensors[i].ow_rom_code.bytewise[3]
+      , ow_sensors[i].ow_rom_code.bytewise[4]
+      , ow_sensors[i].ow_rom_code.bytewise[5]
+      , ow_sensors[i].ow_rom_code.bytewise[6]
+      , ow_sensors[i].ow_rom_code.bytewise[7]
 #ifdef ONEWIRE_ECMD_LIST_POWER_SUPPORT
-            , ow_sensors[i].power
+      , ow_sensors[i].power
 #endif
-            );
+      );
 #endif
 
-        /* a value of 85.0°C will only be stored if we get it twice, to
-         * eliminate communication errors */
-        if ((temp == 21760 && ow_sensors[i].conv_error) ||
-             temp != 21760 )
-          ow_sensors[i].temp =
-              ((int8_t) HI8(temp)) * 10 + HI8(((temp & 0x00ff) * 10) + 0x80);
+  /* a value of 85.0°C will only be stored if we get it twice, to
+   * eliminate communication errors */
+  if ((temp == 21760 && ow_sensors[i].conv_error) ||
+       temp != 21760 )
+    ow_sensors[i].temp =
+        ((int8_t) HI8(temp)) * 10 + HI8(((temp & 0x00ff) * 10) + 0x80);
 
-        /* set a semaphore of if we had a conversion or communication error */
-        ow_sensors[i].conv_error = (temp == 21760);
+  /* set a semaphore of if we had a conversion or communication error */
+  ow_sensors[i].conv_error = (temp == 21760);
 
-  #ifdef ONEWIRE_HOOK_SUPPORT
-        hook_ow_poll_call(&ow_sensors[i], OW_READY);
-  #endif
-      }
+#ifdef ONEWIRE_HOOK_SUPPORT
+  hook_ow_poll_call(&ow_sensors[i], OW_READY);
+#endif
+}
+
+
+/* this function will be called once every second */
+void
+ow_periodic(void)
+{
+  /* start discovery of 1-wire devices every DISCOVER_INTERVAL */
+  if (--ow_discover_interval == 0)
+  {
+    /* only start a bus discovery if there is no conversion underway*/
+    if (!ow_global.converting)
+    {
+      ow_discover_interval = OW_DISCOVER_INTERVAL;
+      ow_discover_sensor();
     }
+    else
+      /* wait with discovery until conversion has ended */
+      ow_discover_interval++;
+  }
+
+  if (ow_global.converting && !ow_global.reading &&
+      --ow_global.convert_delay == 0)
+  {
+    /* the sensors are read by ow_mainloop() from the mainloop */
+    ow_global.read_index = 0;
+    ow_global.reading = 1;
   }
 
   if (--ow_polling_interval == 0)
@@ -912,4 +1014,5 @@ ow_names_save(void)
   header(hardware/onewire/onewire.h)
   init(onewire_init)
   ifdef(`conf_ONEWIRE_POLLING',`timer(50, ow_periodic())')
+  ifdef(`conf_ONEWIRE_POLLING',`mainloop(ow_mainloop)')
 */
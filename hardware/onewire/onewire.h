@@ -140,6 +140,12 @@
 #define OW_READ_TIMEOUT_3 (F_CPU / 1000000 * 65 / 4)
 
 
+/* approximate bus time in µs of a reset and of a single bit timeslot, used
+ * to account the time the mainloop is blocked by the polling */
+#define OW_RESET_BUSTIME 960
+#define OW_SLOT_BUSTIME   85
+
+
 /*
  * macros
  */
@@ -257,6 +263,10 @@ typedef struct
 #endif
   /* semaphore for conversion error 85.0°C */
   uint8_t conv_error :1;
+#if defined(ONEWIRE_POLLING_SUPPORT) && ONEWIRE_BUSCOUNT > 1
+  /* bus the sensor has been discovered on */
+  uint8_t bus :3;
+#endif
 
   /* byte aligned fields */
 #ifdef ONEWIRE_POLLING_SUPPORT
@@ -284,6 +294,20 @@ typedef struct
   uint8_t converting :1;
   /* delay for the sensor to convert the temperatures */
   uint8_t convert_delay :2;
+  /* conversion done, the sensors are read one per mainloop pass */
+  uint8_t reading :1;
+  /* next sensor to be read */
+  uint8_t read_index;
+  /* bus time in µs spent since the last reset of this counter */
+  uint16_t bustime;
+  struct
+  {
+    /* successful and failed scratchpad reads */
+    uint16_t reads;
+    uint16_t errors;
+    /* longest bus time in µs spent in one mainloop pass */
+    uint16_t max_bustime;
+  } stats;
 #endif
   int8_t last_discrepancy;
 #ifdef ONEWIRE_DS2502_SUPPORT
@@ -344,13 +368,14 @@ int8_t ow_read_rom(ow_rom_code_t * rom);
 int8_t ow_skip_rom(void);
 
 
-/* address one sensor.
+/* address one sensor on all busses, or only on the busses in busmask.
  *
  * return values:
  *    1: match rom command issued successfully
  *   -1: no presence pulse has been detected, no device connected?
  */
 int8_t ow_match_rom(ow_rom_code_t * rom);
+int8_t ow_match_rom_bus(uint8_t busmask, ow_rom_code_t * rom);
 
 
 /* detect rom codes on the onewire bus. call ow_search_rom_first() for initial
@@ -464,6 +489,7 @@ int8_t ow_find_sensor_index(ow_rom_code_t * rom);
 extern uint16_t ow_discover_interval;
 extern uint16_t ow_polling_interval;
 void ow_periodic(void);
+void ow_mainloop(void);
 #endif
 
 /* naming support */
@@ -500,6 +526,11 @@ int16_t parse_cmd_onewire_get(char *cmd, char *output, uint16_t len);
 int16_t parse_cmd_onewire_convert(char *cmd, char *output, uint16_t len);
 
 
+#ifdef ONEWIRE_POLLING_SUPPORT
+/* print polling statistics */
+int16_t parse_cmd_onewire_stats(char *cmd, char *output, uint16_t len);
+#endif
+
 /* naming support */
 #ifdef ONEWIRE_NAMING_SUPPORT
 int16_t parse_cmd_onewire_name_set(char *cmd, char *output, uint16_t len);
@@ -519,6 +519,18 @@ parse_cmd_onewire_convert(char *cmd, char *output, uint16_t len)
 }
 #endif
 
+#ifdef ONEWIRE_POLLING_SUPPORT
+int16_t
+parse_cmd_onewire_stats(char *cmd, char *output, uint16_t len)
+{
+  return ECMD_FINAL(snprintf_P(output, len,
+                               PSTR("reads %u errors %u max stall %uus"),
+                               ow_global.stats.reads,
+                               ow_global.stats.errors,
+                               ow_global.stats.max_bustime));
+}
+#endif
+
 /* naming support */
 #ifdef ONEWIRE_NAMING_SUPPORT
 
@@ -685,6 +697,9 @@ parse_cmd_onewire_name_save(char *cmd, char *output, uint16_t len)
     ecmd_feature(onewire_get, "1w get", DEVICE, Return temperature value of onewire device (provide 64-bit ID as 16-hex-digits))
   ecmd_endif()
   ecmd_feature(onewire_convert, "1w convert", DEVICE, Trigger temperature conversion of either DEVICE or all connected devices)
+  ecmd_ifdef(ONEWIRE_POLLING_SUPPORT)
+    ecmd_feature(onewire_stats, "1w stats", , Show number of polled sensor reads, read errors and the longest mainloop stall)
+  ecmd_endif()
   ecmd_ifdef(ONEWIRE_NAMING_SUPPORT)
     ecmd_feature(onewire_name_set, "1w name set", ID DEVICE NAME, Assign a name to/from an device address)
     ecmd_feature(onewire_name_clear, "1w name clear", ID, Delete a name mapping)
@@ -25,6 +25,8 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
 
@@ -43,7 +45,27 @@ rfm12_status_t rfm12_status;
 static volatile rfm12_index_t rfm12_index;
 static volatile rfm12_index_t rfm12_txlen;
 
+/* Frames waiting for the air, the one at rfm12_tx_head is sent first.
+ * They are sent from here, so the uip buffer is free for reception as
+ * soon as a frame has been queued. */
+static struct
+{
+  rfm12_index_t len;            /* bytes excluding the LLH */
+  uint8_t buf[RFM12_BUFFER_LEN];
+} rfm12_tx_frames[RFM12_TX_QUEUE];
+
+static volatile uint8_t rfm12_tx_head;
+static volatile uint8_t rfm12_tx_count;
+static uint8_t *rfm12_txbuf;    /* frame being sent, LLH first */
+
+/* Ticks of rfm12_net_periodic to wait before the next attempt, and how
+ * often the air was found busy for the frame at the head of the queue. */
+static volatile uint8_t rfm12_tx_backoff;
+static uint8_t rfm12_tx_tries;
+
 static void rfm12_txstart_hard(void);
+static void rfm12_tx_enqueue(rfm12_index_t size);
+static void rfm12_tx_next(void);
 //static uint8_t rfm12_rxstop(void);
 
 
@@ -180,17 +202,18 @@ ISR(RFM12_VECTOR)               /* PCINT */
 #endif /* RFM12_SOURCE_ROUTE_ALL */
 
     case RFM12_TX_SIZE_HI:
-      rfm12_trans(RFM12_CMD_TX | rfm12_buf[0]);
+      rfm12_trans(RFM12_CMD_TX | rfm12_txbuf[0]);
       rfm12_status++;
       break;
 
     case RFM12_TX_SIZE_LO:
-      rfm12_trans(RFM12_CMD_TX | rfm12_buf[1]);
+      rfm12_trans(RFM12_CMD_TX | rfm12_txbuf[1]);
       rfm12_status++;
       break;
 
     case RFM12_TX_DATA:
-      rfm12_trans(RFM12_CMD_TX | rfm12_data[rfm12_index++]);
+      rfm12_trans(RFM12_CMD_TX |
+                  rfm12_txbuf[RFM12_LLH_LEN + rfm12_index++]);
 
       if (rfm12_index >= rfm12_txlen)
         rfm12_status = RFM12_TX_DATAEND;
@@ -203,7 +226,14 @@ ISR(RFM12_VECTOR)               /* PCINT */
       PIN_CLEAR(STATUSLED_RFM12_TX);
 #endif
       rfm12_trans(RFM12_CMD_TX | 0x08); /* TX off */
-      uip_buf_unlock();
+
+      /* Frame is out, release its slot.  Leave a tick between two frames
+       * so the receivers can hand the previous one to their stack. */
+      if (++rfm12_tx_head == RFM12_TX_QUEUE)
+        rfm12_tx_head = 0;
+      rfm12_tx_count--;
+      rfm12_tx_backoff = 1;
+
       rfm12_rxstart();
       //break;
 
@@ -211,8 +241,6 @@ ISR(RFM12_VECTOR)               /* PCINT */
     case RFM12_NEW:
       rfm12_trans(RFM12_CMD_STATUS);    /* clear interrupt flags in RFM12 */
   }
-  if (rfm12_status >= RFM12_TX)
-    _uip_buf_lock = 8;
 }
 
 void
@@ -350,14 +378,13 @@ rfm12_rxfinish(void)
     {
       /* Strip source route header. */
       memmove(rfm12_buf, rfm12_buf + 3, len - 1);
+      rfm12_tx_enqueue(len - 3);        /* Num of bytes excluding LLH. */
 
-      for (uint8_t j = 0; j < 15; j++)
-        _delay_ms(10);          /* Wait 150ms for slower receivers to get
-                                 * ready again. */
+      /* Wait 160ms for slower receivers to get ready again. */
+      if (rfm12_tx_backoff < 8)
+        rfm12_tx_backoff = 8;
 
-      rfm12_txlen = len - 3;    /* Num of bytes excluding LLH. */
-      rfm12_txstart_hard();
-      return 0;                 /* We mustn't parse the packet,
+      len = 0;                  /* We mustn't parse the packet,
                                  * since this might cause a reply. */
     }
 #else
@@ -377,26 +404,103 @@ rfm12_rxfinish(void)
   return (len);                 /* receive size */
 }
 
-void
-rfm12_txstart(rfm12_index_t size)
+/* Copy the frame in rfm12_buf, LLH included, to the transmit queue. */
+static void
+rfm12_tx_enqueue(rfm12_index_t size)
 {
-  if (rfm12_status > RFM12_RX
-      || (rfm12_status == RFM12_RX && rfm12_index > 0))
+  if (size > RFM12_DATA_LEN)
+    return;
+
+  uint8_t sreg = SREG;
+  cli();
+  uint8_t slot = rfm12_tx_head + rfm12_tx_count;
+  uint8_t full = rfm12_tx_count == RFM12_TX_QUEUE;
+  SREG = sreg;
+
+  if (full)
   {
-    return;                     /* rx or tx in action or
-                                 * new packet left in buffer */
+    RFM12_DEBUG("rfm12_net/queue full, frame dropped");
+    return;
   }
+  if (slot >= RFM12_TX_QUEUE)
+    slot -= RFM12_TX_QUEUE;
 
-  rfm12_txlen = size;
+  memcpy(rfm12_tx_frames[slot].buf, rfm12_buf, RFM12_LLH_LEN + size);
+  rfm12_tx_frames[slot].len = size;
 
+  cli();
+  rfm12_tx_count++;
+  SREG = sreg;
+}
+
+void
+rfm12_txstart(rfm12_index_t size)
+{
 #ifdef TEENSY_SUPPORT
   rfm12_buf[0] = 0;
 #else
-  rfm12_buf[0] = HI8(rfm12_txlen);
+  rfm12_buf[0] = HI8(size);
 #endif
-  rfm12_buf[1] = LO8(rfm12_txlen);
+  rfm12_buf[1] = LO8(size);
 
+  rfm12_tx_enqueue(size);
+  rfm12_tx_next();
+}
+
+/* Send the frame at the head of the queue if the air is free.  Carrier
+ * sense is done by the receiver: once it has caught the sync pattern of
+ * a frame rfm12_index moves away from zero.  A busy channel makes us
+ * wait a random number of ticks, the window doubling with every try. */
+static void
+rfm12_tx_next(void)
+{
+  if (rfm12_tx_count == 0 || rfm12_tx_backoff)
+    return;
+
+  uint8_t sreg = SREG;
+  cli();
+
+  if (rfm12_status >= RFM12_TX || rfm12_status == RFM12_NEW)
+  {
+    /* sending already or a received packet waits for rfm12_process */
+    SREG = sreg;
+    return;
+  }
+
+  if (rfm12_status == RFM12_RX && rfm12_index > 0)
+  {
+    SREG = sreg;
+
+    if (++rfm12_tx_tries > RFM12_CSMA_TRIES)
+    {
+      RFM12_DEBUG("rfm12_net/air busy, frame dropped");
+      cli();
+      if (++rfm12_tx_head == RFM12_TX_QUEUE)
+        rfm12_tx_head = 0;
+      rfm12_tx_count--;
+      SREG = sreg;
+      rfm12_tx_tries = 0;
+      return;
+    }
+
+    uint8_t window = rfm12_tx_tries < 5 ? 1 << rfm12_tx_tries : 32;
+    rfm12_tx_backoff = 1 + (rand() & (window - 1));
+    return;
+  }
+
+  rfm12_tx_tries = 0;
+  rfm12_txbuf = rfm12_tx_frames[rfm12_tx_head].buf;
+  rfm12_txlen = rfm12_tx_frames[rfm12_tx_head].len;
   rfm12_txstart_hard();
+
+  SREG = sreg;
+}
+
+void
+rfm12_net_periodic(void)
+{
+  if (rfm12_tx_backoff)
+    rfm12_tx_backoff--;
 }
 
 
@@ -419,11 +523,9 @@ rfm12_txstart_hard(void)
   rfm12_epilogue();
 
   /* Force interrupts active no matter what.
-   * 
-   * If we're forwarding a packet from say Ethernet, uip_buf_unlock won't
-   * unlock since there's an active RFM12 transfer, but it'd leave
-   * the RFM12 interrupt disabled as well. */
-  _uip_buf_lock = 8;
+   *
+   * If we're forwarding a packet from say Ethernet, the uip buffer is
+   * locked and the RFM12 interrupt disabled. */
   rfm12_int_enable();
 }
 
@@ -431,6 +533,8 @@ rfm12_txstart_hard(void)
 void
 rfm12_process(void)
 {
+  rfm12_tx_next();
+
   uip_len = rfm12_rxfinish();
   if (!uip_len)
     return;
@@ -473,12 +577,14 @@ rfm12_process(void)
 
   /* Application has generated output, send it out. */
   router_output();
+  uip_buf_unlock();
 }
 
 /*
   -- Ethersex META --
   header(hardware/radio/rfm12/rfm12_net.h)
   mainloop(rfm12_process)
+  timer(1, rfm12_net_periodic())
   ifdef(`conf_RFM12_USE_POLL',`mainloop(rfm12_int_process)')
   init(rfm12_net_init)
 */
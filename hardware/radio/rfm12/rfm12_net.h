@@ -58,6 +58,7 @@ typedef enum
 /* Current RFM12 transceiver status. */
 extern rfm12_status_t rfm12_status;
 
+/* A frame of the transmit queue is on the air. */
 #define rfm12_tx_active()  (rfm12_status >= RFM12_TX)
 
 #ifdef RFM12_USE_POLL
@@ -89,11 +90,20 @@ typedef uint16_t rfm12_index_t;
 /* how many calls to wait before a retransmit */
 #define RFM12_TXDELAY 0x10
 
+/* number of frames waiting for the air, each takes RFM12_BUFFER_LEN */
+#ifndef RFM12_TX_QUEUE
+#define RFM12_TX_QUEUE 1
+#endif
+
+/* how often the air may be found busy before a frame is dropped */
+#define RFM12_CSMA_TRIES 8
+
 
 uint8_t rfm12_rxstart(void);
 rfm12_index_t rfm12_rxfinish(void);
 void rfm12_txstart(rfm12_index_t);
 void rfm12_process(void);
+void rfm12_net_periodic(void);
 
 
 #else /* not RFM12_IP_SUPPORT */
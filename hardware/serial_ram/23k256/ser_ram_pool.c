@@ -0,0 +1,199 @@
+/*
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 3
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+* For more information on the GPL, please go to:
+* http://www.gnu.org/copyleft/gpl.html
+*/
+
+#include <string.h>
+
+#include "config.h"
+#include "sram_23k256.h"
+#include "ser_ram_pool.h"
+
+uint8_t ser_ram_next[SER_RAM_PAGES];
+uint8_t ser_ram_free_pages;
+
+/* page to start the search for a free one at */
+static uint8_t ser_ram_hint;
+
+void
+ser_ram_pool_init(void)
+{
+  memset(ser_ram_next, SER_RAM_FREE, sizeof(ser_ram_next));
+  ser_ram_free_pages = SER_RAM_PAGES;
+  SERRAMDEBUG("%d pages of %d bytes\n", SER_RAM_PAGES, SER_RAM_PAGE_SIZE);
+}
+
+uint8_t
+ser_ram_page_alloc(uint8_t prev)
+{
+  if (!ser_ram_free_pages)
+    return SER_RAM_NOPAGE;
+
+  uint8_t page = ser_ram_hint;
+  while (ser_ram_next[page] != SER_RAM_FREE)
+    if (++page == SER_RAM_PAGES)
+      page = 0;
+
+  ser_ram_next[page] = SER_RAM_NOPAGE;
+  ser_ram_free_pages--;
+  ser_ram_hint = page;
+
+  if (prev != SER_RAM_NOPAGE)
+    ser_ram_next[prev] = page;
+  return page;
+}
+
+void
+ser_ram_page_free(uint8_t page)
+{
+  while (page != SER_RAM_NOPAGE)
+  {
+    uint8_t next = ser_ram_next[page];
+    ser_ram_next[page] = SER_RAM_FREE;
+    ser_ram_free_pages++;
+    page = next;
+  }
+}
+
+
+uint8_t
+ser_ram_ring_put(ser_ram_ring_t * ring, const void *buf, uint16_t len)
+{
+  const uint8_t *p = buf;
+
+  /* Check for enough pages first, so nothing is written partly */
+  uint16_t room = ring->last == SER_RAM_NOPAGE ? 0 :
+    SER_RAM_PAGE_SIZE - ring->wr;
+  if (len > room &&
+      (len - room + SER_RAM_PAGE_SIZE - 1) / SER_RAM_PAGE_SIZE >
+      ser_ram_free_pages)
+    return 0;
+
+  while (len)
+  {
+    if (ring->last == SER_RAM_NOPAGE || ring->wr == SER_RAM_PAGE_SIZE)
+    {
+      ring->last = ser_ram_page_alloc(ring->last);
+      ring->wr = 0;
+      if (ring->first == SER_RAM_NOPAGE)
+      {
+        ring->first = ring->last;
+        ring->rd = 0;
+      }
+    }
+
+    uint16_t chunk = SER_RAM_PAGE_SIZE - ring->wr;
+    if (chunk > len)
+      chunk = len;
+
+    sram23k256_write(ser_ram_addr(ring->last, ring->wr), p, chunk);
+    p += chunk;
+    len -= chunk;
+    ring->wr += chunk;
+    ring->len += chunk;
+  }
+
+  return 1;
+}
+
+static uint16_t
+ser_ram_ring_copy(ser_ram_ring_t * ring, uint8_t * buf, uint16_t len,
+                  uint8_t consume)
+{
+  uint8_t page = ring->first;
+  uint16_t rd = ring->rd;
+
+  if (len > ring->len)
+    len = ring->len;
+
+  for (uint16_t done = 0; done < len;)
+  {
+    if (rd == SER_RAM_PAGE_SIZE)
+    {
+      uint8_t next = ser_ram_next[page];
+      if (consume)
+      {
+        ser_ram_next[page] = SER_RAM_NOPAGE;    /* free this one only */
+        ser_ram_page_free(page);
+      }
+      page = next;
+      rd = 0;
+    }
+
+    uint16_t chunk = SER_RAM_PAGE_SIZE - rd;
+    if (chunk > len - done)
+      chunk = len - done;
+
+    if (buf)
+      sram23k256_read(ser_ram_addr(page, rd), buf + done, chunk);
+    done += chunk;
+    rd += chunk;
+  }
+
+  if (consume)
+  {
+    ring->len -= len;
+    if (ring->len == 0)
+    {
+      ser_ram_page_free(page);
+      ring->first = ring->last = SER_RAM_NOPAGE;
+      ring->rd = ring->wr = 0;
+    }
+    else
+    {
+      if (rd == SER_RAM_PAGE_SIZE)
+      {
+        uint8_t next = ser_ram_next[page];
+        ser_ram_next[page] = SER_RAM_NOPAGE;
+        ser_ram_page_free(page);
+        page = next;
+        rd = 0;
+      }
+      ring->first = page;
+      ring->rd = rd;
+    }
+  }
+
+  return len;
+}
+
+uint16_t
+ser_ram_ring_get(ser_ram_ring_t * ring, void *buf, uint16_t len)
+{
+  return ser_ram_ring_copy(ring, buf, len, 1);
+}
+
+uint16_t
+ser_ram_ring_peek(ser_ram_ring_t * ring, void *buf, uint16_t len)
+{
+  return ser_ram_ring_copy(ring, buf, len, 0);
+}
+
+void
+ser_ram_ring_flush(ser_ram_ring_t * ring)
+{
+  ser_ram_page_free(ring->first);
+  ring->first = ring->last = SER_RAM_NOPAGE;
+  ring->rd = ring->wr = ring->len = 0;
+}
+
+/*
+  -- Ethersex META --
+  header(hardware/serial_ram/23k256/ser_ram_pool.h)
+  init(ser_ram_pool_init)
+*/
@@ -0,0 +1,88 @@
+/*
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 3
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+* For more information on the GPL, please go to:
+* http://www.gnu.org/copyleft/gpl.html
+*/
+
+#ifndef HAVE_SER_RAM_POOL_H
+#define HAVE_SER_RAM_POOL_H
+
+#include <stdint.h>
+#include "config.h"
+#include "sram_23k256.h"
+
+/* The serial RAM is split into pages of SER_RAM_PAGE_SIZE bytes, which
+   are handed out to the RAM disk and to ring buffers.  Pages of one user
+   are chained by a table kept in internal RAM. */
+#define SER_RAM_PAGES  (SRAM23K256_SIZE / SER_RAM_PAGE_SIZE)
+#define SER_RAM_NOPAGE 0xFF     /* end of chain */
+#define SER_RAM_FREE   0xFE     /* page not in use */
+
+#if SER_RAM_PAGES > SER_RAM_FREE
+#error "SER_RAM_PAGE_SIZE too small, at most 254 pages are supported"
+#endif
+
+#define ser_ram_addr(page, offset) \
+  ((uint16_t) (page) * SER_RAM_PAGE_SIZE + (offset))
+
+extern uint8_t ser_ram_next[SER_RAM_PAGES];
+extern uint8_t ser_ram_free_pages;
+
+/* Page following PAGE in its chain, SER_RAM_NOPAGE at the end. */
+#define ser_ram_page_next(page) (ser_ram_next[page])
+
+void ser_ram_pool_init(void);
+
+/* Allocate a page and append it to the chain ending with PREV, which may
+   be SER_RAM_NOPAGE to start a new chain.  Returns SER_RAM_NOPAGE if the
+   serial RAM is full. */
+uint8_t ser_ram_page_alloc(uint8_t prev);
+
+/* Free PAGE and all pages chained to it. */
+void ser_ram_page_free(uint8_t page);
+
+
+/* A byte queue of arbitrary length, that only occupies as many pages as
+   it holds data.  Initialize with SER_RAM_RING_INIT. */
+typedef struct
+{
+  uint8_t first;                /* page data is read from */
+  uint8_t last;                 /* page data is appended to */
+  uint16_t rd;                  /* read offset within first */
+  uint16_t wr;                  /* write offset within last */
+  uint16_t len;                 /* bytes queued */
+} ser_ram_ring_t;
+
+#define SER_RAM_RING_INIT { SER_RAM_NOPAGE, SER_RAM_NOPAGE, 0, 0, 0 }
+
+#define ser_ram_ring_len(ring) ((ring)->len)
+
+/* Append LEN bytes from BUF, either completely or not at all.
+   Returns 0 if there are not enough free pages. */
+uint8_t ser_ram_ring_put(ser_ram_ring_t * ring, const void *buf, uint16_t len);
+
+/* Copy up to LEN bytes from the head of RING to BUF and remove them.
+   BUF may be NULL to just drop them.  Returns the number of bytes. */
+uint16_t ser_ram_ring_get(ser_ram_ring_t * ring, void *buf, uint16_t len);
+
+/* Like ser_ram_ring_get, but leave the data queued. */
+uint16_t ser_ram_ring_peek(ser_ram_ring_t * ring, void *buf, uint16_t len);
+
+/* Drop all queued data. */
+void ser_ram_ring_flush(ser_ram_ring_t * ring);
+
+#endif /* HAVE_SER_RAM_POOL_H */
@@ -48,19 +48,55 @@
 /* Hold flag for status register*/
 #define SRAM_23K256_HOLD 1  /* Use HOLD pin */
 
+#if ARCH == ARCH_HOST
+/* Stand-in for the chip, so users of the serial RAM can be run on the
+   host. */
+static uint8_t sram23k256_mem[SRAM23K256_SIZE];
+
+void sram23k256_read(uint16_t address_ui16, void *dataPtr, uint16_t len_ui16)
+{
+  uint8_t *dataPtr_pui8 = dataPtr;
+
+  while (len_ui16--)
+  {
+    *dataPtr_pui8++ = sram23k256_mem[address_ui16++ % SRAM23K256_SIZE];
+  }
+}
+
+void sram23k256_write(uint16_t address_ui16, const void *dataPtr, uint16_t len_ui16)
+{
+  const uint8_t *dataPtr_pui8 = dataPtr;
+
+  while (len_ui16--)
+  {
+    sram23k256_mem[address_ui16++ % SRAM23K256_SIZE] = *dataPtr_pui8++;
+  }
+}
+
+int16_t sram23k256_init(void)
+{
+  SERRAMDEBUG ("init (host)\n");
+  memset(sram23k256_mem, 0, sizeof(sram23k256_mem));
+  return ECMD_FINAL_OK;
+}
+
+#else /* ARCH != ARCH_HOST */
+
 /**
 * @brief Read data from the serial RAM
 *
 * Adresses the serial RAM chip and reads the given number of bytes
-* from the RAM, starting at address_ui16 into dataPtr_pui8.
+* from the RAM, starting at address_ui16 into dataPtr.
+* The chip runs in sequential mode, so this is a single burst for any
+* length, wrapping around at the end of the RAM.
 *
 * @param address_ui16 RAM address to start reading from.
-* @param dataPtr_pui8 Pointer to destination
-* @param len_ui8 Number of bytes to be read
+* @param dataPtr Pointer to destination
+* @param len_ui16 Number of bytes to be read
 */
-void sram23k256_read(uint16_t address_ui16, uint8_t dataPtr_pui8[], uint8_t len_ui8)
+void sram23k256_read(uint16_t address_ui16, void *dataPtr, uint16_t len_ui16)
 {
-  uint16_t ctr = 0;
+  uint8_t *dataPtr_pui8 = dataPtr;
 
   /* Acquire device */
   PIN_CLEAR(SPI_CS_23K256);
@@ -71,9 +107,9 @@ void sram23k256_read(uint16_t address_ui16, uint8_t dataPtr_pui8[], uint8_t len_
   spi_send(LO8(address_ui16));
 
   /* Read data from chip */
-  for (ctr = 0; ctr < len_ui8; ctr++)
+  while (len_ui16--)
   {
-    dataPtr_pui8[ctr] = spi_send(0);
+    *dataPtr_pui8++ = spi_send(0);
   }
 
   /* Release device */
@@ -84,15 +120,16 @@ void sram23k256_read(uint16_t address_ui16, uint8_t dataPtr_pui8[], uint8_t len_
 * @brief Write data into the serial RAM
 *
 * Adresses the serial RAM chip and writes the given number of bytes
-* from dataPtr_ui8 to the RAM, starting at address_ui16.
+* from dataPtr to the RAM, starting at address_ui16.
+* Like reading, this is a single sequential burst.
 *
 * @param address_ui16 RAM address to start writing to.
-* @param dataPtr_pui8 Pointer to source.
-* @param len_ui8 Number of bytes to be written
+* @param dataPtr Pointer to source.
+* @param len_ui16 Number of bytes to be written
 */
-void sram23k256_write(uint16_t address_ui16, uint8_t dataPtr_pui8[], uint8_t len_ui8)
+void sram23k256_write(uint16_t address_ui16, const void *dataPtr, uint16_t len_ui16)
 {
-  uint16_t ctr = 0;
+  const uint8_t *dataPtr_pui8 = dataPtr;
 
   /* Acquire device */
   PIN_CLEAR(SPI_CS_23K256);
@@ -103,9 +140,9 @@ void sram23k256_write(uint16_t address_ui16, uint8_t dataPtr_pui8[], uint8_t len
   spi_send(LO8(address_ui16));
 
   /* Write data to chip */
-  for (ctr = 0; ctr < len_ui8; ctr++)
+  while (len_ui16--)
   {
-     spi_send(dataPtr_pui8[ctr]);
+     spi_send(*dataPtr_pui8++);
   }
 
   /* Release device */
@@ -215,6 +252,7 @@ int16_t sram23k256_init(void)
 
   return ECMD_FINAL_OK;
 }
+#endif /* ARCH != ARCH_HOST */
 
 /*
   -- Ethersex META --
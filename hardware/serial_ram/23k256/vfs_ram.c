@@ -0,0 +1,299 @@
+/*
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 3
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+* For more information on the GPL, please go to:
+* http://www.gnu.org/copyleft/gpl.html
+*/
+
+/* RAM disk on the 23K256 serial RAM.  Contents are lost on reset, so
+ * this is meant for scratch and spool files.  The directory lives in
+ * internal RAM, file data in chains of pages of the serial RAM pool. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "core/vfs/vfs.h"
+#include "sram_23k256.h"
+#include "ser_ram_pool.h"
+#include "vfs_ram.h"
+
+struct vfs_ram_file_t
+{
+  char name[VFS_RAM_NAMELEN];   /* empty if unused */
+  uint8_t first;
+  uint16_t size;
+  uint8_t open;                 /* handles referring to the file */
+};
+
+static struct vfs_ram_file_t vfs_ram_files[VFS_RAM_FILES];
+
+#define RAM_FILE(fh) (&vfs_ram_files[(fh)->u.ram.file])
+
+
+static int8_t
+vfs_ram_lookup(const char *name)
+{
+  if (strlen(name) >= VFS_RAM_NAMELEN)
+    return -1;
+
+  for (uint8_t i = 0; i < VFS_RAM_FILES; i++)
+    if (vfs_ram_files[i].name[0]
+        && strncmp(vfs_ram_files[i].name, name, VFS_RAM_NAMELEN) == 0)
+      return i;
+
+  return -1;
+}
+
+/* Return the INDEX-th page of file F, extending the chain if ALLOC is
+ * set.  SER_RAM_NOPAGE if there is none. */
+static uint8_t
+vfs_ram_page(struct vfs_ram_file_t *f, uint8_t index, uint8_t alloc)
+{
+  uint8_t prev = SER_RAM_NOPAGE;
+  uint8_t page = f->first;
+
+  for (;;)
+  {
+    if (page == SER_RAM_NOPAGE)
+    {
+      if (!alloc)
+        return SER_RAM_NOPAGE;
+      page = ser_ram_page_alloc(prev);
+      if (page == SER_RAM_NOPAGE)
+        return SER_RAM_NOPAGE;
+      if (prev == SER_RAM_NOPAGE)
+        f->first = page;
+    }
+
+    if (!index--)
+      return page;
+
+    prev = page;
+    page = ser_ram_page_next(page);
+  }
+}
+
+
+struct vfs_file_handle_t *
+vfs_ram_open(const char *filename)
+{
+  int8_t i = vfs_ram_lookup(filename);
+  if (i < 0)
+    return NULL;                /* File not found. */
+
+  struct vfs_file_handle_t *fh = vfs_handle_alloc();
+  if (fh == NULL)
+    return NULL;
+
+  fh->fh_type = VFS_RAM;
+  fh->u.ram.file = i;
+  fh->u.ram.offset = 0;
+  vfs_ram_files[i].open++;
+
+  return fh;
+}
+
+void
+vfs_ram_close(struct vfs_file_handle_t *fh)
+{
+  RAM_FILE(fh)->open--;
+  vfs_handle_free(fh);
+}
+
+vfs_size_t
+vfs_ram_read(struct vfs_file_handle_t *fh, void *buf, vfs_size_t length)
+{
+  struct vfs_ram_file_t *f = RAM_FILE(fh);
+  uint16_t offset = fh->u.ram.offset;
+  uint8_t *p = buf;
+
+  /* another handle may have truncated the file meanwhile */
+  if (offset >= f->size)
+    length = 0;
+  else if (length > f->size - offset)
+    length = f->size - offset;
+
+  uint8_t page = vfs_ram_page(f, offset / SER_RAM_PAGE_SIZE, 0);
+  uint16_t pos = offset % SER_RAM_PAGE_SIZE;
+  vfs_size_t done = 0;
+
+  while (done < length && page != SER_RAM_NOPAGE)
+  {
+    uint16_t chunk = SER_RAM_PAGE_SIZE - pos;
+    if (chunk > length - done)
+      chunk = length - done;
+
+    sram23k256_read(ser_ram_addr(page, pos), p + done, chunk);
+    done += chunk;
+    page = ser_ram_page_next(page);
+    pos = 0;
+  }
+
+  fh->u.ram.offset += done;
+  return done;
+}
+
+vfs_size_t
+vfs_ram_write(struct vfs_file_handle_t *fh, void *buf, vfs_size_t length)
+{
+  struct vfs_ram_file_t *f = RAM_FILE(fh);
+  uint8_t *p = buf;
+
+  /* don't leave a hole behind a truncation by another handle */
+  if (fh->u.ram.offset > f->size)
+    fh->u.ram.offset = f->size;
+  uint16_t offset = fh->u.ram.offset;
+
+  if (length > SRAM23K256_SIZE - offset)
+    length = SRAM23K256_SIZE - offset;
+
+  uint8_t page = vfs_ram_page(f, offset / SER_RAM_PAGE_SIZE, 1);
+  uint16_t pos = offset % SER_RAM_PAGE_SIZE;
+  vfs_size_t done = 0;
+
+  while (done < length)
+  {
+    if (page == SER_RAM_NOPAGE)
+      break;                    /* serial RAM full */
+
+    uint16_t chunk = SER_RAM_PAGE_SIZE - pos;
+    if (chunk > length - done)
+      chunk = length - done;
+
+    sram23k256_write(ser_ram_addr(page, pos), p + done, chunk);
+    done += chunk;
+    pos += chunk;
+
+    if (pos == SER_RAM_PAGE_SIZE && done < length)
+    {
+      uint8_t next = ser_ram_page_next(page);
+      page = next != SER_RAM_NOPAGE ? next : ser_ram_page_alloc(page);
+      pos = 0;
+    }
+  }
+
+  fh->u.ram.offset += done;
+  if (fh->u.ram.offset > f->size)
+    f->size = fh->u.ram.offset;
+
+  return done;
+}
+
+uint8_t
+vfs_ram_fseek(struct vfs_file_handle_t *fh, vfs_size_t offset, uint8_t whence)
+{
+  uint16_t len = RAM_FILE(fh)->size;
+  vfs_size_t new_pos;
+
+  switch (whence)
+  {
+    case SEEK_SET:
+      new_pos = offset;
+      break;
+
+    case SEEK_CUR:
+      new_pos = fh->u.ram.offset + offset;
+      break;
+
+    case SEEK_END:
+      new_pos = len + offset;
+      break;
+
+    default:
+      return -1;                /* Invalid argument. */
+  }
+
+  if (new_pos > len)
+    return -1;                  /* Beyond end of file. */
+
+  fh->u.ram.offset = new_pos;
+  return 0;
+}
+
+uint8_t
+vfs_ram_truncate(struct vfs_file_handle_t *fh, vfs_size_t length)
+{
+  struct vfs_ram_file_t *f = RAM_FILE(fh);
+
+  if (length > f->size)
+    return -1;                  /* Growing is not supported. */
+
+  if (length == 0)
+  {
+    ser_ram_page_free(f->first);
+    f->first = SER_RAM_NOPAGE;
+  }
+  else
+  {
+    uint8_t last = vfs_ram_page(f, (length - 1) / SER_RAM_PAGE_SIZE, 0);
+    ser_ram_page_free(ser_ram_page_next(last));
+    ser_ram_next[last] = SER_RAM_NOPAGE;
+  }
+
+  f->size = length;
+  if (fh->u.ram.offset > length)
+    fh->u.ram.offset = length;
+
+  return 0;
+}
+
+struct vfs_file_handle_t *
+vfs_ram_create(const char *name)
+{
+  struct vfs_file_handle_t *fh = vfs_ram_open(name);
+  if (fh)
+  {
+    vfs_ram_truncate(fh, 0);
+    return fh;
+  }
+
+  if (strlen(name) >= VFS_RAM_NAMELEN)
+    return NULL;
+
+  for (uint8_t i = 0; i < VFS_RAM_FILES; i++)
+  {
+    struct vfs_ram_file_t *f = &vfs_ram_files[i];
+    if (f->name[0])
+      continue;
+
+    strcpy(f->name, name);
+    f->first = SER_RAM_NOPAGE;
+    f->size = 0;
+    f->open = 0;
+    return vfs_ram_open(name);
+  }
+
+  return NULL;                  /* Directory full. */
+}
+
+uint8_t
+vfs_ram_unlink(const char *name)
+{
+  int8_t i = vfs_ram_lookup(name);
+  if (i < 0 || vfs_ram_files[i].open)
+    return 1;                   /* Not found or still open. */
+
+  ser_ram_page_free(vfs_ram_files[i].first);
+  vfs_ram_files[i].name[0] = 0;
+  return 0;
+}
+
+vfs_size_t
+vfs_ram_size(struct vfs_file_handle_t *fh)
+{
+  return RAM_FILE(fh)->size;
+}
@@ -0,0 +1,62 @@
+/*
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 3
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*
+* For more information on the GPL, please go to:
+* http://www.gnu.org/copyleft/gpl.html
+*/
+
+#ifndef VFS_RAM_H
+#define VFS_RAM_H
+
+#include <stdlib.h>
+
+#define VFS_RAM_NAMELEN 12
+
+typedef struct {
+  uint8_t file;			/* index to vfs_ram_files */
+  uint16_t offset;
+
+} vfs_file_handle_ram_t;
+
+/* vfs_ram_ Prototypes. */
+struct vfs_file_handle_t *vfs_ram_open (const char *filename);
+void vfs_ram_close (struct vfs_file_handle_t *);
+vfs_size_t vfs_ram_read  (struct vfs_file_handle_t *, void *buf,
+			  vfs_size_t length);
+vfs_size_t vfs_ram_write (struct vfs_file_handle_t *, void *buf,
+			  vfs_size_t length);
+uint8_t vfs_ram_fseek (struct vfs_file_handle_t *, vfs_size_t offset,
+		       uint8_t whence);
+uint8_t vfs_ram_truncate (struct vfs_file_handle_t *, vfs_size_t length);
+struct vfs_file_handle_t *vfs_ram_create (const char *name);
+uint8_t vfs_ram_unlink (const char *name);
+vfs_size_t vfs_ram_size (struct vfs_file_handle_t *);
+
+
+#define VFS_RAM_FUNCS {				\
+    "ram",					\
+    vfs_ram_open,				\
+    vfs_ram_close,				\
+    vfs_ram_read,				\
+    vfs_ram_write,				\
+    vfs_ram_fseek,				\
+    vfs_ram_truncate,				\
+    vfs_ram_create,				\
+    vfs_ram_unlink,				\
+    vfs_ram_size,				\
+  }
+
+#endif	/* VFS_RAM_H */
@@ -18,6 +18,8 @@
  * For more information on the GPL, please go to:
  * http://www.gnu.org/copyleft/gpl.html
  */
+#include <stdio.h>
+#include <stdlib.h>
 #include <avr/pgmspace.h>
 #include "config.h"
 #include "sram.h"
@@ -26,6 +28,10 @@
 
 #include "protocols/ecmd/ecmd-base.h"
 
+extern char *__brkval;
+extern uint8_t __heap_start;
+extern uint8_t __data_start, __data_end, __bss_start, __bss_end;
+
 static uint8_t sram_memtest(void);
 
 void
@@ -38,6 +44,15 @@ sram_init(void)
 #ifdef SRAM_MEMTEST_ON_BOOT
 	sram_memtest();
 #endif
+
+#ifdef SRAM_HEAP_SUPPORT
+	/* the heap can only be moved as long as it is empty */
+	if (__brkval == NULL) {
+		__malloc_heap_start = (char *) SRAM_START_ADDRESS;
+		__malloc_heap_end = (char *) SRAM_END_ADDRESS;
+	} else
+		SRAM_DEBUG("heap already in use, not moved\n");
+#endif
 }
 
 /*
@@ -49,7 +64,12 @@ sram_init(void)
 static uint8_t
 sram_memtest(void)
 {
+	/* only test what is not part of the heap */
 	uint8_t *sram = SRAM_START_ADDRESS;
+#ifdef SRAM_HEAP_SUPPORT
+	if (__malloc_heap_start == (char *) SRAM_START_ADDRESS && __brkval)
+		sram = (uint8_t *) __brkval;
+#endif
 	uint8_t *cnt;
 	uint8_t c = 0;
     uint8_t ok = 1;
@@ -83,6 +103,46 @@ parse_cmd_sram_memtest(char *cmd, char *output, uint16_t len)
         return ECMD_FINAL( snprintf_P(output, len,
                PSTR("memtest error: see debugging output for more information")));
 }
+
+int16_t
+parse_cmd_sram_map(char *cmd, char *output, uint16_t len)
+{
+	/* use the first byte of cmd to remember the line to print */
+	if (cmd[0] != ECMD_STATE_MAGIC) {
+		cmd[0] = ECMD_STATE_MAGIC;
+		cmd[1] = 0;
+	}
+
+	uint16_t from, to;
+	const char *name;
+	switch (cmd[1]++) {
+	case 0:
+		name = PSTR("data");
+		from = (uint16_t) &__data_start;
+		to = (uint16_t) &__data_end;
+		break;
+	case 1:
+		name = PSTR("bss");
+		from = (uint16_t) &__bss_start;
+		to = (uint16_t) &__bss_end;
+		break;
+	case 2:
+		name = PSTR("heap");
+		from = (uint16_t) __malloc_heap_start;
+		to = (uint16_t) (__brkval ? __brkval : __malloc_heap_start);
+		break;
+	default:
+		name = PSTR("stack");
+		from = SP;
+		to = RAMEND;
+		return ECMD_FINAL(snprintf_P(output, len,
+					     PSTR("%-5S 0x%04x-0x%04x"),
+					     name, from, to));
+	}
+
+	return ECMD_AGAIN(snprintf_P(output, len, PSTR("%-5S 0x%04x-0x%04x"),
+				     name, from, to));
+}
 #endif
 
 /*
@@ -90,5 +150,6 @@ parse_cmd_sram_memtest(char *cmd, char *output, uint16_t len)
   header(hardware/sram/sram.h)
   init(sram_init)
   block(External SRAM support)
-  ecmd_feature(sram_memtest, "sram memtest",, Perform a memory test)
+  ecmd_feature(sram_memtest, "sram memtest",, Perform a memory test of the unused external RAM)
+  ecmd_feature(sram_map, "sram map",, Show the used address ranges of data, bss, heap and stack)
 */
@@ -22,6 +22,8 @@
 #ifndef _SRAM_H
 #define _SRAM_H
 
+#include <stdint.h>
+
 #define SRAM_START_ADDRESS (uint8_t*)0x1100
 #define SRAM_END_ADDRESS (uint8_t*)0xFFFF
 
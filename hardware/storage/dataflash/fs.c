@@ -163,27 +163,24 @@ fs_status_t fs_init(void)
     }
 
     /* allocate temporary buffer */
-    fs_node_t *node = malloc(sizeof(fs_node_t));
-
-    if (node == NULL)
-        return FS_MEM;
+    fs_node_t node;
 
     printf("fs: nodes in root:\r\n");
     for (uint8_t i = 0; i < FS_NODES_IN_ROOT; i++) {
 
-        df_flash_read(fs.chip, fs.root, node, FS_ROOTNODE_NODETABLE_OFFSET + i * sizeof(fs_node_t), sizeof(fs_node_t));
+        df_flash_read(fs.chip, fs.root, &node, FS_ROOTNODE_NODETABLE_OFFSET + i * sizeof(fs_node_t), sizeof(fs_node_t));
 
-        if (node->unused == 0) {
+        if (node.unused == 0) {
 #ifdef DEBUG_FS
             char name[7];
-            strncpy(name, node->name, FS_FILENAME);
+            strncpy(name, node.name, FS_FILENAME);
             name[FS_FILENAME] = 0;
 #endif
 
-            df_page_t page = fs_page(&fs, node->inode);
+            df_page_t page = fs_page(&fs, node.inode);
 
 	    printf(" * %s: (index %d, file %d, inode 0x%04x, page 0x%04x)\r\n",
-	    	   name, i, node->file, node->inode, page);
+	    	   name, i, node.file, node.inode, page);
 
             while (page != 0xffff) {
                 fs_mark_used(&fs, page);
@@ -203,9 +200,6 @@ fs_status_t fs_init(void)
 
     }
 
-    /* free temporarily buffer */
-    free(node);
-
 #ifdef DEBUG_FS_MARK
     printf("fs: used pages:\r\n");
     for (uint16_t i = 0; i < DF_PAGES; i++) {
@@ -227,30 +221,25 @@ fs_status_t fs_list(fs_t *fs, char *dir, char *buf, fs_index_t index)
 {
 
     /* alloc temporary buffer */
-    fs_node_t *node = malloc(sizeof(fs_node_t)+1);
-
-    if (node == NULL)
-        return FS_MEM;
+    fs_node_t node;
 
     /* read node */
     df_flash_read(fs->chip,
                   fs->root,
-                  node,
+                  &node,
                   FS_ROOTNODE_NODETABLE_OFFSET+index * sizeof(fs_node_t),
                   sizeof(fs_node_t));
 
     /* copy name, terminate string */
-    strncpy(buf, node->name, FS_FILENAME);
+    strncpy(buf, node.name, FS_FILENAME);
     buf[FS_FILENAME] = '\0';
 
-    // printf("index %d, node->unused: %d\n", index, node->unused);
+    // printf("index %d, node.unused: %d\n", index, node.unused);
 
     /* if this is the last node, return EOF */
-    if (node->unused) {
-        free(node);
+    if (node.unused) {
         return FS_EOF;
     } else {
-        free(node);
         return FS_OK;
     }
 
@@ -263,24 +252,22 @@ fs_inode_t fs_get_inode(fs_t *fs, const char *file)
     fs_index_t index = 0;
 
     /* alloc temporary buffer */
-    fs_node_t *node = malloc(sizeof(fs_node_t)+1);
+    fs_node_t node;
 
     do {
         /* read node */
         df_flash_read(fs->chip,
                       fs->root,
-                      node,
+                      &node,
                       FS_ROOTNODE_NODETABLE_OFFSET+(index++) * sizeof(fs_node_t),
                       sizeof(fs_node_t));
 
-        if (strncmp(node->name, file, FS_FILENAME) == 0) {
-            inode = node->inode;
+        if (strncmp(node.name, file, FS_FILENAME) == 0) {
+            inode = node.inode;
             break;
         }
 
-    } while (!node->unused);
-
-    free(node);
+    } while (!node.unused);
     return inode;
 
 }
@@ -717,10 +704,7 @@ fs_status_t fs_create(fs_t *fs, const char *name)
 
     /* search for a place for this filename in the table */
     fs_index_t index = 0, i = 0, max = 0;
-    fs_node_t *node = malloc(sizeof(fs_node_t));
-
-    if (node == NULL)
-        return FS_MEM;
+    fs_node_t node;
 
     while(1) {
 
@@ -729,23 +713,22 @@ fs_status_t fs_create(fs_t *fs, const char *name)
         /* read node */
         df_flash_read(fs->chip,
                 fs->root,
-                node,
+                &node,
                 FS_ROOTNODE_NODETABLE_OFFSET+i*sizeof(fs_node_t),
                 sizeof(fs_node_t));
 
-        if (node->unused) {
+        if (node.unused) {
             // printf(", last node\n");
             max = i;
             break;
         }
 
-        if (strncmp(node->name, name, FS_FILENAME) == 0) {
+        if (strncmp(node.name, name, FS_FILENAME) == 0) {
             // printf(" duplicate, EEK!\n");
-            free(node);
             return FS_DUPLICATE;
         }
 
-        if (strncmp(node->name, name, FS_FILENAME) < 0) {
+        if (strncmp(node.name, name, FS_FILENAME) < 0) {
             // printf(" strncmp() < 0)");
             index++;
         }
@@ -759,13 +742,12 @@ fs_status_t fs_create(fs_t *fs, const char *name)
     printf("new file will be placed in index %d, max is %d\n", index, max);
 
     /* now i points to the node index, construct new node */
-    strncpy(node->name, name, FS_FILENAME);
-    node->unused = 0;
-    node->file = 1;
-    node->inode = fs_new_inode(fs);
+    strncpy(node.name, name, FS_FILENAME);
+    node.unused = 0;
+    node.file = 1;
+    node.inode = fs_new_inode(fs);
 
-    if (node->inode == 0xffff) {
-        free(node);
+    if (node.inode == 0xffff) {
         return FS_BADINODE;
     }
 
@@ -776,7 +758,7 @@ fs_status_t fs_create(fs_t *fs, const char *name)
     /* write node to BUF1 */
     df_buf_write(fs->chip,
                  DF_BUF1,
-                 node,
+                 &node,
                  FS_ROOTNODE_NODETABLE_OFFSET+index*sizeof(fs_node_t),
                  sizeof(fs_node_t));
 
@@ -788,14 +770,14 @@ fs_status_t fs_create(fs_t *fs, const char *name)
         /* read node */
         df_flash_read(fs->chip,
                 fs->root,
-                node,
+                &node,
                 FS_ROOTNODE_NODETABLE_OFFSET+index*sizeof(fs_node_t),
                 sizeof(fs_node_t));
 
         /* write node to BUF1 */
         df_buf_write(fs->chip,
                      DF_BUF1,
-                     node,
+                     &node,
                      FS_ROOTNODE_NODETABLE_OFFSET+(index+1)*sizeof(fs_node_t),
                      sizeof(fs_node_t));
 
@@ -803,8 +785,6 @@ fs_status_t fs_create(fs_t *fs, const char *name)
 
     }
 
-    free(node);
-
     /* increment version and update checksum */
     return fs_increment(fs);
 
@@ -816,12 +796,7 @@ fs_status_t fs_remove(fs_t *fs, const char *name)
     /* search for this filename in the nodetable */
     fs_index_t index = 0xffff, i = 0, max = 0;
     fs_inode_t inode = 0xffff;
-    fs_node_t *node = malloc(sizeof(fs_node_t));
-
-    if (node == NULL) {
-	printf ("fs_remove: not enough memory!");
-        return FS_MEM;
-    }
+    fs_node_t node;
 
     while(1) {
 
@@ -830,18 +805,18 @@ fs_status_t fs_remove(fs_t *fs, const char *name)
         /* read node */
         df_flash_read(fs->chip,
                 fs->root,
-                node,
+                &node,
                 FS_ROOTNODE_NODETABLE_OFFSET+i*sizeof(fs_node_t),
                 sizeof(fs_node_t));
 
-        if (node->unused) {
+        if (node.unused) {
             max = i;
             break;
         }
 
-        if (strncmp(node->name, name, FS_FILENAME) == 0) {
+        if (strncmp(node.name, name, FS_FILENAME) == 0) {
             index = i;
-            inode = node->inode;
+            inode = node.inode;
         }
 
         i++;
@@ -850,7 +825,6 @@ fs_status_t fs_remove(fs_t *fs, const char *name)
 
     if (max == 0 || index > max) {
         printf("no such file\n");
-        free(node);
         return FS_NOSUCHFILE;
     }
 
@@ -868,14 +842,14 @@ fs_status_t fs_remove(fs_t *fs, const char *name)
         /* read node */
         df_flash_read(fs->chip,
                 fs->root,
-                node,
+                &node,
                 FS_ROOTNODE_NODETABLE_OFFSET+(index+1)*sizeof(fs_node_t),
                 sizeof(fs_node_t));
 
         /* write node to BUF1 */
         df_buf_write(fs->chip,
                      DF_BUF1,
-                     node,
+                     &node,
                      FS_ROOTNODE_NODETABLE_OFFSET+index*sizeof(fs_node_t),
                      sizeof(fs_node_t));
 
@@ -884,18 +858,15 @@ fs_status_t fs_remove(fs_t *fs, const char *name)
     }
 
     /* mark last node as unused */
-    node->unused = 1;
+    node.unused = 1;
 
     /* write node to BUF1 */
     df_buf_write(fs->chip,
                  DF_BUF1,
-                 node,
+                 &node,
                  FS_ROOTNODE_NODETABLE_OFFSET+(max-1)*sizeof(fs_node_t),
                  sizeof(fs_node_t));
 
-    /* cleanup */
-    free(node);
-
     /* increment version and update checksum */
     fs_status_t ret = fs_increment(fs);
 
@@ -913,11 +884,7 @@ fs_size_t fs_size(fs_t *fs, fs_inode_t inode)
     fs_size_t size = 0;
 
     /* allocate space */
-    fs_page_t *page = malloc(sizeof(fs_page_t));
-
-    /* return -1 on memory error */
-    if (page == NULL)
-        return -1;
+    fs_page_t page;
 
     while(1) {
 
@@ -932,25 +899,23 @@ fs_size_t fs_size(fs_t *fs, fs_inode_t inode)
         }
 
         /* else load page */
-        df_flash_read(fs->chip, pagenum, page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
+        df_flash_read(fs->chip, pagenum, &page, FS_STRUCTURE_OFFSET, sizeof(fs_page_t));
 
         /* append size */
-        size += page->size;
+        size += page.size;
 
-        printf("fs: size in inode 0x%04x is 0x%04x\r\n", inode, page->size);
+        printf("fs: size in inode 0x%04x is 0x%04x\r\n", inode, page.size);
 
         /* if this is the last page, we are done */
-        if (page->eof) {
+        if (page.eof) {
             printf("fs: last inode in this file, returning\r\n");
             break;
         }
 
         /* else extract next inode */
-        inode = page->next_inode;
+        inode = page.next_inode;
     }
 
-    free(page);
-
     return size;
 
 }
@@ -965,15 +930,12 @@ fs_status_t fs_scan(fs_t *fs)
     fs->version = 0;
 
     /* alloc temporary buffer */
-    fs_root_t *page = malloc(sizeof(fs_root_t));
-
-    if (page == NULL)
-        return FS_MEM;
+    fs_root_t page;
 
     for (df_page_t p = 0; p < DF_PAGES; p++) {
-        df_flash_read(fs->chip, p, page, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
+        df_flash_read(fs->chip, p, &page, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
 
-        if (page->page.unused == 0 && page->page.root == 1) {
+        if (page.page.unused == 0 && page.page.root == 1) {
             printf("fs: found root node in page 0x%04x\r\n", p);
 
             /* compute crc */
@@ -988,9 +950,9 @@ fs_status_t fs_scan(fs_t *fs)
             if (crc == crc2) {
                 printf("fs: valid crc\r\n");
 
-                if (page->version > fs->version) {
+                if (page.version > fs->version) {
                     printf("fs: found newer version!\r\n");
-                    fs->version = page->version;
+                    fs->version = page.version;
                     fs->root = p;
                 }
             }
@@ -1003,9 +965,6 @@ fs_status_t fs_scan(fs_t *fs)
         }
     }
 
-    /* free temporary buffer */
-    free(page);
-
     if (fs->version >= FS_INITIAL_VERSION) {
         printf("fs: root node has been found, page 0x%04x, version 0x%04x\r\n",
 	       fs->root, fs->version);
@@ -1027,34 +986,25 @@ fs_status_t fs_format(fs_t *fs)
         fs->version = FS_INITIAL_VERSION;
 
     /* allocate temporary buffer */
-    fs_root_t *root = malloc(sizeof(fs_root_t));
-
-    if (root == NULL)
-        return FS_MEM;
+    fs_root_t root;
 
     /* fill buffer with empty root node */
-    root->page.root = 1;
-    root->page.eof = 1;
-    root->page.unused = 0;
-    root->version = fs->version;
+    root.page.root = 1;
+    root.page.eof = 1;
+    root.page.unused = 0;
+    root.version = fs->version;
 
     /* initialize and erase future inode tables */
-    fs_page_t *inode_page = malloc(sizeof(fs_page_t));
-
-    if (inode_page == NULL)
-    {
-        free(root);
-        return  FS_MEM;
-    }
+    fs_page_t inode_page;
 
     /* create empty page */
-    inode_page->root = 0;
-    inode_page->eof = 1;
-    inode_page->unused = 0;
-    inode_page->next_inode = 0x0fff;
+    inode_page.root = 0;
+    inode_page.eof = 1;
+    inode_page.unused = 0;
+    inode_page.next_inode = 0x0fff;
 
     /* set structure information */
-    df_buf_write(fs->chip, DF_BUF1, inode_page, 0, sizeof(fs_page_t));
+    df_buf_write(fs->chip, DF_BUF1, &inode_page, 0, sizeof(fs_page_t));
 
     /* fill with 0xff */
     uint8_t b = 0xff;
@@ -1063,31 +1013,25 @@ fs_status_t fs_format(fs_t *fs)
 
     /* write pages */
     for (uint8_t i = 0; i < 16; i++) {
-        root->inodetable[i] = i+1;
+        root.inodetable[i] = i+1;
         df_buf_save(fs->chip, DF_BUF1, i+1);
         df_wait(fs->chip);
     }
 
     /* write root node to buffer */
-    df_buf_write(fs->chip, DF_BUF1, root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
-
-    /* free temporary buffer */
-    free(root);
+    df_buf_write(fs->chip, DF_BUF1, &root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
 
     /* allocate temporary buffer */
-    fs_node_t *node = malloc(sizeof(fs_node_t));
-
-    if (node == NULL)
-        return FS_MEM;
+    fs_node_t node;
 
     /* write empty node entries */
-    node->unused = 1;
-    node->inode = 0;
-    node->file = 0;
-    node->reserved = 0;
-    node->name[0] = 0;
+    node.unused = 1;
+    node.inode = 0;
+    node.file = 0;
+    node.reserved = 0;
+    node.name[0] = 0;
     for (uint8_t i = 0; i < FS_NODES_IN_ROOT; i++) {
-        df_buf_write(fs->chip, DF_BUF1, node,
+        df_buf_write(fs->chip, DF_BUF1, &node,
                 FS_ROOTNODE_NODETABLE_OFFSET+i*sizeof(fs_node_t),
                 sizeof(fs_node_t));
     }
@@ -1108,9 +1052,6 @@ fs_status_t fs_format(fs_t *fs)
     /* set global pointers */
     fs->root = 0;
 
-    /* free temporary buffer */
-    free(node);
-
     return FS_OK;
 
 }
@@ -1259,17 +1200,17 @@ uint8_t fs_crc(fs_t *fs, uint8_t crc, df_buf_t buf, df_size_t offset, df_size_t
 fs_status_t fs_increment(fs_t *fs)
 {
 
-    fs_root_t *root = malloc(sizeof(fs_root_t));
+    fs_root_t root;
 
     /* read root structure */
-    df_buf_read(fs->chip, DF_BUF1, root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
+    df_buf_read(fs->chip, DF_BUF1, &root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
 
     /* update version */
     fs->version++;
-    root->version = fs->version;
+    root.version = fs->version;
 
     /* write root node to buffer */
-    df_buf_write(fs->chip, DF_BUF1, root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
+    df_buf_write(fs->chip, DF_BUF1, &root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
 
     /* calculate crc */
     uint8_t crc = 0;
@@ -1283,7 +1224,6 @@ fs_status_t fs_increment(fs_t *fs)
     df_page_t page = fs_new_page(fs);
 
     if (page == 0xffff) {
-        free(root);
         return FS_BADPAGE;
     }
 
@@ -1292,8 +1232,6 @@ fs_status_t fs_increment(fs_t *fs)
     df_wait(fs->chip);
 
     fs->root = page;
-
-    free(root);
     return FS_OK;
 
 }
@@ -1311,16 +1249,13 @@ fs_status_t fs_update_inodetable(fs_t *fs, fs_inode_t inode, df_page_t page)
 
     // printf("new inodetable will live in page %d\n", new_page);
 
-    fs_inodetable_node_t *node = malloc(sizeof(fs_inodetable_node_t));
-
-    if (node == NULL)
-        return FS_MEM;
+    fs_inodetable_node_t node;
 
     if (page == 0xffff)
-        node->unused = 1;
+        node.unused = 1;
     else {
-        node->unused = 0;
-        node->page = page;
+        node.unused = 0;
+        node.page = page;
     }
 
     // printf("inodetable %d lives in page %d, writing new inodetable to page %d\n", inode / FS_INODES_PER_TABLE, fs_inodetable(fs, inode / FS_INODES_PER_TABLE), new_page);
@@ -1332,14 +1267,12 @@ fs_status_t fs_update_inodetable(fs_t *fs, fs_inode_t inode, df_page_t page)
     df_wait(fs->chip);
     df_buf_write(fs->chip,
                  DF_BUF1,
-                 node,
+                 &node,
                  FS_DATA_OFFSET + (inode % FS_INODES_PER_TABLE) * sizeof(fs_inodetable_node_t),
                  sizeof(fs_inodetable_node_t));
     df_buf_save(fs->chip, DF_BUF1, new_page);
     df_wait(fs->chip);
 
-    free(node);
-
     /* load root node into BUF1 */
     df_buf_load(fs->chip, DF_BUF1, fs->root);
     df_wait(fs->chip);
@@ -1363,58 +1296,49 @@ fs_inspect_node(fs_t *fs, uint16_t p)
 {
     printf ("root page is 0x%04x\n", fs->root);
 
-    fs_root_t *root = malloc(sizeof(fs_root_t));
+    fs_root_t root;
 
-    df_flash_read(fs->chip, p, root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
+    df_flash_read(fs->chip, p, &root, FS_STRUCTURE_OFFSET, sizeof(fs_root_t));
 
     printf ("Properties of page 0x%04x:\n", p);
-    if (root->page.unused)
+    if (root.page.unused)
 	printf ("\t* unused\n");
-    if (root->page.root)
+    if (root.page.root)
         printf ("\t* root\n");
-    if (root->page.eof)
+    if (root.page.eof)
         printf ("\t* eof\n");
 
-    printf ("\tnext_inode: 0x%04x, size: 0x%04x\n", root->page.next_inode,
-	    root->page.size);
+    printf ("\tnext_inode: 0x%04x, size: 0x%04x\n", root.page.next_inode,
+	    root.page.size);
 
-    if (root->page.root) {
+    if (root.page.root) {
 	printf ("\tThis is a root node (version 0x%02x), inodetable:\n",
-		root->version);
+		root.version);
 
         for (uint8_t i = 0; i < FS_ROOTNODE_INODETABLE_SIZE; i++) {
 
             uint16_t page = fs_inodetable(fs, i);
 	    printf ("\t\t* 0x%02x -> 0x%04x, func: 0x%04x\n", i,
-		    root->inodetable[i], page);
+		    root.inodetable[i], page);
         }
 
         printf ("\troot entries:\n");
         for (uint8_t i = 0; i < FS_NODES_IN_ROOT; i++) {
 
-            fs_node_t *node = malloc(sizeof(fs_node_t));
+            fs_node_t node;
 
-            if (node == NULL) {
-                printf ("\t\tNULL!\n");
-                break;
-            }
+            df_flash_read(fs->chip, fs->root, &node, FS_ROOTNODE_NODETABLE_OFFSET + i * sizeof(fs_node_t), sizeof(fs_node_t));
 
-            df_flash_read(fs->chip, fs->root, node, FS_ROOTNODE_NODETABLE_OFFSET + i * sizeof(fs_node_t), sizeof(fs_node_t));
-
-            if (!node->unused) {
+            if (!node.unused) {
                 char name[FS_FILENAME+1];
 
-                strncpy(name, node->name, FS_FILENAME);
+                strncpy(name, node.name, FS_FILENAME);
                 name[FS_FILENAME] = '\0';
 
 		printf ("\t\t* 0x%02x: %s\n", i, name);
             }
-
-	    free (node);
         }
     }
-
-    free(root);
 }
 
 
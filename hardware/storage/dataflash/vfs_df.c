@@ -31,7 +31,7 @@ vfs_df_open (const char *filename)
   if (i == 0xffff)
     return NULL;		/* No such file. */
 
-  struct vfs_file_handle_t *fh = malloc (sizeof (struct vfs_file_handle_t));
+  struct vfs_file_handle_t *fh = vfs_handle_alloc();
   if (fh == NULL)
     return NULL;
 
@@ -45,7 +45,7 @@ vfs_df_open (const char *filename)
 void
 vfs_df_close (struct vfs_file_handle_t *fh)
 {
-  free (fh);
+  vfs_handle_free (fh);
 }
 
 vfs_size_t
@@ -141,3 +141,12 @@ vfs_df_size (struct vfs_file_handle_t *fh)
 {
   return fs_size (&fs, fh->u.df.inode);
 }
+
+
+uint8_t
+vfs_df_etag (struct vfs_file_handle_t *fh, uint32_t *etag)
+{
+  /* the filesystem version is incremented on every change */
+  *etag = fs.version ^ ((uint32_t) fh->u.df.inode << 20);
+  return VFS_ETAG_STRONG;
+}
@@ -44,6 +44,7 @@ uint8_t vfs_df_truncate (struct vfs_file_handle_t *, vfs_size_t length);
 struct vfs_file_handle_t *vfs_df_create (const char *name);
 uint8_t vfs_df_unlink (const char *name);
 vfs_size_t vfs_df_size (struct vfs_file_handle_t *);
+uint8_t vfs_df_etag (struct vfs_file_handle_t *, uint32_t *etag);
 
 
 #define VFS_DF_FUNCS {				\
@@ -28,11 +28,107 @@
 #include "hardware/storage/sd_reader/sd_raw.h"
 #include "hardware/storage/sd_reader/partition.h"
 #include "core/vfs/vfs.h"
+#include "core/vfs/vfs-util.h"
 #include "core/debug.h"
 
 static struct fat_fs_struct *vfs_sd_fat;
 struct fat_dir_struct *vfs_sd_rootnode;
 
+#if SD_DCACHE_ENTRIES > 0
+/* Directory entries of recently opened files, keyed by the hash of their
+ * full path, most recently used first.  The long name is not kept, it is
+ * restored from the path on a hit. */
+static struct
+{
+  uint32_t hash;
+  uint8_t len;                  /* path length, 0 marks an unused slot */
+  uint8_t attributes;
+  cluster_t cluster;
+  uint32_t file_size;
+  offset_t entry_offset;
+} vfs_sd_dcache[SD_DCACHE_ENTRIES];
+
+static void
+vfs_sd_dcache_flush(void)
+{
+  memset(vfs_sd_dcache, 0, sizeof(vfs_sd_dcache));
+}
+
+/* Move slot I to the front, i.e. mark it most recently used. */
+static void
+vfs_sd_dcache_touch(uint8_t i)
+{
+  if (i == 0)
+    return;
+
+  __typeof__(vfs_sd_dcache[0]) e = vfs_sd_dcache[i];
+  memmove(&vfs_sd_dcache[1], &vfs_sd_dcache[0], i * sizeof(e));
+  vfs_sd_dcache[0] = e;
+}
+
+static int8_t
+vfs_sd_dcache_find(uint32_t hash, uint8_t len)
+{
+  for (uint8_t i = 0; i < SD_DCACHE_ENTRIES; i++)
+    if (vfs_sd_dcache[i].len == len && vfs_sd_dcache[i].hash == hash)
+      return i;
+
+  return -1;
+}
+
+static uint8_t
+vfs_sd_dcache_lookup(const char *path, const char *basename,
+                     struct fat_dir_entry_struct *entry)
+{
+  uint8_t len;
+  int8_t i = vfs_sd_dcache_find(vfs_name_hash(path, &len), len);
+  if (i < 0)
+    return 0;
+
+  vfs_sd_dcache_touch(i);
+  strncpy(entry->long_name, basename, sizeof(entry->long_name) - 1);
+  entry->long_name[sizeof(entry->long_name) - 1] = 0;
+  entry->attributes = vfs_sd_dcache[0].attributes;
+  entry->cluster = vfs_sd_dcache[0].cluster;
+  entry->file_size = vfs_sd_dcache[0].file_size;
+  entry->entry_offset = vfs_sd_dcache[0].entry_offset;
+  SDDEBUGVFS("dcache hit for '%s'\n", path);
+  return 1;
+}
+
+static void
+vfs_sd_dcache_insert(const char *path,
+                     const struct fat_dir_entry_struct *entry)
+{
+  /* evict the least recently used slot */
+  vfs_sd_dcache_touch(SD_DCACHE_ENTRIES - 1);
+  vfs_sd_dcache[0].hash = vfs_name_hash(path, &vfs_sd_dcache[0].len);
+  vfs_sd_dcache[0].attributes = entry->attributes;
+  vfs_sd_dcache[0].cluster = entry->cluster;
+  vfs_sd_dcache[0].file_size = entry->file_size;
+  vfs_sd_dcache[0].entry_offset = entry->entry_offset;
+}
+
+static void
+vfs_sd_dcache_forget(const char *path)
+{
+  uint8_t len;
+  int8_t i = vfs_sd_dcache_find(vfs_name_hash(path, &len), len);
+  if (i >= 0)
+    vfs_sd_dcache[i].len = 0;
+}
+
+/* Forget the entry of an open file whose size or first cluster may have
+ * changed. */
+static void
+vfs_sd_dcache_forget_entry(const struct fat_dir_entry_struct *entry)
+{
+  for (uint8_t i = 0; i < SD_DCACHE_ENTRIES; i++)
+    if (vfs_sd_dcache[i].entry_offset == entry->entry_offset)
+      vfs_sd_dcache[i].len = 0;
+}
+#endif /* SD_DCACHE_ENTRIES > 0 */
+
 struct fat_dir_struct *
 vfs_sd_chdir(const char *dirname)
 {
@@ -40,7 +136,10 @@ vfs_sd_chdir(const char *dirname)
   if (fat_get_dir_entry_of_path(vfs_sd_fat, dirname, &handle) == 0)
     return NULL;
 
-  return fat_open_dir(vfs_sd_fat, &handle);
+  struct fat_dir_struct *dir = fat_open_dir(vfs_sd_fat, &handle);
+  if (dir == NULL)
+    vfs_open_failed = 1;        /* out of directory handles */
+  return dir;
 }
 
 uint8_t
@@ -61,6 +160,13 @@ vfs_sd_try_open_rootnode(void)
   }
 
   SDDEBUGVFS("card initialized and root node opened\n");
+#if SD_DCACHE_ENTRIES > 0
+  vfs_sd_dcache_flush();
+#endif
+#if VFS_LOOKUP_CACHE > 0
+  /* another card may have been inserted */
+  vfs_lookup_cache_flush();
+#endif
   return 0;                     /* Jippie, we're set. */
 }
 
@@ -78,7 +184,10 @@ vfs_sd_traverse(const char *path, const char **basename)
   {
     char *dirname = strdup(path);
     if (dirname == NULL)
+    {
+      vfs_open_failed = 1;
       return NULL;
+    }
     dirname[sep - path] = 0;
     parent = vfs_sd_chdir(dirname);
     free(dirname);
@@ -88,42 +197,55 @@ vfs_sd_traverse(const char *path, const char **basename)
   return parent;
 }
 
-#if SD_WRITE_SUPPORT == 1
 static struct vfs_file_handle_t *
-vfs_sd_open_in(struct fat_dir_struct *parent, const char *filename)
+vfs_sd_open_entry(const struct fat_dir_entry_struct *entry)
 {
-  fat_reset_dir(parent);
+  if (entry->attributes & FAT_ATTRIB_DIR)
+    return NULL;                /* Is a directory. */
 
-  struct fat_dir_entry_struct filep;
-  while (fat_read_dir(parent, &filep))
+  struct fat_file_struct *inode = fat_open_file(vfs_sd_fat, entry);
+  if (inode == NULL)
   {
-    if (strcmp(filep.long_name, filename))
-      continue;
+    vfs_open_failed = 1;        /* out of file handles */
+    return NULL;
+  }
 
-    if (filep.attributes & FAT_ATTRIB_DIR)
-      return NULL;              /* Is a directory. */
+  struct vfs_file_handle_t *fh = vfs_handle_alloc();
+  if (fh == NULL)
+  {
+    fat_close_file(inode);
+    return NULL;
+  }
 
-    /* Got it :) */
-    struct fat_file_struct *inode = fat_open_file(vfs_sd_fat, &filep);
-    struct vfs_file_handle_t *fh = malloc(sizeof(struct vfs_file_handle_t));
-    if (fh == NULL)
-      return NULL;
+  fh->fh_type = VFS_SD;
+  fh->u.sd = inode;
 
-    fh->fh_type = VFS_SD;
-    fh->u.sd = inode;
+  return fh;
+}
 
-    return fh;
+static uint8_t
+vfs_sd_find_in(struct fat_dir_struct *parent, const char *filename,
+               struct fat_dir_entry_struct *entry)
+{
+  fat_reset_dir(parent);
+
+  while (fat_read_dir(parent, entry))
+  {
+    if (strcmp(entry->long_name, filename) == 0)
+    {
+      fat_reset_dir(parent);
+      return 1;                 /* Got it :) */
+    }
   }
 
-  return NULL;                  /* No such file. */
+  return 0;                     /* No such file. */
 }
-#endif
 
 void
 vfs_sd_close(struct vfs_file_handle_t *fh)
 {
   fat_close_file(fh->u.sd);
-  free(fh);
+  vfs_handle_free(fh);
 }
 
 vfs_size_t
@@ -136,6 +258,9 @@ vfs_sd_read(struct vfs_file_handle_t *fh, void *buf, vfs_size_t length)
 vfs_size_t
 vfs_sd_write(struct vfs_file_handle_t * fh, void *buf, vfs_size_t length)
 {
+#if SD_DCACHE_ENTRIES > 0
+  vfs_sd_dcache_forget_entry(&fh->u.sd->dir_entry);
+#endif
   return fat_write_file(fh->u.sd, buf, length);
 }
 #endif
@@ -150,6 +275,9 @@ vfs_sd_fseek(struct vfs_file_handle_t * fh, vfs_size_t offset, uint8_t whence)
 uint8_t
 vfs_sd_truncate(struct vfs_file_handle_t * fh, vfs_size_t length)
 {
+#if SD_DCACHE_ENTRIES > 0
+  vfs_sd_dcache_forget_entry(&fh->u.sd->dir_entry);
+#endif
   return fat_resize_file(fh->u.sd, length) == 0;
 }
 #endif
@@ -157,20 +285,41 @@ vfs_sd_truncate(struct vfs_file_handle_t * fh, vfs_size_t length)
 static struct vfs_file_handle_t *
 vfs_sd_create_open(const char *name, uint8_t create)
 {
+  struct fat_dir_entry_struct entry;
+  struct vfs_file_handle_t *fh = NULL;
   const char *basename;
+
+  while (*name == '/')
+    name++;
+
+#if SD_DCACHE_ENTRIES > 0
+  if (create)
+    vfs_sd_dcache_forget(name);
+  else
+  {
+    const char *sep = strrchr(name, '/');
+    if (vfs_sd_dcache_lookup(name, sep ? sep + 1 : name, &entry))
+      return vfs_sd_open_entry(&entry);
+  }
+#endif
+
   struct fat_dir_struct *parent = vfs_sd_traverse(name, &basename);
   if (!parent)
     return NULL;
 
 #if SD_WRITE_SUPPORT == 1
   if (create)
-  {
-    struct fat_dir_entry_struct file_entry;
-    fat_create_file(parent, basename, &file_entry);
-  }
+    fat_create_file(parent, basename, &entry);
 #endif
 
-  struct vfs_file_handle_t *fh = vfs_sd_open_in(parent, basename);
+  if (vfs_sd_find_in(parent, basename, &entry))
+  {
+    fh = vfs_sd_open_entry(&entry);
+#if SD_DCACHE_ENTRIES > 0
+    if (fh && !create)
+      vfs_sd_dcache_insert(name, &entry);
+#endif
+  }
 
 #if SD_WRITE_SUPPORT == 1
   if (create && fh && vfs_sd_size(fh) != 0)
@@ -274,22 +423,27 @@ uint8_t
 vfs_sd_unlink(const char *name)
 {
   const char *basename;
+  uint8_t ret = 1;
+
+  while (*name == '/')
+    name++;
+
+#if SD_DCACHE_ENTRIES > 0
+  vfs_sd_dcache_forget(name);
+#endif
 
   struct fat_dir_struct *dd = vfs_sd_traverse(name, &basename);
   if (dd)
   {
     struct fat_dir_entry_struct file_entry;
-    while (fat_read_dir(dd, &file_entry))
-    {
-      if (strcmp(file_entry.long_name, basename) == 0)
-      {
-        fat_reset_dir(dd);
-        return fat_delete_file(vfs_sd_fat, &file_entry) == 0;
-      }
-    }
+    if (vfs_sd_find_in(dd, basename, &file_entry))
+      ret = fat_delete_file(vfs_sd_fat, &file_entry) == 0;
+
+    if (dd != vfs_sd_rootnode)
+      fat_close_dir(dd);
   }
 
-  return 1;
+  return ret;
 }
 #endif
 
@@ -299,6 +453,18 @@ vfs_sd_size(struct vfs_file_handle_t * fh)
   return fh->u.sd->dir_entry.file_size;
 }
 
+#if FAT_DATETIME_SUPPORT
+uint8_t
+vfs_sd_etag(struct vfs_file_handle_t * fh, uint32_t * etag)
+{
+  const struct fat_dir_entry_struct *e = &fh->u.sd->dir_entry;
+  /* date, time, size and cluster folded into 32 bits may collide */
+  *etag = (((uint32_t) e->modification_date << 16) |
+           e->modification_time) ^ e->file_size ^ e->cluster;
+  return VFS_ETAG_WEAK;
+}
+#endif
+
 #ifdef SD_PING_READ
 static uint8_t
 vfs_sd_ping(void)
@@ -322,6 +488,9 @@ vfs_sd_ping(void)
 static void
 vfs_sd_umount(void)
 {
+#if SD_DCACHE_ENTRIES > 0
+  vfs_sd_dcache_flush();
+#endif
   if (vfs_sd_rootnode)
   {
     fat_close_dir(vfs_sd_rootnode);
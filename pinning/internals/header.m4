@@ -281,6 +281,7 @@ define(`STELLA_USE_TIMER', `dnl
 #define STELLA_TC_VECTOR_COMPARE    format(TC%s_VECTOR_COMPARE, $1)
 #define STELLA_TC_VECTOR_OVERFLOW   format(TC%s_VECTOR_OVERFLOW, $1)
 #define STELLA_TC_COMPARE_REG       format(TC%s_COUNTER_COMPARE, $1)
+#define STELLA_TC_COUNTER_REG       format(TC%s_COUNTER_CURRENT, $1)
 ')
 
 
@@ -49,8 +49,6 @@
  */
 
 uint8_t artnet_subNet = SUBNET_DEFAULT;
-uint8_t artnet_outputUniverse;
-uint8_t artnet_inputUniverse;
 uint8_t artnet_sendPollReplyOnChange = TRUE;
 uip_ipaddr_t artnet_pollReplyTarget;
 uint32_t artnet_pollReplyCounter = 0;
@@ -65,10 +63,28 @@ volatile uint16_t artnet_dmxChannels = 0;
 volatile uint8_t artnet_dmxTransmitting = FALSE;
 volatile uint8_t artnet_dmxInChanged = FALSE;
 volatile uint8_t artnet_dmxInComplete = FALSE;
-int8_t artnet_conn_id = 0;
-uint8_t artnet_connected = 0;
 uint8_t artnet_dmxDirection = 0;
 
+/* input universes: dmx-storage -> Art-Net */
+int8_t artnet_conn_id[CONF_ARTNET_INUNIVERSES];
+uint8_t artnet_sequence[CONF_ARTNET_INUNIVERSES];
+/* ticks since the last ArtDmx of an input universe has been sent */
+uint8_t artnet_inTicks[CONF_ARTNET_INUNIVERSES];
+
+/* received and sent ArtDmx frames, for throughput measurements */
+uint32_t artnet_rxFrames = 0;
+uint32_t artnet_txFrames = 0;
+
+#ifdef ARTNET_SYNC_SUPPORT
+/* In synchronous mode ArtDmx data is held back here until an ArtSync
+ * arrives, so all output universes latch at the same time. */
+uint8_t artnet_syncBuffer[CONF_ARTNET_OUTUNIVERSES][DMX_STORAGE_CHANNELS];
+uint16_t artnet_syncLength[CONF_ARTNET_OUTUNIVERSES];
+uint8_t artnet_syncPending = 0;
+/* ticks left until we fall back to non-synchronous mode, 0 = not synced */
+uint8_t artnet_syncTicks = 0;
+#endif
+
 const char artnet_ID[8] PROGMEM = "Art-Net";
 
 /* ----------------------------------------------------------------------------
@@ -95,25 +111,22 @@ artnet_init(void)
 
   /* read subnet */
   artnet_subNet = SUBNET_DEFAULT;
-  artnet_inputUniverse = CONF_ARTNET_INUNIVERSE;
-  artnet_outputUniverse = CONF_ARTNET_OUTUNIVERSE;
   strcpy_P(artnet_shortName, PSTR("e6ArtNode"));
   strcpy_P(artnet_longName, PSTR("e6ArtNode hostname: " CONF_HOSTNAME));
 
   uip_ipaddr_copy(artnet_pollReplyTarget,all_ones_addr);
   
   /* dmx storage connection */
-  artnet_conn_id = dmx_storage_connect(artnet_inputUniverse);
-  if (artnet_conn_id != -1)
-  {
-    artnet_connected = TRUE;
-    ARTNET_DEBUG("Connection to dmx-storage established! id:%d\r\n",
-                 artnet_conn_id);
-  }
-  else
+  for (uint8_t i = 0; i < CONF_ARTNET_INUNIVERSES; i++)
   {
-    artnet_connected = FALSE;
-    ARTNET_DEBUG("Connection to dmx-storage couldn't be established!\r\n");
+    artnet_conn_id[i] = dmx_storage_connect(CONF_ARTNET_INUNIVERSE + i);
+    artnet_sequence[i] = 1;
+    artnet_inTicks[i] = 0;
+    if (artnet_conn_id[i] != -1)
+      ARTNET_DEBUG("Connection to dmx-storage established! universe:%d "
+                   "id:%d\r\n", CONF_ARTNET_INUNIVERSE + i, artnet_conn_id[i]);
+    else
+      ARTNET_DEBUG("Connection to dmx-storage couldn't be established!\r\n");
   }
 
   /* net_init */
@@ -180,24 +193,27 @@ artnet_sendPollReply(void)
           (unsigned int) artnet_pollReplyCounter);
 
   msg->numPortsH = 0;
-  msg->numPorts = 1;
-
-  if (artnet_dmxDirection == 1)
-    msg->portTypes[0] = PORT_TYPE_DMX_INPUT;
-  else
-    msg->portTypes[0] = PORT_TYPE_DMX_OUTPUT;
+  msg->numPorts = ARTNET_NUM_PORTS;
 
-  if (artnet_dmxDirection != 1)
-    msg->goodInput[0] = (1 << 3);
-  else if (artnet_dmxChannels > 0)
-    msg->goodInput[0] |= (1 << 7);
-
-  msg->goodOutput[0] = (1 << 1);
-  if (artnet_dmxTransmitting == TRUE)
-    msg->goodOutput[0] |= (1 << 7);
-
-  msg->swin[0] = (artnet_subNet & 15) * 16 | (artnet_inputUniverse & 15);
-  msg->swout[0] = (artnet_subNet & 15) * 16 | (artnet_outputUniverse & 15);
+  for (uint8_t i = 0; i < ARTNET_NUM_PORTS; i++)
+  {
+    if (i < CONF_ARTNET_INUNIVERSES)
+    {
+      msg->portTypes[i] |= PORT_TYPE_DMX_INPUT;
+      msg->goodInput[i] = (1 << 7);
+      msg->swin[i] = (artnet_subNet & 15) * 16 |
+        ((CONF_ARTNET_INUNIVERSE + i) & 15);
+    }
+    if (i < CONF_ARTNET_OUTUNIVERSES)
+    {
+      msg->portTypes[i] |= PORT_TYPE_DMX_OUTPUT;
+      msg->goodOutput[i] = (1 << 1);
+      if (artnet_dmxTransmitting == TRUE)
+        msg->goodOutput[i] |= (1 << 7);
+      msg->swout[i] = (artnet_subNet & 15) * 16 |
+        ((CONF_ARTNET_OUTUNIVERSE + i) & 15);
+    }
+  }
   msg->style = STYLE_NODE;
 
   memcpy(msg->mac, uip_ethaddr.addr, 6);
@@ -207,12 +223,12 @@ artnet_sendPollReply(void)
 }
 
 /* ----------------------------------------------------------------------------
- * send an ArtDmx packet
+ * send an ArtDmx packet of input universe number 'port'
  */
 void
-artnet_sendDmxPacket(void)
+artnet_sendDmxPacket(uint8_t port)
 {
-  static unsigned char sequence = 1;
+  uint8_t universe = CONF_ARTNET_INUNIVERSE + port;
   /* prepare artnet Dmx packet */
   struct artnet_dmx *msg =
     (struct artnet_dmx *) &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
@@ -225,16 +241,19 @@ artnet_sendDmxPacket(void)
   msg->versionH = 0;
   msg->version = PROTOCOL_VERSION;
 
-  msg->sequence = sequence++;
-  if (sequence == 0)
-    sequence = 1;
+  msg->sequence = artnet_sequence[port]++;
+  if (artnet_sequence[port] == 0)
+    artnet_sequence[port] = 1;
 
-  msg->physical = 1;
-  msg->universe = ((artnet_subNet << 4) | artnet_inputUniverse);
+  msg->physical = port;
+  msg->universe = ((artnet_subNet << 4) | universe);
   msg->lengthHi = HI8(DMX_STORAGE_CHANNELS);
   msg->length = LO8(DMX_STORAGE_CHANNELS);
-  for (uint8_t i = 0; i < DMX_STORAGE_CHANNELS; i++)
-	msg->dataStart[i] = get_dmx_channel_slot(artnet_inputUniverse, i, artnet_conn_id);
+  for (uint16_t i = 0; i < DMX_STORAGE_CHANNELS; i++)
+    msg->dataStart[i] =
+      get_dmx_channel_slot(universe, i, artnet_conn_id[port]);
+  artnet_inTicks[port] = 0;
+  artnet_txFrames++;
   /* broadcast the packet */
   artnet_send(sizeof(struct artnet_dmx) + DMX_STORAGE_CHANNELS);
 }
@@ -246,6 +265,13 @@ parse_cmd_artnet_pollreply(int8_t * cmd, int8_t * output, uint16_t len)
   return ECMD_FINAL_OK;
 }
 
+int16_t
+parse_cmd_artnet_stats(int8_t * cmd, int8_t * output, uint16_t len)
+{
+  return ECMD_FINAL(snprintf_P((char *) output, len, PSTR("rx %lu tx %lu"),
+                               artnet_rxFrames, artnet_txFrames));
+}
+
 void
 processPollPacket(struct artnet_poll *poll)
 {
@@ -261,20 +287,108 @@ processPollPacket(struct artnet_poll *poll)
   
   /* we send a dmx packet on a poll packet, if artnet_sendPollReplyOnChange is active */
   if (artnet_sendPollReplyOnChange)
-	  artnet_sendDmxPacket();
+    for (uint8_t i = 0; i < CONF_ARTNET_INUNIVERSES; i++)
+      if (artnet_conn_id[i] != -1)
+        artnet_sendDmxPacket(i);
 }
 
+static void
+processDmxPacket(struct artnet_dmx *dmx)
+{
+  if ((dmx->universe >> 4) != artnet_subNet || artnet_dmxDirection != 0)
+    return;
+
+  uint8_t port = (dmx->universe & 15) - CONF_ARTNET_OUTUNIVERSE;
+  if (port >= CONF_ARTNET_OUTUNIVERSES)
+    return;
+
+  uint16_t len = ((dmx->lengthHi << 8) + dmx->length);
+  if (uip_datalen() < sizeof(struct artnet_dmx))
+    return;
+  if (len > uip_datalen() - sizeof(struct artnet_dmx))
+    len = uip_datalen() - sizeof(struct artnet_dmx);
+
+  artnet_rxFrames++;
+
+#ifdef ARTNET_SYNC_SUPPORT
+  if (artnet_syncTicks)
+  {
+    /* synchronous mode, latch on the next ArtSync */
+    if (len > DMX_STORAGE_CHANNELS)
+      len = DMX_STORAGE_CHANNELS;
+    memcpy(artnet_syncBuffer[port], dmx->dataStart, len);
+    artnet_syncLength[port] = len;
+    artnet_syncPending |= _BV(port);
+    return;
+  }
+#endif
+
+  /* write straight from the packet buffer into dmx-storage */
+  set_dmx_channels(dmx->dataStart, CONF_ARTNET_OUTUNIVERSE + port, len);
+
+  /* starting to output data is a change of the node's condition */
+  if (artnet_dmxTransmitting == FALSE)
+  {
+    artnet_dmxTransmitting = TRUE;
+    if (artnet_sendPollReplyOnChange == TRUE)
+    {
+      artnet_pollReplyCounter++;
+      artnet_sendPollReply();
+    }
+  }
+}
+
+#ifdef ARTNET_SYNC_SUPPORT
+static void
+processSyncPacket(void)
+{
+  artnet_syncTicks = ARTNET_SYNC_TIMEOUT;
+  for (uint8_t i = 0; i < CONF_ARTNET_OUTUNIVERSES; i++)
+    if (artnet_syncPending & _BV(i))
+      set_dmx_channels(artnet_syncBuffer[i], CONF_ARTNET_OUTUNIVERSE + i,
+                       artnet_syncLength[i]);
+  artnet_syncPending = 0;
+}
+#endif
+
 void
 artnet_main(void)
 {
-  if (get_dmx_slot_state(artnet_inputUniverse, artnet_conn_id) ==
-      DMX_NEWVALUES && artnet_connected == TRUE)
+  for (uint8_t i = 0; i < CONF_ARTNET_INUNIVERSES; i++)
   {
-    ARTNET_DEBUG("Universe has changed, sending artnet data!\r\n");
-    artnet_sendDmxPacket();
+    if (artnet_conn_id[i] == -1)
+      continue;
+    /* send on change, but at most once per tick, and refresh the
+     * universe every 4 seconds even if nothing has changed */
+    if ((artnet_inTicks[i] > 0 &&
+         get_dmx_slot_state(CONF_ARTNET_INUNIVERSE + i, artnet_conn_id[i]) ==
+         DMX_NEWVALUES) || artnet_inTicks[i] >= ARTNET_KEEPALIVE_TICKS)
+    {
+      ARTNET_DEBUG("Universe %d has changed, sending artnet data!\r\n",
+                   CONF_ARTNET_INUNIVERSE + i);
+      artnet_sendDmxPacket(i);
+    }
   }
 }
 
+void
+artnet_periodic(void)
+{
+  for (uint8_t i = 0; i < CONF_ARTNET_INUNIVERSES; i++)
+    if (artnet_inTicks[i] < ARTNET_KEEPALIVE_TICKS)
+      artnet_inTicks[i]++;
+
+#ifdef ARTNET_SYNC_SUPPORT
+  /* no ArtSync for 4 seconds: flush what we have and go asynchronous */
+  if (artnet_syncTicks && --artnet_syncTicks == 0)
+  {
+    ARTNET_DEBUG("ArtSync timeout, leaving synchronous mode\r\n");
+    processSyncPacket();
+    artnet_syncTicks = 0;
+  }
+#endif
+}
+
 
 /* ----------------------------------------------------------------------------
  * receive Art-Net packet
@@ -306,24 +420,14 @@ artnet_get(void)
       ARTNET_DEBUG("Received artnet poll reply packet!\r\n");
       break;
     case OP_OUTPUT:;
-      struct artnet_dmx *dmx;
-
       ARTNET_DEBUG("Received artnet output packet!\r\n");
-      dmx = (struct artnet_dmx *) uip_appdata;
-
-      if (dmx->universe == ((artnet_subNet << 4) | artnet_outputUniverse))
-      {
-        if (artnet_dmxDirection == 0)
-        {
-          uint16_t len = ((dmx->lengthHi << 8) + dmx->length);
-          set_dmx_channels(&dmx->dataStart, artnet_outputUniverse, len);
-          if (artnet_sendPollReplyOnChange == TRUE)
-          {
-            artnet_pollReplyCounter++;
-            artnet_sendPollReply();
-          }
-        }
-      }
+      processDmxPacket((struct artnet_dmx *) uip_appdata);
+      break;
+    case OP_SYNC:;
+#ifdef ARTNET_SYNC_SUPPORT
+      ARTNET_DEBUG("Received artnet sync packet!\r\n");
+      processSyncPacket();
+#endif
       break;
     case OP_ADDRESS:;
     case OP_IPPROG:;
@@ -340,6 +444,8 @@ artnet_get(void)
    header(protocols/artnet/artnet.h)
    net_init(artnet_init)
    mainloop(artnet_main)
+   timer(1, artnet_periodic())
    block(Miscelleanous)
    ecmd_feature(artnet_pollreply, "artnet test",,artnet test)
+   ecmd_feature(artnet_stats, "artnet stats",,Show number of received and sent ArtDmx frames)
  */
@@ -55,6 +55,7 @@ extern uint16_t artnet_port;
 #define OP_POLL			0x2000
 #define OP_POLLREPLY		0x2100
 #define OP_OUTPUT		0x5000
+#define OP_SYNC			0x5200
 #define OP_ADDRESS		0x6000
 #define OP_IPPROG		0xf800
 #define OP_IPPROGREPLY		0xf900
@@ -89,6 +90,28 @@ extern uint16_t artnet_port;
 #define PORT_TYPE_DMX_OUTPUT	0x80
 #define PORT_TYPE_DMX_INPUT 	0x40
 
+/* Art-Net refresh rules, counted in 20ms timer ticks: an input universe is
+ * sent on change at most once per tick and retransmitted every 4 seconds
+ * when nothing changes.  A node leaves synchronous mode if no ArtSync has
+ * been seen for 4 seconds. */
+#define ARTNET_KEEPALIVE_TICKS	200
+#define ARTNET_SYNC_TIMEOUT	200
+
+#if CONF_ARTNET_INUNIVERSES > ARTNET_MAX_PORTS || \
+    CONF_ARTNET_OUTUNIVERSES > ARTNET_MAX_PORTS
+#error "Art-Net supports at most ARTNET_MAX_PORTS input/output universes"
+#endif
+#if CONF_ARTNET_INUNIVERSE + CONF_ARTNET_INUNIVERSES > DMX_STORAGE_UNIVERSES || \
+    CONF_ARTNET_OUTUNIVERSE + CONF_ARTNET_OUTUNIVERSES > DMX_STORAGE_UNIVERSES
+#error "Art-Net universes exceed DMX_STORAGE_UNIVERSES"
+#endif
+
+#if CONF_ARTNET_INUNIVERSES > CONF_ARTNET_OUTUNIVERSES
+#define ARTNET_NUM_PORTS	CONF_ARTNET_INUNIVERSES
+#else
+#define ARTNET_NUM_PORTS	CONF_ARTNET_OUTUNIVERSES
+#endif
+
 /* ----------------------------------------------------------------------------
  * packet formats
  */
@@ -211,9 +234,20 @@ struct artnet_dmx
   uint8_t dataStart[];
 };
 
+struct artnet_sync
+{
+  uint8_t id[8];
+  uint16_t opcode;
+  uint8_t versionH;
+  uint8_t version;
+  uint8_t aux1;
+  uint8_t aux2;
+};
+
 void artnet_init(void);
 void artnet_sendPollReply(void);
 void artnet_main(void);
+void artnet_periodic(void);
 void artnet_get(void);
 
 #endif /* _ARTNET_H */
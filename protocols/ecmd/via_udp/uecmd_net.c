@@ -20,12 +20,14 @@
  */
 
 #include <string.h>
+#include <avr/pgmspace.h>
 #include "uecmd_net.h"
 #include "protocols/uip/uip.h"
 #include "protocols/uip/uip_router.h"
 #include "core/debug.h"
 #include "protocols/ecmd/parser.h"
 #include "protocols/ecmd/ecmd-base.h"
+#include "protocols/ecmd/via_tcp/ecmd_state.h"
 
 #include "config.h"
 
@@ -47,39 +49,106 @@ uecmd_net_init()
   uip_udp_bind(uecmd_conn, HTONS(ECMD_UDP_PORT));
 }
 
+/* Room for the datagram and the replies behind the udp/ip header */
+#define UECMD_SPACE (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN)
+
+/* Longest tag echoed in front of the reply lines, e.g. "#1234" */
+#define UECMD_TAG_LENGTH 8
+
 void
 uecmd_net_main()
 {
   if (!uip_newdata())
     return;
 
-  char *p = (char *) uip_appdata;
-  /* This may be 1-2 chars too big in case there is a \r or \n, but it saves us a counting loop */
-  char cmd[uip_datalen() + 1];
-  char *dp = cmd;
-  /* Copy over into temporary buffer, remove \r \n if present, add \0 */
-  while (p < (char *) uip_appdata + uip_datalen())
-  {
-    if (*p == '\r' || *p == '\n')
-      break;
-    *dp++ = *p++;
-  }
-  *dp = 0;
+  /* The replies are written to the start of the buffer, so move the
+   * datagram to its end.  Every line is copied out of the way before the
+   * replies may grow over it. */
+  char *out = (char *) uip_appdata;
+  char *end = out + UECMD_SPACE;
+  char *in = end - uip_datalen();
+  memmove(in, out, uip_datalen());
+
+  char cmd[ECMD_INPUTBUF_LENGTH];
+  char tag[UECMD_TAG_LENGTH + 1];
 
   uip_slen = 0;
-  while (uip_slen < UIP_BUFSIZE - UIP_IPUDPH_LEN)
+  while (in < end)
   {
-    int16_t len = ecmd_parse_command(cmd, ((char *) uip_appdata) + uip_slen,
-                                     (UIP_BUFSIZE - UIP_IPUDPH_LEN) -
-                                     uip_slen);
-    /* At this point, len is either positive, even for errors, or ECMD_AGAIN(n) */
-    int16_t real_len = (is_ECMD_AGAIN(len) ? ECMD_AGAIN(len) : len );
-    uip_slen += real_len + 1;
-    ((char *) uip_appdata)[uip_slen - 1] = '\n';
-    if (real_len == len || len == 0)
-      break;
+    /* Split off the next line, skip empty ones */
+    char *eol = in;
+    while (eol < end && *eol != '\r' && *eol != '\n')
+      eol++;
+    char *line = in;
+    uint16_t line_len = eol - in;
+    while (eol < end && (*eol == '\r' || *eol == '\n'))
+      eol++;
+    in = eol;
+    if (line_len == 0)
+      continue;
+
+    /* A leading "#tag " is echoed in front of every line of the reply,
+     * so pipelined commands can be told apart. */
+    uint8_t tag_len = 0;
+    if (*line == '#')
+    {
+      while (tag_len < line_len && line[tag_len] != ' ')
+        tag_len++;
+      if (tag_len > UECMD_TAG_LENGTH)
+        tag_len = UECMD_TAG_LENGTH;
+      memcpy(tag, line, tag_len);
+      tag[tag_len++] = ' ';
+      while (line_len && *line != ' ')
+        line++, line_len--;
+      while (line_len && *line == ' ')
+        line++, line_len--;
+    }
+
+    if (line_len < ECMD_INPUTBUF_LENGTH)
+    {
+      memcpy(cmd, line, line_len);
+      cmd[line_len] = 0;
+    }
+    else
+      cmd[0] = 0;
+
+    int16_t len;
+    do
+    {
+      /* Stop the batch if a further line of output might not fit in
+       * front of the unparsed lines, the client has to repeat the
+       * commands without a reply. */
+      uint16_t room = in - (out + uip_slen);
+      if (room < tag_len + ECMD_OUTPUTBUF_LENGTH + 1)
+        goto send;
+
+      char *o = out + uip_slen;
+      memcpy(o, tag, tag_len);
+      o += tag_len;
+
+      if (cmd[0] == 0 && line_len)
+      {
+        /* line too long for the parser */
+        len = 11;
+        memcpy_P(o, PSTR("parse error"), len);
+      }
+      else
+        len = ecmd_parse_command(cmd, o, room - tag_len - 1);
+
+      /* len is either positive, even for errors, or ECMD_AGAIN(n) */
+      int16_t real_len = (is_ECMD_AGAIN(len) ? ECMD_AGAIN(len) : len);
+      if (real_len < 0)
+        real_len = 0;
+      uip_slen += tag_len + real_len + 1;
+      out[uip_slen - 1] = '\n';
+    }
+    while (is_ECMD_AGAIN(len));
   }
 
+send:
+  if (uip_slen == 0)
+    return;
+
   /* Sent data out */
 
   uip_udp_conn_t echo_conn;
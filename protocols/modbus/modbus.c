@@ -23,6 +23,7 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 #include <util/crc16.h>
 #include <string.h>
 #include "core/eeprom.h"
@@ -43,16 +44,60 @@
 struct modbus_connection_state_t modbus_client_state;
 #endif
 
+#ifdef MODBUS_RTU_TIMER_SUPPORT
+/* Silent intervals of the RTU framing in CPU cycles, a character has 11
+ * bits.  Above 19200 baud the spec fixes them to 750us and 1750us. */
+#if MODBUS_BAUDRATE > 19200
+#define MODBUS_T15_CYCLES (F_CPU / 4000 * 3)
+#define MODBUS_T35_CYCLES (F_CPU / 4000 * 7)
+#else
+#define MODBUS_T15_CYCLES (F_CPU * 33 / 2 / MODBUS_BAUDRATE)
+#define MODBUS_T35_CYCLES (F_CPU * 77 / 2 / MODBUS_BAUDRATE)
+#endif
+#define MODBUS_CHAR_CYCLES (F_CPU * 11 / MODBUS_BAUDRATE)
+
+#if MODBUS_T35_CYCLES / 8 < 256
+#define MODBUS_TIMER_PRESCALE 8
+#define MODBUS_TIMER_PRESCALER TC2_PRESCALER_8
+#elif MODBUS_T35_CYCLES / 64 < 256
+#define MODBUS_TIMER_PRESCALE 64
+#define MODBUS_TIMER_PRESCALER TC2_PRESCALER_64
+#elif MODBUS_T35_CYCLES / 256 < 256
+#define MODBUS_TIMER_PRESCALE 256
+#define MODBUS_TIMER_PRESCALER TC2_PRESCALER_256
+#elif MODBUS_T35_CYCLES / 1024 < 256
+#define MODBUS_TIMER_PRESCALE 1024
+#define MODBUS_TIMER_PRESCALER TC2_PRESCALER_1024
+#else
+#error Modbus baudrate too low for the RTU frame timer
+#endif
+
+/* The timer is restarted by every received character, so it measures the
+ * silence since the end of the last one.  When the next character arrives
+ * its own transmission time has passed as well. */
+#define MODBUS_T15_TICKS \
+  ((MODBUS_T15_CYCLES + MODBUS_CHAR_CYCLES) / MODBUS_TIMER_PRESCALE)
+#define MODBUS_T35_TICKS (MODBUS_T35_CYCLES / MODBUS_TIMER_PRESCALE)
+
+static volatile uint8_t modbus_frame_ready;
+#endif
+
 
 /* We generate our own usart init module, for our usart port */
 generate_usart_init()
 
 volatile struct modbus_buffer modbus_data;
 
-uint8_t modbus_recv_timer = 0;
+volatile uint8_t modbus_recv_timer = 0;
 int16_t *modbus_recv_len_ptr = NULL;
 uint8_t modbus_last_address;
 
+/* CRC of the frame being received, updated with every byte including the
+ * two CRC bytes, so it is zero at the end of an intact frame. */
+static volatile uint16_t modbus_rx_crc;
+/* set if a character of the frame was lost or came too late */
+static volatile uint8_t modbus_rx_error;
+
 uint16_t
 modbus_crc_calc(uint8_t *data, uint8_t len)
 {
@@ -82,63 +127,83 @@ modbus_init(void)
     modbus_client_state.len = 0;
 #endif
 
+#ifdef MODBUS_RTU_TIMER_SUPPORT
+  TC2_COUNTER_COMPARE = MODBUS_T35_TICKS;
+  TC2_MODE_CTC;
+  MODBUS_TIMER_PRESCALER;
+#endif
 }
 
-void
-modbus_periodic(void)
+/* A frame has been received completely or the answer timed out. */
+static void
+modbus_frame_end(void)
 {
-  if (modbus_recv_timer == 0) return;
-  modbus_recv_timer--;
+  uint8_t valid = modbus_rx_crc == 0 && !modbus_rx_error;
 
   if (!modbus_recv_len_ptr) {
 #ifdef MODBUS_CLIENT_SUPPORT
-    if (modbus_recv_timer == 0) {
-      /* check the crc */
-      uint16_t crc = modbus_crc_calc(modbus_client_state.data, modbus_client_state.len - 2);
-      uint16_t crc_recv =
-        ((modbus_client_state.data[modbus_client_state.len - 1])  << 8)
-        | modbus_client_state.data[modbus_client_state.len - 2];
-      if (crc != crc_recv) {
-        modbus_client_state.len = 0;
-        return;
-      }
-      /* See if we are the receiver */
-      if (!(modbus_client_state.data[0] == MODBUS_ADDRESS
-          || modbus_client_state.data[0] == MODBUS_BROADCAST))
-        return;
-      modbus_client_state.len -= 2;
-      /* A message for our own modbus stack */
-      int16_t recv_len;
-      modbus_client_process(modbus_client_state.data, modbus_client_state.len,
-                            &recv_len);
-      if (recv_len) {
-        RS485_ENABLE_TX;
-
-        modbus_data.data = modbus_client_state.data;
-        modbus_data.len = recv_len; 
-
-        /* Enable the tx interrupt and send the first character */
-        modbus_data.sent = 1;
-        usart(UCSR,B) |= _BV(usart(TXCIE));
-        usart(UDR) = modbus_client_state.data[0];
-      }
-      modbus_client_state.len = 0;
+    uint8_t len = modbus_client_state.len;
+    modbus_client_state.len = 0;
+
+    if (len < 4 || !valid)
+      return;
+    /* See if we are the receiver */
+    if (!(modbus_client_state.data[0] == MODBUS_ADDRESS
+        || modbus_client_state.data[0] == MODBUS_BROADCAST))
+      return;
+    /* A message for our own modbus stack */
+    int16_t recv_len;
+    modbus_client_process(modbus_client_state.data, len - 2, &recv_len);
+    if (recv_len > 0) {
+      RS485_ENABLE_TX;
+
+      modbus_data.data = modbus_client_state.data;
+      modbus_data.len = recv_len;
+
+      /* Enable the tx interrupt and send the first character */
+      modbus_data.sent = 1;
+      usart(UCSR,B) |= _BV(usart(TXCIE));
+      usart(UDR) = modbus_client_state.data[0];
     }
 #endif
     return;
   }
-  if (modbus_recv_timer != 0) return;
-  *modbus_recv_len_ptr = modbus_data.len;
 
-  if (*modbus_recv_len_ptr < 2)
-      *modbus_recv_len_ptr = -1;
+  int16_t recv_len = modbus_data.len;
 
-  if (modbus_data.data[0] != modbus_last_address) {
-      *modbus_recv_len_ptr = -1;
-  }
+  if (recv_len < 2 || modbus_data.data[0] != modbus_last_address)
+    recv_len = -1;
+  else if (!valid)
+    recv_len = MODBUS_RECV_CRC_ERROR;
+
+  *modbus_recv_len_ptr = recv_len;
   modbus_recv_len_ptr = NULL;
 }
 
+void
+modbus_periodic(void)
+{
+  uint8_t expired = 0;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (modbus_recv_timer != 0)
+      expired = --modbus_recv_timer == 0;
+  }
+  if (expired)
+    modbus_frame_end();
+}
+
+#ifdef MODBUS_RTU_TIMER_SUPPORT
+void
+modbus_process(void)
+{
+  if (!modbus_frame_ready)
+    return;
+  modbus_frame_ready = 0;
+  modbus_frame_end();
+}
+#endif
+
 uint8_t
 modbus_rxstart(uint8_t *data, uint8_t len, int16_t *recv_len) {
 #ifdef MODBUS_CLIENT_SUPPORT
@@ -156,7 +221,8 @@ modbus_rxstart(uint8_t *data, uint8_t len, int16_t *recv_len) {
 
   modbus_recv_len_ptr = recv_len;
 
-  modbus_data.crc = modbus_crc_calc(data, len);
+  /* The CRC is completed by the tx interrupt while the data is sent */
+  modbus_data.crc = _crc16_update(0xffff, data[0]);
   modbus_data.crc_len = 2;
 
   modbus_data.data = data;
@@ -173,7 +239,9 @@ modbus_rxstart(uint8_t *data, uint8_t len, int16_t *recv_len) {
 ISR(usart(USART,_TX_vect))
 {
   if (modbus_data.sent < modbus_data.len) {
-    usart(UDR) = modbus_data.data[modbus_data.sent++];
+    uint8_t data = modbus_data.data[modbus_data.sent++];
+    usart(UDR) = data;
+    modbus_data.crc = _crc16_update(modbus_data.crc, data);
   } else if (modbus_data.crc_len != 0) {
     /* Send the crc checksum */
     usart(UDR) = modbus_data.crc >> (( 1 - (--modbus_data.crc_len)) * 8);
@@ -191,6 +259,39 @@ ISR(usart(USART,_TX_vect))
   }
 }
 
+#ifdef MODBUS_RTU_TIMER_SUPPORT
+ISR(TC2_VECTOR_COMPARE)
+{
+  /* t3.5 of silence, the frame is complete */
+  TC2_INT_COMPARE_OFF;
+  modbus_frame_ready = 1;
+}
+#endif
+
+/* Account a received character for CRC and framing, FIRST is set for the
+ * first character of a frame. */
+static inline void
+modbus_rx_char(uint8_t data, uint8_t first)
+{
+  if (first) {
+    modbus_rx_crc = 0xffff;
+    modbus_rx_error = 0;
+  }
+#ifdef MODBUS_RTU_TIMER_SUPPORT
+  else if (TC2_COUNTER_CURRENT > MODBUS_T15_TICKS)
+    modbus_rx_error = 1;      /* more than t1.5 between two characters */
+
+  /* (re)start the end of frame detection, stop the answer timeout */
+  TC2_COUNTER_CURRENT = 0;
+  TC2_INT_COMPARE_CLR;
+  TC2_INT_COMPARE_ON;
+  modbus_recv_timer = 0;
+#else
+  modbus_recv_timer = 2;
+#endif
+  modbus_rx_crc = _crc16_update(modbus_rx_crc, data);
+}
+
 ISR(usart(USART,_RX_vect))
 {
   /* Ignore errors */
@@ -198,6 +299,7 @@ ISR(usart(USART,_RX_vect))
   {
     uint8_t v = usart(UDR);
     (void) v;
+    modbus_rx_error = 1;
     return;
   }
   uint8_t data = usart(UDR);
@@ -207,17 +309,23 @@ ISR(usart(USART,_RX_vect))
   {
 #ifdef MODBUS_CLIENT_SUPPORT
     /* This byte is not answer to a modbus/TCP || ecmd modbus request */
+    modbus_rx_char(data, modbus_client_state.len == 0);
+    if (modbus_client_state.len >= MODBUS_BUFFER_LEN) {
+      modbus_rx_error = 1;
+      return;
+    }
     modbus_client_state.data[modbus_client_state.len++] = data;
-    modbus_recv_timer = 2;
 #endif
     return;
   }
+  modbus_rx_char(data, modbus_data.len == 0);
   /* Is the buffer big enough */
-  if (modbus_data.len >= MODBUS_BUFFER_LEN) return;
+  if (modbus_data.len >= MODBUS_BUFFER_LEN) {
+    modbus_rx_error = 1;
+    return;
+  }
 
   modbus_data.data[modbus_data.len++] = data;
-
-  modbus_recv_timer = 2;
 }
 
 /*
@@ -225,4 +333,5 @@ ISR(usart(USART,_RX_vect))
   header(protocols/modbus/modbus.h)
   init(modbus_init)
   timer(1, modbus_periodic())
+  ifdef(`conf_MODBUS_RTU_TIMER', `mainloop(modbus_process)')
 */
@@ -24,7 +24,12 @@
 #define _MODBUS_H
 
 /* Default baudrate */
+#ifndef MODBUS_BAUDRATE
 #define MODBUS_BAUDRATE 9600
+#endif
+
+/* *recv_len of modbus_rxstart if the answer failed the CRC or framing */
+#define MODBUS_RECV_CRC_ERROR -3
 
 struct modbus_buffer {
   uint8_t *data;
@@ -36,6 +41,7 @@ struct modbus_buffer {
 
 void modbus_init(void);
 void modbus_periodic(void);
+void modbus_process(void);
 uint8_t modbus_rxstart(uint8_t *data, uint8_t len, int16_t *recv_len);
 uint16_t modbus_crc_calc(uint8_t *data, uint8_t len);
 
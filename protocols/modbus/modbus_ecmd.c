@@ -64,17 +64,16 @@ int16_t parse_cmd_modbus_recv(char *cmd, char *output, uint16_t len)
   while((volatile uint8_t)recv_len == 0) {
         _delay_ms(10);
         modbus_periodic();
+#ifdef MODBUS_RTU_TIMER_SUPPORT
+        modbus_process();
+#endif
   }
 
 
   if (recv_len == -1)
     return ECMD_FINAL(snprintf_P(output, len, PSTR("modbus error: no answer")));
 
-  uint16_t crc = modbus_crc_calc(buffer, recv_len - 2);
-  uint16_t crc_recv =
-          ((buffer[recv_len - 1])  << 8)
-          | (buffer[recv_len - 2]);
-  if (crc != crc_recv)
+  if (recv_len == MODBUS_RECV_CRC_ERROR)
     return ECMD_FINAL(snprintf_P(output, len, PSTR("modbus error: crc error")));
 
   for (i = 0; i < recv_len - 2; i++) {
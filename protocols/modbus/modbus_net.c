@@ -25,116 +25,308 @@
 
 #include "modbus_net.h"
 #include "protocols/uip/uip.h"
+#include "protocols/uip/uip_router.h"
 #include "core/debug.h"
 #include "protocols/modbus/modbus.h"
+#include "protocols/modbus/modbus_state.h"
+#include "protocols/modbus/modbus_client.h"
 
 #include "config.h"
 
-#define STATE(a) ((a)->appstate.modbus)
+extern int16_t *modbus_recv_len_ptr;
 
+/* Requests of all TCP connections wait here for the serial bus.  An entry
+ * belongs to a connection until its answer has been acknowledged, so
+ * every connection may have several requests outstanding and the answers
+ * find their way back by connection and transaction id.  Answers to
+ * register reads are kept for MODBUS_CACHE_TTL afterwards to serve
+ * identical requests without another round-trip on the bus. */
+struct modbus_gw_entry {
+  uip_conn_t *conn;             /* NULL if nobody waits for the answer */
+  uint8_t state;
+  uint8_t ttl;                  /* of a cached answer, in 100ms */
+  uint8_t cacheable;
+  uint8_t transaction_id[2];    /* as received */
+  uint8_t key[6];               /* unit, function, address, count */
+  int16_t recv_len;
+  uint8_t len;
+  uint8_t data[MODBUS_BUFFER_LEN];
+};
 
-extern int16_t *modbus_recv_len_ptr;
-static int16_t recv_len = -2;
+static struct modbus_gw_entry modbus_gw[MODBUS_GW_QUEUE];
+/* entry served last on the bus, the search for the next starts behind */
+static uint8_t modbus_gw_last;
 
 void modbus_net_init(void)
 {
   uip_listen(HTONS(MODBUS_PORT), modbus_net_main);
 }
 
-void modbus_net_main(void)
+static uint8_t
+modbus_gw_cacheable(uint8_t *rtu, uint8_t len)
+{
+  return len == 6 && rtu[0] != 0
+    && (rtu[1] == MODBUS_CMD_READ_HOLDING || rtu[1] == MODBUS_CMD_READ_INPUTS);
+}
+
+static struct modbus_gw_entry *
+modbus_gw_alloc(void)
+{
+  struct modbus_gw_entry *victim = NULL;
+
+  for (uint8_t i = 0; i < MODBUS_GW_QUEUE; i++) {
+    struct modbus_gw_entry *e = &modbus_gw[i];
+    if (e->state == MODBUS_IDLE)
+      return e;
+    /* a cached answer may be dropped, the oldest one first */
+    if (e->state == MODBUS_CACHED && (!victim || e->ttl < victim->ttl))
+      victim = e;
+  }
+  return victim;
+}
+
+static void
+modbus_gw_drop_unit(uint8_t unit)
+{
+  for (uint8_t i = 0; i < MODBUS_GW_QUEUE; i++)
+    if (modbus_gw[i].state == MODBUS_CACHED
+        && (unit == 0 || modbus_gw[i].key[0] == unit))
+      modbus_gw[i].state = MODBUS_IDLE;
+}
+
+/* The answer has been sent and acknowledged, or the connection is gone. */
+static void
+modbus_gw_done(struct modbus_gw_entry *e)
+{
+  e->conn = NULL;
+#ifdef MODBUS_CACHE_SUPPORT
+  if (e->cacheable && e->recv_len > 2 && e->data[1] == e->key[1]) {
+    e->state = MODBUS_CACHED;
+    /* an answer served from the cache keeps its remaining time */
+    if (e->ttl == 0)
+      e->ttl = MODBUS_CACHE_TTL;
+    return;
+  }
+#endif
+  e->state = MODBUS_IDLE;
+}
+
+static void
+modbus_gw_send(struct modbus_gw_entry *e)
 {
   uint8_t *answer = uip_appdata;
-  uint8_t i = 0;
-
-  if(uip_connected()) {
-    /* New connection */
-    memset(&uip_conn->appstate, 0, sizeof(uip_conn->appstate));
-  } else if (uip_acked()) {
-    uip_conn->appstate.modbus.state = MODBUS_IDLE;
-  } else if (uip_rexmit()) {
-    if (uip_conn->appstate.modbus.state == MODBUS_MUST_ANSWER)
-      goto send_new_data;
-  } else if (uip_closed() || uip_aborted() || uip_timedout()) {
-
-  } else if (uip_newdata()) {
-    /* Have we space for a new packet? */
-    if (STATE(uip_conn).state != MODBUS_IDLE) {
-      /* we don't have enough space, sent error */
-      answer[8] = 0x06; // Server busy
-      goto error_response;
+
+  memset(answer, 0, 6);
+  answer[0] = e->transaction_id[0];
+  answer[1] = e->transaction_id[1];
+
+  if (e->recv_len < 0) {
+    /* gateway target failed to respond or sent garbage */
+    answer[5] = 3;
+    answer[6] = e->key[0];
+    answer[7] = e->key[1] | 0x80;
+    answer[8] = e->recv_len == MODBUS_RECV_CRC_ERROR ? 0x0B : 0x05;
+    uip_send(answer, 9);
+  } else {
+    answer[5] = e->recv_len - 2;
+    memcpy(answer + 6, e->data, e->recv_len - 2);
+    uip_send(answer, e->recv_len - 2 + 6);
+  }
+  e->state = MODBUS_SENT;
+}
+
+/* Queue the request of the MBAP ADU at ADU.  Returns 0, or the exception
+ * code to answer with if the request can't be taken. */
+static uint8_t
+modbus_gw_request(uint8_t *adu)
+{
+  uint8_t *rtu = adu + 6;
+  uint8_t len = adu[5];
+  struct modbus_gw_entry *e;
+
+  if (len > MODBUS_BUFFER_LEN - 2 || len < 2)
+    return 0x04;                /* Server failure */
+
+  uint8_t cacheable = modbus_gw_cacheable(rtu, len);
+  if (!cacheable)
+    modbus_gw_drop_unit(rtu[0]);
+
+  e = modbus_gw_alloc();
+  if (e == NULL)
+    return 0x06;                /* Server busy */
+
+#ifdef MODBUS_CACHE_SUPPORT
+  if (cacheable) {
+    for (uint8_t i = 0; i < MODBUS_GW_QUEUE; i++) {
+      struct modbus_gw_entry *c = &modbus_gw[i];
+      if (c->state == MODBUS_CACHED && memcmp(c->key, rtu, 6) == 0) {
+        /* the cached entry stays, unless it is reused for the answer */
+        if (c != e) {
+          memcpy(e->data, c->data, c->recv_len);
+          cacheable = 0;
+        }
+        e->recv_len = c->recv_len;
+        e->state = MODBUS_MUST_ANSWER;
+        break;
+      }
     }
-    if (answer[5] > MODBUS_BUFFER_LEN) {
-      answer[8] = 0x04; // Server failure
-      goto error_response;
+  }
+  if (e->state != MODBUS_MUST_ANSWER)
+#endif
+  {
+    memcpy(e->data, rtu, len);
+    e->len = len;
+    e->ttl = 0;
+    e->state = MODBUS_MUST_SEND;
+  }
+  /* unit and function are needed for exception answers as well */
+  memcpy(e->key, rtu, len < 6 ? len : 6);
+  e->cacheable = cacheable;
+  e->transaction_id[0] = adu[0];
+  e->transaction_id[1] = adu[1];
+  e->conn = uip_conn;
+  return 0;
+}
+
+void modbus_net_main(void)
+{
+  uint8_t *answer = uip_appdata;
+  struct modbus_gw_entry *e;
+  uint8_t i;
+  /* transaction id, unit, function and code of a refused request */
+  uint8_t error[5] = { 0, 0, 0, 0, 0 };
+
+  if (uip_acked() || uip_closed() || uip_aborted() || uip_timedout()) {
+    uint8_t gone = !uip_acked();
+    for (i = 0; i < MODBUS_GW_QUEUE; i++) {
+      e = &modbus_gw[i];
+      if (e->conn != uip_conn)
+        continue;
+      if (e->state == MODBUS_SENT || (gone && e->state == MODBUS_MUST_ANSWER))
+        modbus_gw_done(e);
+      else if (gone && e->state == MODBUS_MUST_SEND)
+        e->state = MODBUS_IDLE;
+      else if (gone)
+        e->conn = NULL;         /* on the bus, finished by modbus_net_process */
     }
-    memcpy(STATE(uip_conn).data, answer + 6, answer[5]);
-    STATE(uip_conn).len = answer[5];
-    STATE(uip_conn).transaction_id = (answer[0] | (answer[1] << 8));
-    STATE(uip_conn).state = MODBUS_MUST_SEND;
+    if (gone)
+      return;
   }
 
-  /* See if we can send new data */
-  if (recv_len != 0 || !modbus_recv_len_ptr)
-    /* Search for a connetion with data, that had to be send */
-    for (i = 0; i < UIP_CONNS; i ++)
-      if (uip_conns[i].callback == modbus_net_main
-          && uip_conns[i].tcpstateflags != UIP_CLOSED) {
-        if (uip_conns[i].appstate.modbus.state == MODBUS_MUST_SEND) {
-          /* Start the transmission */
-          recv_len = 0;
-          modbus_rxstart((uint8_t *)STATE(&uip_conns[i]).data,
-                         STATE(&uip_conns[i]).len,
-                         &recv_len);
-          STATE(&uip_conns[i]).state = MODBUS_WAIT_ANSWER;
-          break;
-        } else if (STATE(&uip_conns[i]).state == MODBUS_WAIT_ANSWER
-                   && recv_len != 0) {
-          uip_conn = &uip_conns[i];
-          STATE(uip_conn).state = MODBUS_MUST_ANSWER;
-send_new_data:
-          if (recv_len == -1) {
-            // Send an error message
-            answer[8] = 0x05; // gateway problem
-            goto error_response;
-          }
-          uint16_t crc = modbus_crc_calc(STATE(uip_conn).data, recv_len - 2);
-          uint16_t crc_recv =
-            ((STATE(uip_conn).data[recv_len - 1])  << 8)
-            | (STATE(uip_conn).data[recv_len - 2]);
-          if (crc != crc_recv) {
-            // Send an error message
-            answer[8] = 0x0B; // gateway problem
-            goto error_response;
-          }
-          memcpy(answer + 6, STATE(uip_conn).data,
-                 recv_len - 2);
-          memset(answer, 0, 6);
-
-          answer[0] = STATE(uip_conn).transaction_id;
-          answer[1] = STATE(uip_conn).transaction_id >> 8;
-          answer[5] = recv_len - 2;
-
-          uip_udp_send(recv_len -2 + 6);
-        }
+  if (uip_rexmit()) {
+    for (i = 0; i < MODBUS_GW_QUEUE; i++)
+      if (modbus_gw[i].conn == uip_conn && modbus_gw[i].state == MODBUS_SENT) {
+        modbus_gw_send(&modbus_gw[i]);
+        return;
+      }
+  }
+
+  if (uip_newdata()) {
+    /* a segment may carry several pipelined requests */
+    uint8_t *adu = uip_appdata;
+    uint16_t left = uip_datalen();
 
+    while (left >= 8) {
+      uint16_t adu_len = 6 + adu[5];
+      if (left < adu_len)
+        break;                  /* truncated, the rest can't be parsed */
+
+      uint8_t code = modbus_gw_request(adu);
+      if (code && !error[4]) {
+        memcpy(error, adu, 2);
+        memcpy(error + 2, adu + 6, 2);
+        error[4] = code;
       }
+      adu += adu_len;
+      left -= adu_len;
+    }
+  }
 
-  return;
+  /* Send the next answer, uIP allows one unacknowledged segment */
+  if (uip_outstanding(uip_conn))
+    return;
+  for (i = 0; i < MODBUS_GW_QUEUE; i++)
+    if (modbus_gw[i].conn == uip_conn
+        && modbus_gw[i].state == MODBUS_MUST_ANSWER) {
+      modbus_gw_send(&modbus_gw[i]);
+      return;
+    }
 
-error_response:
-  /* The length of the answer */
-  answer[5] = 3;
-  answer[4] = 0;
-  /* Function code manipulation */
-  answer[7] |= 0x80;
-  uip_send(answer, 9);
+  /* Only one exception fits in the segment, the client will repeat the
+   * other refused requests. */
+  if (error[4]) {
+    memset(answer, 0, 6);
+    memcpy(answer, error, 2);
+    answer[5] = 3;
+    answer[6] = error[2];
+    answer[7] = error[3] | 0x80;
+    answer[8] = error[4];
+    uip_send(answer, 9);
+  }
 }
 
+/* Put the next request on the bus and hand finished answers over to
+ * their connections. */
+void
+modbus_net_process(void)
+{
+  uint8_t busy = modbus_recv_len_ptr != NULL;
+  struct modbus_gw_entry *e;
+
+  for (uint8_t i = 0; i < MODBUS_GW_QUEUE; i++) {
+    e = &modbus_gw[i];
+    if (e->state != MODBUS_WAIT_ANSWER)
+      continue;
+    if (e->recv_len == 0) {
+      busy = 1;
+      continue;
+    }
+
+    if (e->conn == NULL) {
+      modbus_gw_done(e);
+      continue;
+    }
+    e->state = MODBUS_MUST_ANSWER;
+    uip_stack_set_active(e->conn->stack);
+    uip_poll_conn(e->conn);
+    if (uip_len > 0)
+      router_output();
+  }
+
+  if (busy)
+    return;
+
+  /* round robin, so one busy connection can't starve the others */
+  uint8_t i = modbus_gw_last;
+  do {
+    if (++i >= MODBUS_GW_QUEUE)
+      i = 0;
+    e = &modbus_gw[i];
+    if (e->state == MODBUS_MUST_SEND) {
+      e->recv_len = 0;
+      if (modbus_rxstart(e->data, e->len, &e->recv_len)) {
+        e->state = MODBUS_WAIT_ANSWER;
+        modbus_gw_last = i;
+      }
+      break;
+    }
+  } while (i != modbus_gw_last);
+}
+
+#ifdef MODBUS_CACHE_SUPPORT
+void
+modbus_net_periodic(void)
+{
+  for (uint8_t i = 0; i < MODBUS_GW_QUEUE; i++)
+    if (modbus_gw[i].state == MODBUS_CACHED && --modbus_gw[i].ttl == 0)
+      modbus_gw[i].state = MODBUS_IDLE;
+}
+#endif
+
 /*
   -- Ethersex META --
   header(protocols/modbus/modbus_net.h)
   net_init(modbus_net_init)
-
-  state_header(protocols/modbus/modbus_state.h)
-  state_tcp(struct modbus_connection_state_t modbus)
+  mainloop(modbus_net_process)
+  ifdef(`conf_MODBUS_CACHE', `timer(5, modbus_net_periodic())')
 */
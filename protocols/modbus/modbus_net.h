@@ -26,7 +26,13 @@
 #define MODBUS_PORT 502
 #define MODBUS_BUFFER_LEN 100
 
+#ifndef MODBUS_GW_QUEUE
+#define MODBUS_GW_QUEUE 4
+#endif
+
 void modbus_net_init(void);
 void modbus_net_main(void);
+void modbus_net_process(void);
+void modbus_net_periodic(void);
 
 #endif /* MODBUS_NET_H */
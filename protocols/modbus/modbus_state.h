@@ -36,6 +36,8 @@ enum {
   MODBUS_MUST_SEND,
   MODBUS_WAIT_ANSWER,
   MODBUS_MUST_ANSWER,
+  MODBUS_SENT,
+  MODBUS_CACHED,
 };
 
 #endif /* MODBUS_STATE_H */
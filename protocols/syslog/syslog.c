@@ -32,12 +32,31 @@
 #include "protocols/uip/check_cache.h"
 #include "syslog.h"
 #include "syslog_net.h"
+#ifdef SYSLOG_SPILL_SUPPORT
+#include "hardware/serial_ram/23k256/ser_ram_pool.h"
+#endif
 
 
 static char send_buffer[MAX_DYNAMIC_SYSLOG_BUFFER + 1];
 extern uip_udp_conn_t *syslog_conn;
 static struct SyslogCallbackCtx syslog_callbacks[SYSLOG_CALLBACKS];
 
+#ifdef SYSLOG_SPILL_SUPPORT
+/* Messages that did not fit send_buffer, zero terminated each.  Once
+   anything is spilled, new messages go here as well to keep them in
+   order, until send_buffer has been refilled from it. */
+static ser_ram_ring_t syslog_spill = SER_RAM_RING_INIT;
+
+static uint8_t
+syslog_spill_put(const char *message)
+{
+  uint16_t len = strlen (message);
+  if (len == 0 || len >= MAX_DYNAMIC_SYSLOG_BUFFER)
+    return 0;
+  return ser_ram_ring_put (&syslog_spill, message, len + 1);
+}
+#endif /* SYSLOG_SPILL_SUPPORT */
+
 static void syslog_send_cb_P(void *data) 
 {
   strcpy_P(uip_appdata, data);
@@ -67,6 +86,12 @@ syslog_send(const char *message)
 {
   uint16_t offset = strlen (send_buffer);
 
+#ifdef SYSLOG_SPILL_SUPPORT
+  if (ser_ram_ring_len (&syslog_spill)
+      || strlen (message) + offset + 1 > MAX_DYNAMIC_SYSLOG_BUFFER)
+    return syslog_spill_put (message);
+#endif
+
   if (strlen (message) + offset + 1 > MAX_DYNAMIC_SYSLOG_BUFFER)
     return 0;
 
@@ -79,40 +104,78 @@ syslog_send(const char *message)
   return 1;
 }
 
-uint8_t 
-syslog_sendf(const char *message, ...)
+static int
+syslog_vformat(uint8_t pgm, char *buf, size_t n, const char *message,
+               va_list va)
+{
+  if (pgm)
+    return vsnprintf_P(buf, n, message, va);
+  return vsnprintf(buf, n, message, va);
+}
+
+static uint8_t
+syslog_vsendf(uint8_t pgm, const char *message, va_list va)
 {
-  va_list va;
   uint16_t offset = strlen (send_buffer);
 
-  va_start(va, message);
-  vsnprintf(send_buffer + offset, MAX_DYNAMIC_SYSLOG_BUFFER - offset, 
-            message, va);
-  va_end(va);
+#ifdef SYSLOG_SPILL_SUPPORT
+  va_list again;
+  va_copy(again, va);
+#endif
 
+  int len = syslog_vformat(pgm, send_buffer + offset,
+                           MAX_DYNAMIC_SYSLOG_BUFFER - offset, message, va);
   send_buffer[MAX_DYNAMIC_SYSLOG_BUFFER] = 0;
 
+#ifdef SYSLOG_SPILL_SUPPORT
+  /* Spill the message if it was truncated or older messages are spilled
+     already.  It is formatted again, since only its head fitted. */
+  if (ser_ram_ring_len (&syslog_spill)
+      || offset + len >= MAX_DYNAMIC_SYSLOG_BUFFER)
+  {
+    uint8_t ret = 0;
+    send_buffer[offset] = 0;
+    if (len < MAX_DYNAMIC_SYSLOG_BUFFER)
+    {
+      char buf[len + 1];
+      syslog_vformat(pgm, buf, len + 1, message, again);
+      ret = syslog_spill_put (buf);
+    }
+    va_end(again);
+    return ret;
+  }
+  va_end(again);
+#else
+  (void) len;
+#endif
+
   if (!offset)
     return syslog_insert_callback(syslog_send_cb, (void *)send_buffer);
   return 1;
 }
 
+uint8_t 
+syslog_sendf(const char *message, ...)
+{
+  va_list va;
+
+  va_start(va, message);
+  uint8_t ret = syslog_vsendf(0, message, va);
+  va_end(va);
+
+  return ret;
+}
+
 uint8_t
 syslog_sendf_P(PGM_P message, ...)
 {
   va_list va;
-  uint16_t offset = strlen (send_buffer);
 
   va_start(va, message);
-  vsnprintf_P(send_buffer + offset, MAX_DYNAMIC_SYSLOG_BUFFER - offset,
-            message, va);
+  uint8_t ret = syslog_vsendf(1, message, va);
   va_end(va);
 
-  send_buffer[MAX_DYNAMIC_SYSLOG_BUFFER] = 0;
-
-  if (!offset)
-    return syslog_insert_callback(syslog_send_cb, (void *)send_buffer);
-  return 1;
+  return ret;
 }
 
 uint8_t 
@@ -122,9 +185,47 @@ syslog_send_ptr(void *message)
 }
 
 
+#ifdef SYSLOG_SPILL_SUPPORT
+/* Move as many complete spilled messages back to the empty send_buffer
+   as fit. */
+static void
+syslog_spill_refill(void)
+{
+  if (send_buffer[0] || !ser_ram_ring_len (&syslog_spill))
+    return;
+
+  uint16_t n = ser_ram_ring_peek (&syslog_spill, send_buffer,
+                                  MAX_DYNAMIC_SYSLOG_BUFFER);
+  uint16_t used = 0, len = 0;
+  while (used < n)
+  {
+    uint16_t l = strnlen (send_buffer + used, n - used);
+    if (used + l == n)
+      break;			/* Terminator not peeked. */
+
+    memmove (send_buffer + len, send_buffer + used, l);
+    len += l;
+    used += l + 1;
+  }
+  send_buffer[len] = 0;
+
+  if (!syslog_insert_callback (syslog_send_cb, (void *) send_buffer))
+  {
+    send_buffer[0] = 0;		/* Try again next time. */
+    return;
+  }
+  ser_ram_ring_get (&syslog_spill, NULL, used);
+}
+#endif /* SYSLOG_SPILL_SUPPORT */
+
+
 void
 syslog_flush (void)
 {
+#ifdef SYSLOG_SPILL_SUPPORT
+  syslog_spill_refill ();
+#endif
+
 #ifdef ETHERNET_SUPPORT
   if (! syslog_conn || uip_check_cache (&syslog_conn->ripaddr))
     return;			/* ARP cache not ready, don't send request
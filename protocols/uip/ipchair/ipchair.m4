@@ -28,6 +28,7 @@ dnl
 #ifndef __IPCHAIR_HDR
 #define __IPCHAIR_HDR
 
+#include <avr/pgmspace.h>
 #include "protocols/uip/uip.h"
 
 typedef void builtin_return_t;
@@ -74,9 +75,110 @@ divert(1)
 #define ICMP6_OPTION_SOURCE_LINK_ADDRESS 1
 #define ICMP6_OPTION_TARGET_LINK_ADDRESS 2
 
-divert(3)#endif
+/* Protocol the rules of a chair are run with if the packet has none of
+   the protocols the chair tests (255 is reserved). */
+#define IPCHAIR_PROTO_OTHER 0xff
+
+#ifdef IPCHAIR_CACHE_SUPPORT
+/* Verdicts of the builtin chairs for TCP connections, so the following
+   packets of a connection skip the rules.  Only chairs that neither test
+   TCP flags nor jump to user chairs are cached, their verdict depends on
+   addresses, ports and stack alone. */
+static struct
+{
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  uint16_t srcport;
+  uint16_t destport;
+#if UIP_MULTI_STACK
+  uint8_t stack;
+#endif
+  uint8_t chair;		/* first rule of the chair plus one, 0 if unused */
+  uint8_t rule;
+  uint8_t drop;
+} ipchair_cache[IPCHAIR_CACHE_SIZE];
+
+static uint8_t ipchair_cache_next;
+
+static uint8_t
+ipchair_cache_find(uint8_t chair)
+{
+  uint8_t i;
+  for (i = 0; i < IPCHAIR_CACHE_SIZE; i++)
+    if (ipchair_cache[i].chair == chair + 1
+	&& ipchair_cache[i].srcport == BUF_TCP->srcport
+	&& ipchair_cache[i].destport == BUF_TCP->destport
+#if UIP_MULTI_STACK
+	&& ipchair_cache[i].stack == uip_stack_get_active()
+#endif
+	&& uip_ipaddr_cmp(ipchair_cache[i].srcipaddr, BUF->srcipaddr)
+	&& uip_ipaddr_cmp(ipchair_cache[i].destipaddr, BUF->destipaddr))
+      break;
+  return i;
+}
+
+/* Apply the verdict cached for the connection of the packet, returns 1
+   if there is one.  Connection setup and teardown go through the rules. */
+static uint8_t
+ipchair_cache_check(uint8_t chair)
+{
+  if (BUF->proto != UIP_PROTO_TCP
+      || (BUF_TCP->flags & (TCP_SYN | TCP_FIN | TCP_RST)))
+    return 0;
+
+  uint8_t i = ipchair_cache_find(chair);
+  if (i == IPCHAIR_CACHE_SIZE)
+    return 0;
+
+  ipchair_hits[ipchair_cache[i].rule]++;
+  if (ipchair_cache[i].drop)
+    uip_len = 0;
+  return 1;
+}
+
+static void
+ipchair_cache_store(uint8_t chair, uint8_t rule, uint8_t drop)
+{
+  if (BUF->proto != UIP_PROTO_TCP)
+    return;
+
+  uint8_t i = ipchair_cache_find(chair);
+  if (BUF_TCP->flags & (TCP_FIN | TCP_RST))
+    {
+      /* connection is closed, free its entry */
+      if (i < IPCHAIR_CACHE_SIZE)
+	ipchair_cache[i].chair = 0;
+      return;
+    }
+
+  if (i == IPCHAIR_CACHE_SIZE)
+    {
+      i = ipchair_cache_next;
+      ipchair_cache_next = i + 1 == IPCHAIR_CACHE_SIZE ? 0 : i + 1;
+    }
+
+  uip_ipaddr_copy(ipchair_cache[i].srcipaddr, BUF->srcipaddr);
+  uip_ipaddr_copy(ipchair_cache[i].destipaddr, BUF->destipaddr);
+  ipchair_cache[i].srcport = BUF_TCP->srcport;
+  ipchair_cache[i].destport = BUF_TCP->destport;
+#if UIP_MULTI_STACK
+  ipchair_cache[i].stack = uip_stack_get_active();
+#endif
+  ipchair_cache[i].chair = chair + 1;
+  ipchair_cache[i].rule = rule;
+  ipchair_cache[i].drop = drop;
+}
+#endif /* IPCHAIR_CACHE_SUPPORT */
+
+divert(9)#endif
 divert(-1)
 
+dnl Every LEG and POLICY is a rule with its own hit counter, numbered
+dnl across all chairs.  The counters and the rule names are emitted
+dnl once all chairs are known.
+define(`__rule_count', 0)
+m4wrap(`__rule_table(__rule_count)')
+
 define(`forloop',
 		`pushdef(`$1', `$2')_forloop(`$1', `$2', `$3', `$4')popdef(`$1')')dnl
 		define(`_forloop',
@@ -92,14 +194,96 @@ dnl List all default targets to return builtin here ...
 dnl else ...
 `user')')
 
+dnl The rules of a chair go to an inlined function taking the protocol
+dnl of the packet.  ipchair_CHAIR_chair switches on the protocol and
+dnl calls it with a constant for each protocol the chair tests, so every
+dnl case keeps only the rules for its protocol and those for any.  The
+dnl rules, raw code and cpp conditionals stay in their order.
 define(`CHAIR', `divert(0)#define IPCHAIR_HAVE_$1
 _chair_type($1)_return_t ipchair_$1_chair(void);
 
 divert(2)
-_chair_type($1)_return_t
-ipchair_$1_chair(void)
+static inline __attribute__ ((always_inline)) _chair_type($1)_return_t
+ipchair_$1_rules(const uint8_t proto)
 {dnl
 define(`__type', _chair_type($1))dnl
+define(`__chair', `$1')dnl
+define(`__chair_rule', 0)dnl
+define(`__chair_first', __rule_count)dnl
+define(`__chair_protos', `')dnl
+define(`__cacheable', 1)dnl
+')
+
+dnl Add protocol $1 to the cases of the current chair.
+define(`__proto_case', `ifdef(`__proto_case_'__chair`_$1', `',
+`define(`__proto_case_'__chair`_$1', 1)dnl
+define(`__chair_protos', defn(`__chair_protos')`$1,')')')
+
+dnl Run the rules of the current chair with protocol $1.
+define(`__rules_call', `ifelse(__type, `builtin',
+`ipchair_`'__chair`'_rules($1);', `return ipchair_`'__chair`'_rules($1);')')
+
+define(`__proto_cases', `ifelse(`$1', `', `', `    case UIP_PROTO_$1:
+      __rules_call(`UIP_PROTO_$1')ifelse(__type, `builtin', `
+      break;')
+$0(shift($@))')')
+
+define(`__chair_dispatch', `
+_chair_type(__chair)_return_t
+ipchair_`'__chair`'_chair(void)
+{ifelse(__type, `builtin', `
+  ipchair_`'__chair`'_check();')
+ifelse(defn(`__chair_protos'), `', `  __rules_call(`IPCHAIR_PROTO_OTHER')',
+`  switch (BUF->proto)
+    {
+__proto_cases(__chair_protos)    default:
+      __rules_call(`IPCHAIR_PROTO_OTHER')
+    }')
+}
+')
+
+dnl Count a hit of the current rule, which jumps to target $1.  The
+dnl rules of a chair are named by number, the policy by $2.
+define(`__rule_hit', `dnl
+ifelse(`$2', `', `define(`__chair_rule', incr(__chair_rule))')dnl
+__rule_name(__rule_count, __chair ifelse(`$2', `', __chair_rule, `$2'))dnl
+__rule_store(`$1', __rule_count)dnl
+define(`__rule_count', incr(__rule_count))')
+
+define(`__rule_name', `divert(3)static const char ipchair_rule_name_$1[] PROGMEM = "$2";
+divert(2)
+    ipchair_hits[$1]++;')
+
+dnl Remember the verdict of rule $2 for the connection, as far as it is final.
+define(`__rule_store', `ifelse(__type, `user', `',
+`$1', `DROP', `
+    ipchair_`'__chair`'_store($2, 1);',
+`$1', `ACCEPT', `
+    ipchair_`'__chair`'_store($2, 0);',
+`$1', `RETURN', `',
+`define(`__cacheable', 0)')')
+
+dnl Emit the cache hooks of a builtin chair: name $1, first rule $2.
+define(`__chair_hooks', `divert(1)
+#if defined(IPCHAIR_CACHE_SUPPORT) && $3
+#define ipchair_$1_check()  if (ipchair_cache_check($2)) return
+#define ipchair_$1_store(rule, drop)  ipchair_cache_store($2, rule, drop)
+#else
+#define ipchair_$1_check()  do { } while (0)
+#define ipchair_$1_store(rule, drop)  do { } while (0)
+#endif
+divert(2)')
+
+define(`__rule_table', `divert(0)
+#define IPCHAIR_RULES $1
+extern uint32_t ipchair_hits[];
+extern PGM_P const ipchair_rule_names[];
+divert(3)
+uint32_t ipchair_hits[$1];
+PGM_P const ipchair_rule_names[] PROGMEM = {
+ifelse($1, 0, `', `forloop(`i', 0, decr($1), `  ipchair_rule_name_`'i,
+')')dnl
+};
 ')
 
 define(`LEG', `if (_ipchair_arg_loop($@)')
@@ -128,7 +312,7 @@ dnl Stack
 ifelse(`$1', `--stack', `ipchair_stack($2) && $0(shift(shift($@)))')dnl
 ifelse(`$1', `! --stack', `!(ipchair_stack($2)) && $0(shift(shift($@)))')dnl
 dnl Target
-ifelse(`$1', `-j', `1) __target(shift($@))undefine(`__proto')')dnl
+ifelse(`$1', `-j', `1) {__rule_hit(`$2')__target(shift($@)) }undefine(`__proto')')dnl
 ')
 
 # Yippieyah voodoo
@@ -140,11 +324,11 @@ define(`__paste2', `$1$2')
 #######
 define(`ipchair_dst', `uip_ipaddr_cmp_instant(BUF->destipaddr, ipchair_addr($1))') 
 define(`ipchair_src', `uip_ipaddr_cmp_instant(BUF->srcipaddr, ipchair_addr($1))') 
-define(`ipchair_proto',  `define(`__proto', translit(`$1', `a-z', `A-Z'))BUF->proto == __paste2(`UIP_PROTO_', translit(`$1', `a-z', `A-Z'))') 
+define(`ipchair_proto',  `define(`__proto', translit(`$1', `a-z', `A-Z'))__proto_case(indir(`__proto'))proto == __paste2(`UIP_PROTO_', translit(`$1', `a-z', `A-Z'))') 
 define(`ipchair_dport', `__paste2(`BUF_', indir(`__proto'))->destport == HTONS($1)') 
 define(`ipchair_stack', `uip_stack_get_active() == $1') 
 define(`ipchair_sport', `__paste2(`BUF_', indir(`__proto'))->srcport == HTONS($1)') 
-define(`ipchair_tcp_flags', `(((BUF_TCP->flags) & (0 patsubst(`:'translit(`$1', `a-z', `A-Z'), `:', ` | TCP_'))) == (0 patsubst(`:'translit(`$2', `a-z', `A-Z'), `:', ` | TCP_')))')
+define(`ipchair_tcp_flags', `define(`__cacheable', 0)(((BUF_TCP->flags) & (0 patsubst(`:'translit(`$1', `a-z', `A-Z'), `:', ` | TCP_'))) == (0 patsubst(`:'translit(`$2', `a-z', `A-Z'), `:', ` | TCP_')))')
 define(`ipchair_icmp_type', `__paste2(`BUF_', indir(`__proto'))->type == __paste2(__paste2(indir(`__proto'),_),translit(`$1', `a-z', `A-Z'))') 
 ######
 # Targets
@@ -171,9 +355,10 @@ divert(2){
 
 define(`POLICY', `
   ifelse(__type, `builtin', `policy:')
-  if(1) __target($1)
+  if(1) {__rule_hit(`$1', `policy')__target($1) }
   ifelse(__type, `user', `/* call failed, continue in parent */ return 1;')
-}')
+}
+__chair_dispatch`'ifelse(__type, `builtin', `__chair_hooks(__chair, __chair_first, __cacheable)')')
 
 define(`SET_STACK', `uip_stack_set_active(STACK_$1); ')
 
@@ -0,0 +1,55 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#include <stdio.h>
+#include <avr/pgmspace.h>
+
+#include "config.h"
+#include "protocols/uip/ipchair/ipchair.h"
+
+#include "protocols/ecmd/ecmd-base.h"
+
+int16_t
+parse_cmd_ipchair_stats(char *cmd, char *output, uint16_t len)
+{
+#if IPCHAIR_RULES
+  /* use the bytes of cmd to keep our position between the calls */
+  if (cmd[0] != ECMD_STATE_MAGIC)
+  {
+    cmd[0] = ECMD_STATE_MAGIC;
+    cmd[1] = 0;
+  }
+
+  uint8_t i = cmd[1]++;
+  int16_t ret = snprintf_P(output, len, PSTR("%S %lu"),
+                           (PGM_P) pgm_read_word(&ipchair_rule_names[i]),
+                           ipchair_hits[i]);
+  return i + 1 < IPCHAIR_RULES ? ECMD_AGAIN(ret) : ECMD_FINAL(ret);
+#else
+  return ECMD_FINAL_OK;
+#endif
+}
+
+/*
+  -- Ethersex META --
+  block(Network configuration)
+  ecmd_ifdef(IPCHAIR_SUPPORT)
+    ecmd_feature(ipchair_stats, "ipchair stats",, List the hit count of every IPchair rule)
+  ecmd_endif()
+*/
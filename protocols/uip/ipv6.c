@@ -262,9 +262,9 @@ uip_router_parse_advertisement(void)
 
         if (isnt_prefix)
           /* use the router's ip address as new default gateway. */
-          uip_ipaddr_copy(uip_draddr, prefix->prefix);
+          uip_setdraddr(prefix->prefix);
         else
-          uip_ipaddr_copy(uip_draddr, ICMPBUF->srcipaddr);
+          uip_setdraddr(ICMPBUF->srcipaddr);
 
         break;
       default:
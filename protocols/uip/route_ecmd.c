@@ -0,0 +1,102 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+#include <stdio.h>
+#include <avr/pgmspace.h>
+
+#include "config.h"
+#include "protocols/uip/uip.h"
+#include "protocols/uip/uip_router.h"
+
+#include "protocols/ecmd/ecmd-base.h"
+
+/* parse up to three dotted quads, returns the number found */
+static int8_t
+parse_route(char *cmd, uip_ipaddr_t *net, uip_ipaddr_t *netmask,
+            uip_ipaddr_t *gw)
+{
+  uint8_t *n = (uint8_t *) net, *m = (uint8_t *) netmask, *g = (uint8_t *) gw;
+  int8_t ret = sscanf_P(cmd, PSTR("%hhu.%hhu.%hhu.%hhu %hhu.%hhu.%hhu.%hhu"
+                                  " %hhu.%hhu.%hhu.%hhu"),
+                        n, n + 1, n + 2, n + 3, m, m + 1, m + 2, m + 3,
+                        g, g + 1, g + 2, g + 3);
+  return ret < 0 ? 0 : ret / 4;
+}
+
+int16_t
+parse_cmd_route_add(char *cmd, char *output, uint16_t len)
+{
+  uip_ipaddr_t net, netmask, gw;
+
+  if (parse_route(cmd, &net, &netmask, &gw) != 3)
+    return ECMD_ERR_PARSE_ERROR;
+
+  if (router_route_add(&net, &netmask, &gw))
+    return ECMD_FINAL(snprintf_P(output, len, PSTR("table full")));
+
+  return ECMD_FINAL_OK;
+}
+
+int16_t
+parse_cmd_route_del(char *cmd, char *output, uint16_t len)
+{
+  uip_ipaddr_t net, netmask, gw;
+
+  if (parse_route(cmd, &net, &netmask, &gw) < 2)
+    return ECMD_ERR_PARSE_ERROR;
+
+  if (router_route_del(&net, &netmask))
+    return ECMD_FINAL(snprintf_P(output, len, PSTR("no such route")));
+
+  return ECMD_FINAL_OK;
+}
+
+int16_t
+parse_cmd_route_list(char *cmd, char *output, uint16_t len)
+{
+  /* use the bytes of cmd to keep our position between the calls */
+  if (cmd[0] != ECMD_STATE_MAGIC)
+  {
+    cmd[0] = ECMD_STATE_MAGIC;
+    cmd[1] = 0;
+  }
+
+  uint8_t i = cmd[1]++;
+  if (i >= router_routes_used)
+    return ECMD_FINAL_OK;
+
+  uint8_t *n = (uint8_t *) &router_routes[i].net;
+  uint8_t *m = (uint8_t *) &router_routes[i].netmask;
+  uint8_t *g = (uint8_t *) &router_routes[i].gw;
+  int16_t ret = snprintf_P(output, len,
+                           PSTR("%u.%u.%u.%u %u.%u.%u.%u via %u.%u.%u.%u"),
+                           n[0], n[1], n[2], n[3], m[0], m[1], m[2], m[3],
+                           g[0], g[1], g[2], g[3]);
+  return i + 1 < router_routes_used ? ECMD_AGAIN(ret) : ECMD_FINAL(ret);
+}
+
+/*
+  -- Ethersex META --
+  block(Network configuration)
+  ecmd_ifdef(ROUTER_STATIC_SUPPORT)
+    ecmd_feature(route_list, "route list",, List the static routes)
+    ecmd_feature(route_add, "route add", NET NETMASK GW, Route NET/NETMASK via the gateway GW)
+    ecmd_feature(route_del, "route del", NET NETMASK, Remove the route to NET/NETMASK)
+  ecmd_endif()
+*/
@@ -124,7 +124,10 @@ struct uip_listen_port {
  *
  * \hideinitializer
  */
-#define uip_sethostaddr(addr) uip_ipaddr_copy(uip_hostaddr, (addr))
+#define uip_sethostaddr(addr) do {		\
+    uip_ipaddr_copy(uip_hostaddr, (addr));	\
+    router_cache_flush();			\
+  } while(0)
 
 /**
  * Get the IP address of this host.
@@ -156,7 +159,10 @@ struct uip_listen_port {
  *
  * \hideinitializer
  */
-#define uip_setdraddr(addr) uip_ipaddr_copy(uip_draddr, (addr))
+#define uip_setdraddr(addr) do {		\
+    uip_ipaddr_copy(uip_draddr, (addr));	\
+    router_cache_flush();			\
+  } while(0)
 
 /**
  * Set the netmask.
@@ -168,9 +174,15 @@ struct uip_listen_port {
  *
  * \hideinitializer
  */
-#define uip_setnetmask(addr) uip_ipaddr_copy(uip_netmask, (addr))
+#define uip_setnetmask(addr) do {		\
+    uip_ipaddr_copy(uip_netmask, (addr));	\
+    router_cache_flush();			\
+  } while(0)
 
-#define uip_setprefixlen(len)  (uip_prefix_len = (len))
+#define uip_setprefixlen(len) do {		\
+    uip_prefix_len = (len);			\
+    router_cache_flush();			\
+  } while(0)
 
 
 /**
@@ -1661,7 +1673,8 @@ static inline uint8_t uip_buf_lock (void)
     result = 1;
   else {
     _uip_buf_lock = 8;
-    rfm12_int_disable();
+    if (!rfm12_tx_active ())	/* don't stall an RFM12 transmission */
+      rfm12_int_disable();
   }
   SREG = sreg;			/* reenable global interrupts */
 #endif
@@ -1678,8 +1691,7 @@ static inline uint8_t uip_buf_lock (void)
 
 #define uip_buf_unlock()			\
   do {						\
-    if(rfm12_tx_active ()			\
-       || usb_net_tx_active ()			\
+    if(usb_net_tx_active ()			\
        || zbus_tx_active()) break;		\
     _uip_buf_lock = 0;				\
     rfm12_int_enable();				\
@@ -421,8 +421,14 @@ uip_arp_out(void)
     /* Check if the destination address is on the local network. */
     if(!uip_ipaddr_maskcmp(IPBUF->destipaddr, uip_hostaddr, uip_netmask)) {
       /* Destination address was not on the local network, so we need to
-	 use the default router's IP address instead of the destination
-	 address when determining the MAC address. */
+	 use the router's IP address instead of the destination address
+	 when determining the MAC address. */
+#ifdef ROUTER_STATIC_SUPPORT
+      uip_ipaddr_t *gw = router_route_gw(&IPBUF->destipaddr);
+      if(gw)
+	uip_ipaddr_copy(ipaddr, *gw);
+      else
+#endif
       uip_ipaddr_copy(ipaddr, uip_draddr);
     } else {
       /* Else, we use the destination IP address. */
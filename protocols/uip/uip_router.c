@@ -19,6 +19,8 @@
  * http://www.gnu.org/copyleft/gpl.html
  */
 
+#include <string.h>
+
 #include "uip_router.h"
 
 #ifdef ROUTER_SUPPORT
@@ -49,37 +51,168 @@
 
 #define BUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
 
+#ifdef ROUTER_CACHE_SUPPORT
+/* Recent decisions of router_find_stack, so the stacks needn't be
+   walked for every packet.  Replaced round robin. */
+static struct
+{
+  uip_ipaddr_t addr;
+  uint8_t local;		/* addr was checked for being one of ours */
+  uint8_t stack;
+} router_cache[ROUTER_CACHE_SIZE];
+
+static uint8_t router_cache_used;
+static uint8_t router_cache_next;
+
+void
+router_cache_flush(void)
+{
+  router_cache_used = 0;
+  router_cache_next = 0;
+}
+#endif	/* ROUTER_CACHE_SUPPORT */
+
+#ifdef ROUTER_STATIC_SUPPORT
+/* Static routes, the most specific netmask first. */
+struct router_route router_routes[ROUTER_STATIC_ROUTES];
+uint8_t router_routes_used;
+
+/* Compare two netmasks, > 0 if A covers fewer addresses than B. */
+static int8_t
+router_mask_cmp(uip_ipaddr_t *a, uip_ipaddr_t *b)
+{
+  for (uint8_t i = 0; i < 2; i++)
+    if ((*a)[i] != (*b)[i])
+      return HTONS((*a)[i]) > HTONS((*b)[i]) ? 1 : -1;
+  return 0;
+}
+
 uint8_t
-router_find_stack(uip_ipaddr_t *forwardip)
+router_route_add(uip_ipaddr_t *net, uip_ipaddr_t *netmask, uip_ipaddr_t *gw)
 {
   uint8_t i;
-routing_input:
-  for (i = 0; i < STACK_LEN; i++) {
+
+  router_route_del(net, netmask);
+  if (router_routes_used == ROUTER_STATIC_ROUTES)
+    return 1;
+
+  for (i = router_routes_used; i > 0; i--)
+    {
+      if (router_mask_cmp(&router_routes[i - 1].netmask, netmask) >= 0)
+	break;
+      router_routes[i] = router_routes[i - 1];
+    }
+
+  uip_ipaddr_copy(router_routes[i].net, *net);
+  uip_ipaddr_copy(router_routes[i].netmask, *netmask);
+  uip_ipaddr_copy(router_routes[i].gw, *gw);
+  router_routes_used++;
+
+  router_cache_flush();
+  return 0;
+}
+
+uint8_t
+router_route_del(uip_ipaddr_t *net, uip_ipaddr_t *netmask)
+{
+  for (uint8_t i = 0; i < router_routes_used; i++)
+    if (uip_ipaddr_cmp(router_routes[i].net, *net)
+	&& uip_ipaddr_cmp(router_routes[i].netmask, *netmask))
+      {
+	router_routes_used--;
+	memmove(&router_routes[i], &router_routes[i + 1],
+		(router_routes_used - i) * sizeof(struct router_route));
+	router_cache_flush();
+	return 0;
+      }
+
+  return 1;
+}
+
+uip_ipaddr_t *
+router_route_gw(uip_ipaddr_t *dest)
+{
+  for (uint8_t i = 0; i < router_routes_used; i++)
+    if (uip_ipaddr_maskcmp(*dest, router_routes[i].net,
+			   router_routes[i].netmask))
+      return &router_routes[i].gw;
+
+  return NULL;
+}
+#endif	/* ROUTER_STATIC_SUPPORT */
+
+/* Find the stack IP is directly attached to. */
+static uint8_t
+router_find_attached(uip_ipaddr_t *ip)
+{
+  for (uint8_t i = 0; i < STACK_LEN; i++) {
     uip_stack_set_active(i);
-    if((! forwardip) && uip_ipaddr_cmp(BUF->destipaddr, uip_hostaddr))
-      return i;
 #ifdef IPV6_SUPPORT
-    if(forwardip && uip_ipaddr_prefixlencmp(*forwardip, uip_hostaddr,
-                                            uip_prefix_len))
+    if(uip_ipaddr_prefixlencmp(*ip, uip_hostaddr, uip_prefix_len))
       return i;
 #else /* !UIP_CONF_IPV6 */
-    if(forwardip && uip_ipaddr_maskcmp(*forwardip, uip_hostaddr,
-                                       uip_netmask))
-       return i;
+    if(uip_ipaddr_maskcmp(*ip, uip_hostaddr, uip_netmask))
+      return i;
 #endif
   }
-  /* we didn't find an interface for the forwadip, so try it again with the
-   * default router
-   */
-  if (forwardip && forwardip != &uip_draddr){
-    forwardip = &uip_draddr;
-    goto routing_input;
-  }
 
-  /* Drop the packet */
   return 255;
 }
 
+uint8_t
+router_find_stack(uip_ipaddr_t *forwardip)
+{
+  uint8_t i;
+
+#ifdef ROUTER_CACHE_SUPPORT
+  uip_ipaddr_t *addr = forwardip ? forwardip : &BUF->destipaddr;
+  for (i = 0; i < router_cache_used; i++)
+    if (router_cache[i].local == !forwardip
+	&& uip_ipaddr_cmp(router_cache[i].addr, *addr))
+      return router_cache[i].stack;
+#endif
+
+  if (! forwardip) {
+    for (i = 0; i < STACK_LEN; i++) {
+      uip_stack_set_active(i);
+      if(uip_ipaddr_cmp(BUF->destipaddr, uip_hostaddr))
+	break;
+    }
+    if (i == STACK_LEN)
+      i = 255;
+  }
+  else {
+    i = router_find_attached(forwardip);
+
+#ifdef ROUTER_STATIC_SUPPORT
+    if (i == 255) {
+      uip_ipaddr_t *gw = router_route_gw(forwardip);
+      if (gw)
+	i = router_find_attached(gw);
+    }
+#endif
+
+    /* we didn't find an interface for the forwadip, so try it again with
+     * the default router
+     */
+    if (i == 255 && forwardip != &uip_draddr)
+      i = router_find_attached(&uip_draddr);
+  }
+
+#ifdef ROUTER_CACHE_SUPPORT
+  uint8_t n = router_cache_next;
+  uip_ipaddr_copy(router_cache[n].addr, *addr);
+  router_cache[n].local = !forwardip;
+  router_cache[n].stack = i;
+  router_cache_next = n + 1 == ROUTER_CACHE_SIZE ? 0 : n + 1;
+  if (router_cache_used < ROUTER_CACHE_SIZE)
+    router_cache_used++;
+#endif
+
+  /* 255 drops the packet */
+  return i;
+}
+
 
 void
 router_input(uint8_t origin)
@@ -39,6 +39,32 @@ uint8_t router_find_stack(uip_ipaddr_t *forwardip);
    */
 void router_output(void);
 
+#ifdef ROUTER_STATIC_SUPPORT
+#ifndef ROUTER_STATIC_ROUTES
+#define ROUTER_STATIC_ROUTES 4
+#endif
+
+struct router_route {
+  uip_ipaddr_t net;
+  uip_ipaddr_t netmask;
+  uip_ipaddr_t gw;		/* next hop, on a directly attached net */
+};
+
+extern struct router_route router_routes[ROUTER_STATIC_ROUTES];
+extern uint8_t router_routes_used;
+
+/* Add or replace the route to NET/NETMASK via GW.  Returns 1 if the
+   table is full. */
+uint8_t router_route_add(uip_ipaddr_t *net, uip_ipaddr_t *netmask,
+			 uip_ipaddr_t *gw);
+
+/* Remove the route to NET/NETMASK.  Returns 1 if there is none. */
+uint8_t router_route_del(uip_ipaddr_t *net, uip_ipaddr_t *netmask);
+
+/* Return the gateway of the most specific route to DEST or NULL. */
+uip_ipaddr_t *router_route_gw(uip_ipaddr_t *dest);
+#endif	/* ROUTER_STATIC_SUPPORT */
+
 #else
 
 /* No routing support, simply pass packet to uip_input of the stack
@@ -74,4 +100,16 @@ void router_output(void);
 
 #endif	/* ROUTER_SUPPORT && UIP_MULTI_STACK */
 
+#ifdef ROUTER_CACHE_SUPPORT
+#ifndef ROUTER_CACHE_SIZE
+#define ROUTER_CACHE_SIZE 4
+#endif
+
+/* Forget the cached routing decisions, needed whenever an address,
+   netmask or route changes.  The uip_set* macros take care of that. */
+void router_cache_flush(void);
+#else
+#define router_cache_flush()  do { } while(0)
+#endif
+
 #endif	/* UIP_ROUTER_H */
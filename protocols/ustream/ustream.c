@@ -27,33 +27,248 @@
 
 #include "config.h"
 #include "protocols/uip/uip.h"
+#include "protocols/uip/uip_router.h"
 #include "protocols/ecmd/parser.h"
 #include "protocols/ecmd/ecmd-base.h"
 
 #include "ustream.h"
+#include "vs1053.h"
 
 static uip_conn_t *ustream_conn;
 
+/* Jitter buffer between the tcp stream and the decoder. Both ends are
+ * served from the main loop, so no locking is needed. */
+static uint8_t ustream_buf[USTREAM_BUFFER_LEN];
+static uint16_t ustream_head;
+static uint16_t ustream_tail;
+
+/* don't feed the decoder until the buffer has been filled up again */
+static uint8_t ustream_prebuffer = 1;
+/* the server closed the stream, play what is left without prebuffering */
+static uint8_t ustream_eof;
+
+/* number of "\r\n\r\n" characters matched while skipping the header,
+ * USTREAM_HEADER_DONE once the payload starts */
+#define USTREAM_HEADER_DONE 4
+static uint8_t ustream_header;
+
+/* progress through the status line, which may span several segments:
+ * 0 within the protocol ("HTTP/1.x" or "ICY"), then one more for each
+ * digit of "200" matched */
+#define USTREAM_STATUS_OK 4
+static uint8_t ustream_status;
+
+/* periodic calls to wait before the next connection attempt, and the
+ * wait after the next failed one; doubled on every failure */
+static uint8_t ustream_backoff;
+static uint8_t ustream_backoff_next = 1;
+static uint8_t ustream_streaming;
+
+uint16_t ustream_underruns;
+uint16_t ustream_overruns;
+
+static const char ustream_request[] PROGMEM =
+	"GET " CONF_USTREAM_PATH " HTTP/1.0\r\n"
+	"Icy-MetaData: 0\r\n"
+	"\r\n";
+
+uint16_t ustream_fill(void)
+{
+	if (ustream_head >= ustream_tail)
+		return ustream_head - ustream_tail;
+	return USTREAM_BUFFER_LEN - ustream_tail + ustream_head;
+}
+
+static uint16_t ustream_free(void)
+{
+	return USTREAM_BUFFER_LEN - 1 - ustream_fill();
+}
+
+static void ustream_store(const uint8_t *data, uint16_t len)
+{
+	uint16_t free = ustream_free();
+	if (len > free)
+	{
+		USTREAMDEBUG("buffer overrun, %u bytes lost\n", len - free);
+		ustream_overruns++;
+		len = free;
+	}
+
+	uint16_t span = USTREAM_BUFFER_LEN - ustream_head;
+	if (span > len)
+		span = len;
+	memcpy(ustream_buf + ustream_head, data, span);
+	memcpy(ustream_buf, data + span, len - span);
+
+	ustream_head += len;
+	if (ustream_head >= USTREAM_BUFFER_LEN)
+		ustream_head -= USTREAM_BUFFER_LEN;
+}
+
+/* Skip the HTTP/ICY response header, returns the number of bytes eaten. */
+static uint16_t ustream_skip_header(const char *data, uint16_t len)
+{
+	uint16_t i = 0;
+
+	/* status line, "HTTP/1.x 200 OK" or "ICY 200 OK" */
+	while (ustream_status < USTREAM_STATUS_OK && i < len)
+	{
+		char c = data[i++];
+		if (ustream_status == 0)
+		{
+			if (c == ' ')
+				ustream_status++;
+			continue;
+		}
+		if (c != (ustream_status == 1 ? '2' : '0'))
+		{
+			USTREAMDEBUG("server refused stream\n");
+			uip_close();
+			return len;
+		}
+		if (++ustream_status == USTREAM_STATUS_OK)
+			ustream_streaming = 1;
+	}
+
+	for (; i < len && ustream_header < USTREAM_HEADER_DONE; i++)
+	{
+		char expect = (ustream_header & 1) ? '\n' : '\r';
+		if (data[i] == expect)
+			ustream_header++;
+		else
+			ustream_header = (data[i] == '\r') ? 1 : 0;
+	}
+	return i;
+}
+
 void ustream_main(void)
 {
-	if(uip_connected() || uip_rexmit())
+	if (uip_aborted() || uip_timedout() || uip_closed())
+	{
+		USTREAMDEBUG("connection closed\n");
+		ustream_conn = NULL;
+		ustream_eof = 1;
+
+		if (ustream_streaming)
+			ustream_backoff_next = 1;
+		else
+		{
+			ustream_backoff = ustream_backoff_next;
+			if (ustream_backoff_next < USTREAM_BACKOFF_MAX)
+				ustream_backoff_next *= 2;
+			USTREAMDEBUG("retry in %u0s\n", ustream_backoff);
+		}
+		ustream_streaming = 0;
+		return;
+	}
+
+	if (uip_connected())
+	{
+		ustream_header = 0;
+		ustream_status = 0;
+		ustream_head = ustream_tail = 0;
+		ustream_prebuffer = 1;
+		ustream_eof = 0;
+	}
+
+	if (uip_connected() || uip_rexmit())
 	{
-		uip_send(USTREAM_URI, strlen(USTREAM_URI));
+		uip_send(uip_sappdata, strlen_P(ustream_request));
+		memcpy_P(uip_sappdata, ustream_request, uip_slen);
 		return;
 	}
 
-	if(uip_newdata())
+	if (uip_newdata())
+	{
+		uint8_t *data = uip_appdata;
+		uint16_t len = uip_len;
+
+		if (ustream_header < USTREAM_HEADER_DONE)
+		{
+			uint16_t skip = ustream_skip_header((char *) data, len);
+			data += skip;
+			len -= skip;
+		}
+		if (len)
+			ustream_store(data, len);
+	}
+
+	/* Back-pressure the server: only advertise what is left in the
+	 * jitter buffer. A window of 0 would select the default window,
+	 * so stop the connection instead. ustream_process polls it once
+	 * there is room again. */
+	uint16_t free = ustream_free();
+	if (free >= uip_mss())
+	{
+		uip_conn->wnd = free;
+		if (uip_poll() && uip_stopped(uip_conn))
+			uip_restart();
+	}
+	else
+		uip_stop();
+}
+
+/* Feed the decoder with 32 byte bursts as long as it requests data. */
+void ustream_process(void)
+{
+	if (ustream_prebuffer)
+	{
+		/* the tail of an ended stream won't fill the buffer anymore */
+		if (ustream_fill() < USTREAM_PREBUFFER
+		    && !(ustream_eof && ustream_fill()))
+			return;
+		USTREAMDEBUG("prebuffering done\n");
+		ustream_prebuffer = 0;
+	}
+
+	/* limit the bursts per call to keep the main loop going */
+	for (uint8_t i = 0; i < USTREAM_BURSTS && vs1053_ready(); i++)
+	{
+		uint16_t len = ustream_fill();
+		if (len == 0)
+		{
+			if (!ustream_eof)
+			{
+				USTREAMDEBUG("buffer underrun\n");
+				ustream_underruns++;
+			}
+			ustream_prebuffer = 1;
+			break;
+		}
+
+		if (len > VS1053_SDI_BURST)
+			len = VS1053_SDI_BURST;
+		if (len > USTREAM_BUFFER_LEN - ustream_tail)
+			len = USTREAM_BUFFER_LEN - ustream_tail;
+
+		vs1053_sdi_write(ustream_buf + ustream_tail, len);
+
+		ustream_tail += len;
+		if (ustream_tail >= USTREAM_BUFFER_LEN)
+			ustream_tail = 0;
+	}
+
+	/* Reopen a stopped connection right away, waiting for the next
+	 * periodic poll would let the buffer run dry. */
+	if (ustream_conn && uip_stopped(ustream_conn)
+	    && ustream_free() >= ustream_conn->mss)
 	{
-		// TBD: Push data to VS1053
-		((char *) uip_appdata)[uip_len] = 0;
-		printf("Got some data.\n");
+		uip_stack_set_active(ustream_conn->stack);
+		uip_poll_conn(ustream_conn);
+		if (uip_len > 0)
+			router_output();
 	}
 }
 
 
 void ustream_periodic(void)
 {
-  if (!ustream_conn) ustream_init();
+  if (ustream_conn)
+    return;
+  if (ustream_backoff)
+    ustream_backoff--;
+  else
+    ustream_init();
 }
 
 void ustream_init(void)
@@ -76,6 +291,7 @@ void ustream_init(void)
   -- Ethersex META --
   header(protocols/ustream/ustream.h)
   net_init(ustream_init)
+  mainloop(ustream_process)
   timer(500, ustream_periodic())
 */
 
@@ -22,12 +22,25 @@
 #ifndef HAVE_USTREAM_H
 #define HAVE_USTREAM_H
 
-#define USTREAM_URI "GET /stream/1010 HTTP/1.0\r\n\r\n"
+#include <stdint.h>
+
+#include "config.h"
+
+/* start feeding the decoder when the jitter buffer is half full */
+#define USTREAM_PREBUFFER (USTREAM_BUFFER_LEN / 2)
+/* max. number of SDI bursts per main loop pass */
+#define USTREAM_BURSTS 8
+/* max. number of periodic calls (10s each) to wait before reconnecting
+   to a server that refused the stream or could not be reached */
+#define USTREAM_BACKOFF_MAX 64
 
 void ustream_init (void);
 void ustream_periodic(void);
+void ustream_process(void);
+uint16_t ustream_fill(void);
 
-#include "config.h"
+extern uint16_t ustream_underruns;
+extern uint16_t ustream_overruns;
 #ifdef DEBUG_USTREAM
 # include "core/debug.h"
 # define USTREAMDEBUG(a...)  debug_printf("ustream: " a)
@@ -47,10 +47,19 @@ int16_t parse_cmd_ustream_test(char *cmd, char *output, uint16_t len)
   return ECMD_FINAL_OK;
 }
 
+int16_t parse_cmd_ustream_stats(char *cmd, char *output, uint16_t len)
+{
+  return ECMD_FINAL(snprintf_P(output, len,
+                               PSTR("fill %u/%u under %u over %u"),
+                               ustream_fill(), USTREAM_BUFFER_LEN - 1,
+                               ustream_underruns, ustream_overruns));
+}
+
 
 /*
   -- Ethersex META --
   block(Ustream Client)
   ecmd_feature(ustream_init, ``"ustream init"'',,ustream service re-initialization)
   ecmd_feature(ustream_test, ``"ustream test"'',,test ustream service)
+  ecmd_feature(ustream_stats, ``"ustream stats"'',,show jitter buffer fill and underrun/overrun counters)
 */
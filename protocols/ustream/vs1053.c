@@ -20,6 +20,7 @@
  * THE SOFTWARE.
 */
 #include <avr/io.h>
+#include "config.h"
 #include "vs1053.h"
 #include "core/spi.h"
 
@@ -82,3 +83,42 @@ void vs1053_sinetest(char pitch)
 
 	cs_low();
 }	
+
+void vs1053_init(void)
+{
+	/* Without a separate data chip select the decoder shares XCS,
+	 * SDI is then selected while XCS is high. */
+#ifdef HAVE_VS1053_DCS
+	PIN_SET(VS1053_DCS);
+	sci_write(0x00, (1<<SM_SDINEW));
+#else
+	sci_write(0x00, (1<<SM_SDISHARE)|(1<<SM_SDINEW));
+#endif
+}
+
+uint8_t vs1053_ready(void)
+{
+	return PIN_HIGH(VS1053_DREQ) ? 1 : 0;
+}
+
+void vs1053_sdi_write(const uint8_t *data, uint8_t len)
+{
+#ifdef HAVE_VS1053_DCS
+	PIN_CLEAR(VS1053_DCS);
+#else
+	cs_high();
+#endif
+
+	while (len--)
+		spi_send(*data++);
+
+#ifdef HAVE_VS1053_DCS
+	PIN_SET(VS1053_DCS);
+#endif
+}
+
+/*
+  -- Ethersex META --
+  header(protocols/ustream/vs1053.h)
+  init(vs1053_init)
+*/
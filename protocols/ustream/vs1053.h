@@ -23,6 +23,8 @@
 #ifndef _VS1053_H_
 #define _VS1053_H_
 
+#include <stdint.h>
+
 // SCI_MODE defines for the VS1053
 #define SM_DIFF 0 // Differential
 #define SM_LAYER12 1 // Allow MPEG layers I&II
@@ -40,9 +42,14 @@
 #define SM_LINE1 14 // MIC/LINE1 selector
 #define SM_CLK_RANGE 15 // Input clock range
 
+#define VS1053_SDI_BURST 32		// bytes accepted per DREQ high
+
 int sci_read(char addr);		// Read
 void sci_write(char addr, int data);	// Write
 void vs1053_sinetest(char pitch);	// Sinewave
+void vs1053_init(void);			// Enable SDI stream mode
+uint8_t vs1053_ready(void);		// DREQ high, room for a burst
+void vs1053_sdi_write(const uint8_t *data, uint8_t len); // Stream data
 
 void cs_high(void);			// Set CS high
 void cs_low(void);			// Set CS low
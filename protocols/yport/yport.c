@@ -51,46 +51,127 @@ uint16_t yport_eth_retransmit;
 uint8_t yport_lf;
 #endif
 
+#ifdef YPORT_FLOWCONTROL
+#ifndef HAVE_YPORT_RTS
+#error "YPort flow control needs YPORT_RTS and YPORT_CTS pins in pinning"
+#endif
+/* RTS is active low: a high level asks the other side to pause */
+#define yport_rts_stop()	PIN_SET(YPORT_RTS)
+#define yport_rts_go()		PIN_CLEAR(YPORT_RTS)
+#define yport_cts_blocked()	PIN_HIGH(YPORT_CTS)
+#endif
+
 void yport_init(void)
 {
   usart_init();
+#ifdef YPORT_FLOWCONTROL
+  DDR_CONFIG_OUT(YPORT_RTS);
+  DDR_CONFIG_IN(YPORT_CTS);
+  yport_rts_go();
+#endif
 }
 
-uint8_t
-yport_rxstart(uint8_t * data, uint16_t len)
+/* Start transmission of the send buffer if the usart is idle. */
+static void
+yport_txstart(void)
 {
-  uint16_t diff = yport_send_buffer.len - yport_send_buffer.sent;
-  if (diff == 0)
-  {
-    /* Copy the data to the send buffer */
-    memcpy(yport_send_buffer.data, data, len);
-    yport_send_buffer.len = len;
-    goto start_sending;
-    /* The actual packet can be pushed into the buffer */
-  }
-  else if ((diff + len) < YPORT_BUFFER_LEN)
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
-    memmove(yport_send_buffer.data,
-            yport_send_buffer.data + yport_send_buffer.sent, diff);
-    memcpy(yport_send_buffer.data + diff, data, len);
-    yport_send_buffer.len = diff + len;
-    goto start_sending;
+    if (usart(UCSR, B) & _BV(usart(TXCIE)))
+      return;
+    uint16_t tail = yport_send_buffer.tail;
+    if (tail == yport_send_buffer.head)
+      return;
+#ifdef YPORT_FLOWCONTROL
+    if (yport_cts_blocked())
+      return;
+#endif
+    /* Enable the tx interrupt and send the first character */
+    usart(UCSR, B) |= _BV(usart(TXCIE));
+    usart(UDR) = yport_send_buffer.data[tail];
+    yport_send_buffer.tail = yport_index_add(tail, 1);
   }
-  return 0;
-start_sending:
-  yport_send_buffer.sent = 1;
-  /* Enable the tx interrupt and send the first character */
-  usart(UCSR, B) |= _BV(usart(TXCIE));
-  usart(UDR) = yport_send_buffer.data[0];
+}
+
+uint16_t
+yport_rxfree(void)
+{
+  return YPORT_BUFFER_LEN - 1 -
+    yport_buffer_fill(yport_send_buffer.head,
+                      yport_index_get(&yport_send_buffer.tail));
+}
+
+uint8_t
+yport_rxstart(uint8_t * data, uint16_t len)
+{
+  if (len > yport_rxfree())
+    return 0;
+
+  /* Copy the data to the send buffer, wrapping around at its end */
+  uint16_t head = yport_send_buffer.head;
+  uint16_t span = YPORT_BUFFER_LEN - head;
+  if (span > len)
+    span = len;
+  memcpy(yport_send_buffer.data + head, data, span);
+  memcpy(yport_send_buffer.data, data + span, len - span);
+  yport_index_set(&yport_send_buffer.head, yport_index_add(head, len));
+
+  yport_txstart();
   return 1;
 }
 
+/* Copy up to len not yet acked bytes of the receive buffer to dest. */
+uint16_t
+yport_txcopy(uint8_t * dest, uint16_t len)
+{
+  uint16_t tail = yport_recv_buffer.tail;
+  uint16_t fill = yport_buffer_fill(yport_index_get(&yport_recv_buffer.head),
+                                    tail);
+  if (len > fill)
+    len = fill;
+
+  uint16_t span = YPORT_BUFFER_LEN - tail;
+  if (span > len)
+    span = len;
+  memcpy(dest, yport_recv_buffer.data + tail, span);
+  memcpy(dest + span, yport_recv_buffer.data, len - span);
+  return len;
+}
+
+/* Release len bytes of the receive buffer after they have been acked. */
+void
+yport_txack(uint16_t len)
+{
+  yport_index_set(&yport_recv_buffer.tail,
+                  yport_index_add(yport_recv_buffer.tail, len));
+#ifdef YPORT_FLOWCONTROL
+  if (yport_buffer_fill(yport_index_get(&yport_recv_buffer.head),
+                        yport_recv_buffer.tail) < YPORT_HIGH_WATER)
+    yport_rts_go();
+#endif
+}
+
+#ifdef YPORT_FLOWCONTROL
+void
+yport_periodic(void)
+{
+  /* the other side may have released CTS meanwhile */
+  yport_txstart();
+}
+#endif
+
 
 ISR(usart(USART, _TX_vect))
 {
-  if (yport_send_buffer.sent < yport_send_buffer.len)
+  uint16_t tail = yport_send_buffer.tail;
+  if (tail != yport_send_buffer.head
+#ifdef YPORT_FLOWCONTROL
+      && !yport_cts_blocked()
+#endif
+    )
   {
-    usart(UDR) = yport_send_buffer.data[yport_send_buffer.sent++];
+    usart(UDR) = yport_send_buffer.data[tail];
+    yport_send_buffer.tail = yport_index_add(tail, 1);
   }
   else
   {
@@ -119,8 +200,18 @@ ISR(usart(USART, _RX_vect))
     else
     {
       uint8_t v = usart(UDR);
-      if (yport_recv_buffer.len < YPORT_BUFFER_LEN)
-        yport_recv_buffer.data[yport_recv_buffer.len++] = v;
+      uint16_t head = yport_recv_buffer.head;
+      uint16_t next = yport_index_add(head, 1);
+      if (next != yport_recv_buffer.tail)
+      {
+        yport_recv_buffer.data[head] = v;
+        yport_recv_buffer.head = next;
+#ifdef YPORT_FLOWCONTROL
+        if (yport_buffer_fill(next, yport_recv_buffer.tail) >=
+            YPORT_HIGH_WATER)
+          yport_rts_stop();
+#endif
+      }
 #ifdef DEBUG_YPORT
       else
         yport_rx_bufferfull++;
@@ -142,4 +233,5 @@ ISR(usart(USART, _RX_vect))
   header(protocols/yport/yport.h)
 
   net_init(yport_init)
+  ifdef(`conf_YPORT_FLOWCONTROL', `timer(1, yport_periodic())')
 */
@@ -25,15 +25,65 @@
 #define _YPORT_H
 
 
+#include <util/atomic.h>
+
+/* Single producer, single consumer ring buffer.  One side only ever
+ * writes 'head', the other one only 'tail', so no locking is needed apart
+ * from accessing the 16 bit indices atomically outside of the ISRs.
+ * For yport_recv_buffer (usart -> tcp) the bytes between 'tail' and
+ * 'tail + sent' have been sent via tcp but are not acked yet. */
 struct yport_buffer
 {
-  uint16_t len;
+  volatile uint16_t head;
+  volatile uint16_t tail;
   uint16_t sent;
   uint8_t data[YPORT_BUFFER_LEN];
 };
 
+static inline uint16_t
+yport_index_get(volatile uint16_t * index)
+{
+  uint16_t i;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    i = *index;
+  }
+  return i;
+}
+
+static inline void
+yport_index_set(volatile uint16_t * index, uint16_t i)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    *index = i;
+  }
+}
+
+static inline uint16_t
+yport_index_add(uint16_t index, uint16_t n)
+{
+  index += n;
+  if (index >= YPORT_BUFFER_LEN)
+    index -= YPORT_BUFFER_LEN;
+  return index;
+}
+
+/* number of bytes stored between 'tail' and 'head' */
+static inline uint16_t
+yport_buffer_fill(uint16_t head, uint16_t tail)
+{
+  return head >= tail ? head - tail : YPORT_BUFFER_LEN - tail + head;
+}
+
 void yport_init(void);
 uint8_t yport_rxstart(uint8_t * data, uint16_t len);
+uint16_t yport_rxfree(void);
+uint16_t yport_txcopy(uint8_t * dest, uint16_t len);
+void yport_txack(uint16_t len);
+#ifdef YPORT_FLOWCONTROL
+void yport_periodic(void);
+#endif
 
 extern struct yport_buffer yport_send_buffer;
 extern struct yport_buffer yport_recv_buffer;
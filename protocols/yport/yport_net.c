@@ -22,7 +22,6 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <util/atomic.h>
 #include <string.h>
 #include "yport_net.h"
 #include "protocols/uip/uip.h"
@@ -54,7 +53,7 @@ yport_net_main(void)
     if (yport_conn == NULL)
     {
       yport_conn = uip_conn;
-      uip_conn->wnd = YPORT_BUFFER_LEN - 1;
+      yport_recv_buffer.sent = 0;
     }
     else
       /* if we already have a connection, send an error */
@@ -67,14 +66,9 @@ yport_net_main(void)
       uip_close();
     else
     {
-      /* data we have sent was acked */
-      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-      {
-        yport_recv_buffer.len -= yport_recv_buffer.sent;
-        memmove(yport_recv_buffer.data,
-                yport_recv_buffer.data + yport_recv_buffer.sent,
-                yport_recv_buffer.len);
-      }
+      /* data we have sent was acked, release it from the ring */
+      yport_txack(yport_recv_buffer.sent);
+      yport_recv_buffer.sent = 0;
     }
   }
   else if (uip_closed() || uip_aborted() || uip_timedout())
@@ -85,21 +79,29 @@ yport_net_main(void)
   }
   else if (uip_newdata())
   {
-    if (uip_len <= YPORT_BUFFER_LEN &&
-        yport_rxstart(uip_appdata, uip_len) != 0)
+    if (yport_rxstart(uip_appdata, uip_len) == 0)
     {
       /* prevent the other side from sending more data via tcp */
       uip_stop();
     }
   }
 
-  /* retransmit last packet */
-  if (uip_rexmit() && yport_conn == uip_conn)
+  if (yport_conn != uip_conn)
+    return;
+
+  /* advertise the free space of the serial send buffer as tcp window,
+   * a window of 0 would select the default window, so stop instead */
+  uint16_t free = yport_rxfree();
+  if (free)
+    uip_conn->wnd = free;
+  else
+    uip_stop();
+
+  /* retransmit last packet, it is still at the tail of the ring */
+  if (uip_rexmit())
   {
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-    {
-      uip_send(yport_recv_buffer.data, yport_recv_buffer.sent);
-    }
+    uip_send(uip_sappdata, yport_txcopy(uip_sappdata,
+                                        yport_recv_buffer.sent));
 #ifdef DEBUG_YPORT
     yport_eth_retransmit++;
 #endif
@@ -109,16 +111,16 @@ yport_net_main(void)
 
     /* restart connection */
     if (uip_poll()
-        && yport_conn == uip_conn
         && uip_stopped(yport_conn)
-        && yport_send_buffer.sent == yport_send_buffer.len)
+        && free >= uip_mss())
       uip_restart();
 
     /* send data */
-    if ((uip_poll() || uip_acked()) && yport_conn == uip_conn
+    if ((uip_poll() || uip_acked()) && yport_recv_buffer.sent == 0
         /* receive buffer reached water mark */
 #if YPORT_FLUSH > 0
-        && (yport_recv_buffer.len > (YPORT_BUFFER_LEN / 4)
+        && (yport_buffer_fill(yport_index_get(&yport_recv_buffer.head),
+                              yport_recv_buffer.tail) > (YPORT_BUFFER_LEN / 4)
             /* last transmission is at least one second ago */
             || yport_lastservice >= YPORT_FLUSH
             /* we received a linefeed character, send immediately */
@@ -126,16 +128,13 @@ yport_net_main(void)
 #endif
       )
     {
-      /* we have enough uart data, send it via tcp */
-      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-      {
-        uip_send(yport_recv_buffer.data, yport_recv_buffer.len);
-        yport_recv_buffer.sent = yport_recv_buffer.len;
+      /* we have enough uart data, send it via tcp straight from the ring */
+      yport_recv_buffer.sent = yport_txcopy(uip_sappdata, uip_mss());
+      uip_send(uip_sappdata, yport_recv_buffer.sent);
 #if YPORT_FLUSH > 0
-        yport_lastservice = 0;
-        yport_lf = 0;
+      yport_lastservice = 0;
+      yport_lf = 0;
 #endif
-      }
     }
   }
 }
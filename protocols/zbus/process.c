@@ -47,7 +47,6 @@ zbus_process(void)
     router_output ();
 
     uip_buf_unlock ();
-    zbus_rxstart ();
     return;
   }
 #endif
@@ -56,8 +55,6 @@ zbus_process(void)
 
 #endif
 
-  zbus_rxstart ();
-
   router_input (STACK_ZBUS);
 
   if (!uip_len) {
@@ -69,6 +66,7 @@ zbus_process(void)
   router_output ();
 
   uip_len = 0;
+  uip_buf_unlock ();
 }
 
 /*
@@ -24,6 +24,7 @@
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <util/delay.h>
+#include <string.h>
 #include "config.h"
 #include "core/heartbeat.h"
 #include "protocols/zbus/zbus_raw_net.h"
@@ -47,11 +48,47 @@
 generate_usart_init ()
 static uint8_t send_escape_data = 0;
 static uint8_t recv_escape_data = 0;
-static uint8_t bus_blocked = 0;
+static volatile uint8_t bus_blocked = 0;
 
-static volatile zbus_index_t zbus_index;
+struct zbus_frame
+{
+  zbus_index_t len;
+  uint8_t data[ZBUS_BUFFER_LEN];
+};
+
+/* A frame is received into the uip buffer if it is free, into the extra
+   buffer otherwise.  The extra one is only used while it is empty and
+   handed out after a frame waiting in the uip buffer, so the frames stay
+   in order. */
+enum
+{
+  ZBUS_RX_DROP,
+  ZBUS_RX_UIP,
+  ZBUS_RX_EXTRA,
+};
+static struct zbus_frame zbus_rx_frame;
+static volatile uint8_t zbus_rx_target;
+static volatile zbus_index_t zbus_rxlen;	/* frame waiting in uip_buf */
+static volatile zbus_index_t zbus_rx_index;
+
+#if ZBUS_TX_QUEUE
+/* Frames waiting for the bus, the one at zbus_txq_head is sent first. */
+static struct zbus_frame zbus_tx_frames[ZBUS_TX_QUEUE];
+static volatile uint8_t zbus_txq_head;
+static volatile uint8_t zbus_txq_count;
+#define zbus_tx_pending()  (zbus_txq_count > 0)
+#define zbus_tx_data       (zbus_tx_frames[zbus_txq_head].data)
+#define zbus_tx_len        (zbus_tx_frames[zbus_txq_head].len)
+#else
+/* The frame is sent from the uip buffer, which stays locked meanwhile. */
 volatile zbus_index_t zbus_txlen;
-static volatile zbus_index_t zbus_rxlen;
+#define zbus_tx_pending()  (zbus_txlen > 0)
+#define zbus_tx_data       zbus_buf
+#define zbus_tx_len        zbus_txlen
+#endif
+static volatile uint8_t zbus_tx_state;	/* 0 idle, 1 data, 2 stop */
+static volatile zbus_index_t zbus_tx_index;
+
 #ifdef ZBUS_ECMD
 uint16_t zbus_rx_frameerror;
 uint16_t zbus_rx_overflow;
@@ -59,26 +96,71 @@ uint16_t zbus_rx_parityerror;
 uint16_t zbus_rx_bufferfull;
 uint16_t zbus_rx_count;
 uint16_t zbus_tx_count;
+uint16_t zbus_tx_dropped;
 #endif
 
 static void __zbus_txstart (void);
 
+#if ZBUS_TX_QUEUE
 void
 zbus_txstart (zbus_index_t size)
 {
-  // FIXME
-  if (zbus_txlen != 0 || zbus_rxlen != 0 || bus_blocked)
-    return;			/* rx or tx in action or
-				   new packet left in buffer
-				   or somebody is talking on the line */
-  zbus_index = 0;
+  if (size > ZBUS_BUFFER_LEN)
+    return;
 
-  zbus_txlen = size;
+  uint8_t sreg = SREG;
+  cli ();
+  uint8_t slot = zbus_txq_head + zbus_txq_count;
+  uint8_t full = zbus_txq_count == ZBUS_TX_QUEUE;
+  SREG = sreg;
 
-  if (bus_blocked)
-    return;
-  __zbus_txstart ();
+  if (full)
+    {
+#ifdef ZBUS_ECMD
+      zbus_tx_dropped++;
+#endif
+      return;			/* queue full, drop the frame */
+    }
+  if (slot >= ZBUS_TX_QUEUE)
+    slot -= ZBUS_TX_QUEUE;
+
+  /* The frame is copied, so the uip buffer is free again right away. */
+  memcpy (zbus_tx_frames[slot].data, zbus_buf, size);
+  zbus_tx_frames[slot].len = size;
+
+  cli ();
+  zbus_txq_count++;
+  /* Go unless we're sending already or somebody is talking on the
+     line, the frame is picked up when the bus is free. */
+  if (!zbus_tx_state && !bus_blocked)
+    __zbus_txstart ();
+  SREG = sreg;
 }
+#else
+void
+zbus_txstart (zbus_index_t size)
+{
+  uint8_t sreg = SREG;
+  cli ();
+  if (zbus_txlen != 0 || zbus_rxlen != 0 || zbus_rx_target == ZBUS_RX_UIP)
+    {
+      SREG = sreg;
+#ifdef ZBUS_ECMD
+      zbus_tx_dropped++;
+#endif
+      return;			/* the uip buffer holds another frame */
+    }
+
+  /* Keep the buffer until the frame is out, the caller may hold the
+     lock already. */
+  uip_buf_lock ();
+  zbus_txlen = size;
+  /* Wait for the bus if somebody is talking on the line. */
+  if (!bus_blocked)
+    __zbus_txstart ();
+  SREG = sreg;
+}
+#endif
 
 static void
 __zbus_txstart (void)
@@ -87,6 +169,8 @@ __zbus_txstart (void)
   uint8_t sreg = SREG;
   cli ();
   bus_blocked = 3;
+  zbus_tx_state = 1;
+  zbus_tx_index = 0;
 
   /* enable transmitter and receiver as well as their interrupts */
   usart (UCSR, B) = _BV (usart (TXCIE)) | _BV (usart (TXEN));
@@ -118,11 +202,10 @@ __zbus_txstart (void)
 void
 zbus_rxstart (void)
 {
-  if (zbus_txlen > 0)
+  if (zbus_tx_state)
     {
       return;
     }
-  zbus_rxlen = 0;
 
   uint8_t sreg = SREG;
   cli ();
@@ -139,23 +222,35 @@ zbus_rxstart (void)
 }
 
 
-static void
-zbus_rxstop (void)
+/* Hand the oldest received frame over in the uip buffer, which is locked
+   then.  Returns the length of the frame, 0 if there is none or the
+   buffer is in use. */
+zbus_index_t
+zbus_rxfinish (void)
 {
   uint8_t sreg = SREG;
   cli ();
+  zbus_index_t len = zbus_rxlen;
+  if (len)
+    {
+      /* received in place, the buffer is locked since */
+      zbus_rxlen = 0;
+      SREG = sreg;
+      return len;
+    }
+  len = zbus_rx_frame.len;
+  SREG = sreg;
 
-  /* completely disable usart */
-  usart (UCSR, B) = 0;
+  if (len == 0 || uip_buf_lock ())
+    return 0;
 
-  SREG = sreg;
-}
+  memcpy (zbus_buf, zbus_rx_frame.data, len);
 
+  cli ();
+  zbus_rx_frame.len = 0;
+  SREG = sreg;
 
-zbus_index_t
-zbus_rxfinish (void)
-{
-  return zbus_rxlen;
+  return len;
 }
 
 void
@@ -169,20 +264,18 @@ zbus_core_init (void)
   DDR_CONFIG_OUT (ZBUS_RXTX_PIN);
 #endif
 
-  /* clear the buffers */
-  zbus_txlen = 0;
-  zbus_rxlen = 0;
-  zbus_index = 0;
-
   zbus_rxstart ();
 }
 
 void
 zbus_core_periodic (void)
 {
+  uint8_t sreg = SREG;
+  cli ();
   if (bus_blocked)
-    if (--bus_blocked == 0 && zbus_txlen > 0)
+    if (--bus_blocked == 0 && zbus_tx_pending () && !zbus_tx_state)
       __zbus_txstart ();
+  SREG = sreg;
 }
 
 
@@ -190,11 +283,6 @@ zbus_core_periodic (void)
 
 ISR (usart (USART, _TX_vect))
 {
-
-#ifdef ZBUS_DEBUG
-  ZBUS_DEBUG ("send data: %s\n", uip_appdata);
-#endif
-
   /* If there's a carry byte, send it! */
   if (send_escape_data)
     {
@@ -205,13 +293,13 @@ ISR (usart (USART, _TX_vect))
       send_escape_data = 0;
     }
 
-  /* Otherwise send data from send context, if any is left. */
-  else if (zbus_txlen && zbus_index < zbus_txlen)
+  /* Otherwise send data of the current frame, if any is left. */
+  else if (zbus_tx_state == 1 && zbus_tx_index < zbus_tx_len)
     {
-      if (zbus_buf[zbus_index] == '\\')
+      if (zbus_tx_data[zbus_tx_index] == '\\')
 	{
 	  /* We need to quote the character. */
-	  send_escape_data = zbus_buf[zbus_index];
+	  send_escape_data = zbus_tx_data[zbus_tx_index];
 #ifdef ZBUS_ECMD
 	  zbus_tx_count++;
 #endif
@@ -223,19 +311,26 @@ ISR (usart (USART, _TX_vect))
 #ifdef ZBUS_ECMD
 	  zbus_tx_count++;
 #endif
-	  usart (UDR) = zbus_buf[zbus_index];
+	  usart (UDR) = zbus_tx_data[zbus_tx_index];
 	}
 
-      zbus_index++;
+      zbus_tx_index++;
       bus_blocked = 3;
     }
 
-  /* If send_ctx contains data, but every byte has been sent over the
-     wires, send a stop condition. */
-  else if (zbus_txlen)
+  /* Every byte of the frame has been sent over the wires, release its
+     buffer and send a stop condition. */
+  else if (zbus_tx_state == 1)
     {
+      zbus_tx_state = 2;
+#if ZBUS_TX_QUEUE
+      if (++zbus_txq_head == ZBUS_TX_QUEUE)
+	zbus_txq_head = 0;
+      zbus_txq_count--;
+#else
       zbus_txlen = 0;		/* mark buffer as empty. */
       uip_buf_unlock ();
+#endif
 
       /* Generate the stop condition. */
       send_escape_data = ZBUS_STOP;
@@ -245,18 +340,18 @@ ISR (usart (USART, _TX_vect))
       usart (UDR) = '\\';
     }
 
-
-
-
-  /* Nothing to do, disable transmitter and TX LED. */
+  /* Frame complete, go on with the next one or back to receiving. */
   else
     {
       bus_blocked = 0;
 #ifdef STATUSLED_ZBUS_TX_SUPPORT
       PIN_CLEAR (STATUSLED_ZBUS_TX);
 #endif
-      zbus_txlen = 0;
-      zbus_rxstart ();
+      zbus_tx_state = 0;
+      if (zbus_tx_pending ())
+	__zbus_txstart ();
+      else
+	zbus_rxstart ();
     }
 }
 
@@ -266,12 +361,6 @@ ISR (usart (USART, _RX_vect))
   uint8_t flags = usart (UCSR, A);
   if (flags & (_BV (usart (FE)) | _BV (usart (DOR)) | _BV (usart (UPE))))
     {
-
-#ifdef ZBUS_DEBUG
-      ZBUS_DEBUG ("received data: %s\n", uip_appdata);
-#endif
-
-
 #ifdef ZBUS_ECMD
       if (flags & _BV (usart (FE)))
 	zbus_rx_frameerror++;
@@ -288,45 +377,53 @@ ISR (usart (USART, _RX_vect))
   zbus_rx_count++;
 #endif
 
-
-  /* Old data is not read by application, ignore message */
-  if (zbus_rxlen != 0)
-    return;
-
-  /* Don't accept incoming message if we're sending and sharing
-     send and receive buffer. */
-  if (zbus_txlen != 0)
-    return;
-
   if (recv_escape_data)
     {
       recv_escape_data = 0;
 
       if (data == ZBUS_START)
 	{
-	  if (uip_buf_lock ())
-	    return;		/* lock of buffer failed, ignore packet */
+	  /* a frame cut short by this start condition is lost */
+	  if (zbus_rx_target == ZBUS_RX_UIP)
+	    uip_buf_unlock ();
 
-	  zbus_index = 0;
-	  bus_blocked = 3;
+	  if (zbus_rx_frame.len)
+	    {
+	      zbus_rx_target = ZBUS_RX_DROP;
+#ifdef ZBUS_ECMD
+	      zbus_rx_bufferfull++;	/* no buffer, frame is ignored */
+#endif
+	    }
+	  else if (zbus_rxlen == 0 && !zbus_tx_active () && !uip_buf_lock ())
+	    zbus_rx_target = ZBUS_RX_UIP;
+	  else
+	    zbus_rx_target = ZBUS_RX_EXTRA;
 
+	  zbus_rx_index = 0;
+	  bus_blocked = 3;
 	}
 
       else if (data == ZBUS_STOP)
 	{
 	  /* Only if there was a start condition before */
-	  if (bus_blocked)
+	  if (bus_blocked && zbus_rx_index)
 	    {
-	      zbus_rxstop ();
-	      zbus_rxlen = zbus_index;
+	      if (zbus_rx_target == ZBUS_RX_UIP)
+		zbus_rxlen = zbus_rx_index;
+	      else if (zbus_rx_target == ZBUS_RX_EXTRA)
+		zbus_rx_frame.len = zbus_rx_index;
 	    }
+	  else if (zbus_rx_target == ZBUS_RX_UIP)
+	    uip_buf_unlock ();
+	  zbus_rx_target = ZBUS_RX_DROP;
+	  zbus_rx_index = 0;
 #ifdef STATUSLED_ZBUS_RX_SUPPORT
 	  PIN_CLEAR (STATUSLED_ZBUS_RX);
 #endif
 
 	  /* force bus free even if we didn't catch the start condition. */
 	  bus_blocked = 0;
-	  if (zbus_txlen > 0)
+	  if (zbus_tx_pending ())
 	    __zbus_txstart ();
 	}
 
@@ -346,22 +443,32 @@ ISR (usart (USART, _RX_vect))
   else
     {
     append_data:
-      /* Not enough space in buffer */
-      if (zbus_index >= ZBUS_BUFFER_LEN)
+      /* If bus is not blocked we aren't on an message */
+      if (!bus_blocked)
+	return;
+
+      bus_blocked = 3;
+
+      if (zbus_rx_target == ZBUS_RX_DROP)
+	return;
+
+      /* Not enough space in buffer, the frame is dropped as a whole */
+      if (zbus_rx_index >= ZBUS_BUFFER_LEN)
 	{
 #ifdef ZBUS_ECMD
 	  zbus_rx_bufferfull++;
 #endif
+	  if (zbus_rx_target == ZBUS_RX_UIP)
+	    uip_buf_unlock ();
+	  zbus_rx_target = ZBUS_RX_DROP;
 	  return;
 	}
 
-      /* If bus is not blocked we aren't on an message */
-      if (!bus_blocked)
-	return;
-
-      bus_blocked = 3;
-      zbus_buf[zbus_index] = data;
-      zbus_index++;
+      if (zbus_rx_target == ZBUS_RX_UIP)
+	zbus_buf[zbus_rx_index] = data;
+      else
+	zbus_rx_frame.data[zbus_rx_index] = data;
+      zbus_rx_index++;
     }
 }
 
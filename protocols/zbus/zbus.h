@@ -48,14 +48,27 @@ typedef uint16_t zbus_index_t;
 #  define ZBUS_BAUDRATE CONF_ZBUS_BAUDRATE
 #endif
 
+/* number of frames waiting for the bus, each takes ZBUS_BUFFER_LEN;
+   without a queue the frame waits in the uip buffer */
+#ifndef ZBUS_TX_QUEUE
+#  define ZBUS_TX_QUEUE 0
+#endif
+
+#if ZBUS_TX_QUEUE
+/* Frames are copied to the transmit queue, so the uip buffer is never
+   held by an outgoing frame. */
+#define zbus_tx_active()  (0)
+#else
 extern volatile zbus_index_t zbus_txlen;
 #define zbus_tx_active()  (zbus_txlen > 0)
+#endif
 extern uint16_t zbus_rx_frameerror;
 extern uint16_t zbus_rx_overflow;
 extern uint16_t zbus_rx_parityerror;
 extern uint16_t zbus_rx_bufferfull;
 extern uint16_t zbus_rx_count;
 extern uint16_t zbus_tx_count;
+extern uint16_t zbus_tx_dropped;
 
 enum ZBusEscapes {
   ZBUS_START = '0',
@@ -33,13 +33,14 @@
 int16_t parse_cmd_zbus_stats(char *cmd, char *output, uint16_t len)
 {
     int16_t chars = snprintf_P(output, len,
-		               PSTR("rx fe=%u, ov=%u, pe=%u, bf=%u, #=%u, tx #=%u"),
+		               PSTR("rx fe=%u, ov=%u, pe=%u, bf=%u, #=%u, tx #=%u, dr=%u"),
                                zbus_rx_frameerror,
                                zbus_rx_overflow,
                                zbus_rx_parityerror,
                                zbus_rx_bufferfull,
                                zbus_rx_count,
-                               zbus_tx_count);
+                               zbus_tx_count,
+                               zbus_tx_dropped);
     return ECMD_FINAL(chars);
 }
 
@@ -29,6 +29,7 @@
 #include "test.h"
 #include "core/debug.h"
 #include "core/eeprom.h"
+#include "core/pool.h"
 #include "protocols/ecmd/ecmd-base.h"
 #include "protocols/ecmd/parser.h"
 #include "services/clock/clock.h"
@@ -43,6 +44,31 @@ uint32_t last_check;
 struct cron_event_linkedlist *head;
 struct cron_event_linkedlist *tail;
 
+/* Jobs with up to CRON_POOL_EXTRA bytes of extra data are taken from a
+ * pool, larger ones and those that do not fit anymore from the heap. */
+#define CRON_POOL_SIZE (sizeof(struct cron_event_linkedlist) + CRON_POOL_EXTRA)
+POOL_DEFINE(cron_pool, CRON_POOL_SIZE, CRON_POOL_JOBS);
+
+static struct cron_event_linkedlist *
+cron_alloc(uint16_t size)
+{
+  void *job = NULL;
+  if (size <= CRON_POOL_SIZE)
+    job = pool_alloc(&cron_pool);
+  if (job == NULL)
+    job = malloc(size);
+  return job;
+}
+
+static void
+cron_free(struct cron_event_linkedlist *job)
+{
+  if (pool_contains(&cron_pool, job))
+    pool_free(&cron_pool, job);
+  else
+    free(job);
+}
+
 #ifdef CRON_PERSIST_SUPPORT
 void
 cron_load()
@@ -87,7 +113,7 @@ cron_load()
 #endif
     // try to get ram space
     wsize = sizeof(struct cron_event_linkedlist) + extrasize;
-    newone = malloc(wsize);
+    newone = cron_alloc(wsize);
 
 #ifdef DEBUG_CRON
     debug_printf
@@ -108,13 +134,13 @@ cron_load()
 #ifdef CRON_VFS_SUPPORT
     if (vfs_fseek(file, position, SEEK_SET) != 0)
     {
-      free(newone);
+      cron_free(newone);
       newone = NULL;
       goto end;
     }
     if (vfs_read(file, &newone->event, wsize) != wsize)
     {
-      free(newone);
+      cron_free(newone);
       newone = NULL;
       goto end;
     }
@@ -278,7 +304,7 @@ cron_jobinsert_callback(int8_t minute, int8_t hour, int8_t day, int8_t month,
 
   // try to get ram space
   struct cron_event_linkedlist *newone =
-    malloc(sizeof(struct cron_event_linkedlist) + extrasize);
+    cron_alloc(sizeof(struct cron_event_linkedlist) + extrasize);
 
   // no more ram available -> abort
   if (!newone)
@@ -318,7 +344,7 @@ cron_jobinsert_ecmd(int8_t minute, int8_t hour, int8_t day, int8_t month,
 
   // try to get ram space
   struct cron_event_linkedlist *newone =
-    malloc(sizeof(struct cron_event_linkedlist) + ecmdsize);
+    cron_alloc(sizeof(struct cron_event_linkedlist) + ecmdsize);
 
   // no more ram available -> abort
   if (!newone)
@@ -421,7 +447,7 @@ cron_jobrm(struct cron_event_linkedlist *job)
     job->next->prev = job->prev;
 
   // free the current element
-  free(job);
+  cron_free(job);
 
 #ifdef DEBUG_CRON
   debug_printf("cron: removed. Left %u\n", cron_jobs());
@@ -113,29 +113,38 @@ set_dmx_channel(uint8_t universe, uint16_t channel, uint8_t value)
   }
 }
 
-void
-set_dmx_channels(uint8_t * start, uint8_t universe, uint16_t len)
+uint8_t
+set_dmx_channels(const uint8_t * start, uint8_t universe, uint16_t len)
 {
+  uint8_t changed = 0;
   /* if our input is bigger than our storage */
   if (len > DMX_STORAGE_CHANNELS)
-    len = DMX_STORAGE_CHANNELS - 1;
+    len = DMX_STORAGE_CHANNELS;
 #ifdef DMX_STORAGE_DEBUG
   debug_printf("DMX STOR: set dmx_channels: Universe: %d Length: %d \n",
                universe, len);
 #endif
   if (universe < DMX_STORAGE_UNIVERSES)
   {
+    uint8_t *channels = dmx_universes[universe].channels;
+    /* only touch channels which really differ, so unchanged frames (the
+     * common case for Art-Net refreshes) don't wake up the slot owners */
     for (uint16_t i = 0; i < len; i++)
     {
-      dmx_universes[universe].channels[i] = start[i];
+      if (channels[i] == start[i])
+        continue;
+      channels[i] = start[i];
+      changed = 1;
 #ifdef DMX_STORAGE_DEBUG
       debug_printf("DMX STOR: Universe: %d chan: %d value %d \n", universe, i,
-                   dmx_universes[universe].channels[i]);
+                   channels[i]);
 #endif
     }
-    for (uint8_t i = 0; i < DMX_STORAGE_SLOTS; i++)
-      dmx_universes[universe].slots[i].slot_state = DMX_NEWVALUES;
+    if (changed)
+      for (uint8_t i = 0; i < DMX_STORAGE_SLOTS; i++)
+        dmx_universes[universe].slots[i].slot_state = DMX_NEWVALUES;
   }
+  return changed;
 }
 
 enum dmx_universe_state
@@ -106,14 +106,15 @@ uint8_t set_dmx_channel(uint8_t universe, uint16_t channel, uint8_t value);
 /**
 *	@brief Sets many channels of an universe of dmx-storage
 *
-*	After the channel has been set and the argument value is not equal to the old value
-*	the state of the universe will be changed to DMX_NEWVALUES
+*	Only channels whose value differs from the stored one are written.
+*	If at least one channel has changed the state of the universe will be
+*	changed to DMX_NEWVALUES
 *	@param *start Pointer to the head of DMX data
 *	@param universe
 *	@param len Length of the data
-*	@return none
+*	@return 1 if any channel has changed, 0 otherwise
 */
-void set_dmx_channels(uint8_t * start, uint8_t universe, uint16_t len);
+uint8_t set_dmx_channels(const uint8_t * start, uint8_t universe, uint16_t len);
 /**
 *	@brief Gets the current state of an universe for a specific slot (connection id)
 *	@param universe
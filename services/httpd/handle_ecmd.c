@@ -31,13 +31,36 @@
 # define printf(...)   ((void)0)
 #endif
 
-void
-httpd_handle_ecmd_setup (char *encoded_cmd)
-{
-    char *ptr = STATE->u.ecmd.input;
-    uint8_t maxlen = ECMD_INPUTBUF_LENGTH;
+#ifdef HTTPD_ECMD_BATCH_SUPPORT
+#if HTTPD_ECMD_BATCH_LENGTH < 2 * ECMD_OUTPUTBUF_LENGTH + 4
+#error "HTTPD_ECMD_BATCH_LENGTH must hold one escaped line of ecmd output"
+#endif
+#if HTTPD_ECMD_BATCH_LENGTH > 255
+#error "HTTPD_ECMD_BATCH_LENGTH must not exceed 255"
+#endif
+
+/* One connection at a time runs a batch, its commands and the segment
+   in flight live here instead of in the state of every connection. */
+static struct {
+    uip_conn_t *conn;
+
+    /* Commands not yet run, each zero terminated, the list ends with
+       an empty one. */
+    char batch[HTTPD_ECMD_BATCH_LENGTH];
+
+    /* Escaped output of the segment in flight. */
+    char packed[HTTPD_ECMD_BATCH_LENGTH];
+} httpd_ecmd_batch_buf;
+#endif	/* HTTPD_ECMD_BATCH_SUPPORT */
 
-    for (; *encoded_cmd && maxlen; maxlen --, ptr ++, encoded_cmd ++) {
+/* URL-decode ENCODED_CMD up to its end or the STOP character into PTR.
+   Returns a pointer to the first character not consumed, or NULL if
+   more than MAXLEN bytes (including the terminator) were needed. */
+static char *
+httpd_ecmd_decode (char *ptr, char *encoded_cmd, uint8_t maxlen, char stop)
+{
+    for (; *encoded_cmd && *encoded_cmd != stop && maxlen;
+	 maxlen --, ptr ++, encoded_cmd ++) {
 	uint8_t carry;
 
 	switch (*encoded_cmd) {
@@ -58,23 +81,23 @@ httpd_handle_ecmd_setup (char *encoded_cmd)
 	}
     }
 
-    if (maxlen == 0) {
-	printf ("httpd_ecmd: received ecmd too long.\n");
-	return;
-    }
+    if (maxlen == 0)
+	return NULL;
 
     *ptr = 0;
-    STATE->handler = httpd_handle_ecmd;
+    return encoded_cmd;
 }
 
-
-static void
-httpd_handle_ecmd_send_header (void)
+void
+httpd_handle_ecmd_setup (char *encoded_cmd)
 {
-    PASTE_RESET ();
-    PASTE_P (httpd_header_200);
-    PASTE_P (httpd_header_ecmd);
-    PASTE_SEND ();
+    if (httpd_ecmd_decode (STATE->u.ecmd.input, encoded_cmd,
+			   ECMD_INPUTBUF_LENGTH, 0) == NULL) {
+	printf ("httpd_ecmd: received ecmd too long.\n");
+	return;
+    }
+
+    STATE->handler = httpd_handle_ecmd;
 }
 
 
@@ -84,11 +107,8 @@ httpd_handle_ecmd (void)
     if (uip_acked ())
 	STATE->header_acked = 1;
 
-    if (!STATE->header_acked) {
-	httpd_handle_ecmd_send_header ();
-	return;
-    }
-
+    /* Output is kept in STATE->u.ecmd.output until it has been acked,
+       a retransmission just sends it (and the header) once more. */
     if (!uip_rexmit ()) {
 	if (STATE->eof)
 	    uip_close ();
@@ -112,5 +132,239 @@ httpd_handle_ecmd (void)
 	}
     }
 
-    uip_send (STATE->u.ecmd.output, strlen (STATE->u.ecmd.output));
+    PASTE_RESET ();
+    if (!STATE->header_acked) {
+	/* The first line of output goes along with the header. */
+	PASTE_P (httpd_header_200);
+	PASTE_P (httpd_header_close);
+	PASTE_P (httpd_header_ecmd);
+    }
+    strcat (uip_appdata, STATE->u.ecmd.output);
+    PASTE_SEND ();
+}
+
+
+#ifdef HTTPD_ECMD_BATCH_SUPPORT
+/* Decode the '&' separated commands of ENCODED_CMDS into the batch
+   buffer, they are run one after another by httpd_handle_ecmd_batch. */
+void
+httpd_handle_ecmd_batch_setup (char *encoded_cmds)
+{
+    uip_conn_t *owner = httpd_ecmd_batch_buf.conn;
+    if (owner && owner != uip_conn
+	&& owner->appstate.httpd.handler == httpd_handle_ecmd_batch) {
+	printf ("httpd_ecmd: batch buffer in use.\n");
+	STATE->handler = httpd_handle_ecmd_busy;
+	return;
+    }
+    httpd_ecmd_batch_buf.conn = uip_conn;
+
+    char *ptr = httpd_ecmd_batch_buf.batch;
+    char *end = ptr + HTTPD_ECMD_BATCH_LENGTH - 1; /* keep the list end */
+
+    while (*encoded_cmds) {
+	if (*encoded_cmds == '&') {
+	    encoded_cmds ++;	/* Skip empty commands. */
+	    continue;
+	}
+
+	/* Each command must fit the input buffer as well. */
+	uint8_t maxlen = end - ptr;
+	if (maxlen > ECMD_INPUTBUF_LENGTH)
+	    maxlen = ECMD_INPUTBUF_LENGTH;
+
+	encoded_cmds = httpd_ecmd_decode (ptr, encoded_cmds, maxlen, '&');
+	if (encoded_cmds == NULL) {
+	    printf ("httpd_ecmd: received batch too long.\n");
+	    httpd_handle_ecmd_batch_release ();
+	    STATE->handler = httpd_handle_400;
+	    return;
+	}
+	ptr += strlen (ptr) + 1;
+    }
+    *ptr = 0;
+
+    STATE->u.ecmd.batch_pos = 0;
+    STATE->u.ecmd.packed_len = 0;
+    STATE->u.ecmd.started = 0;
+    STATE->u.ecmd.active = 0;
+    STATE->u.ecmd.pending = 0;
+    STATE->u.ecmd.comma = 0;
+    STATE->handler = httpd_handle_ecmd_batch;
+}
+
+
+void
+httpd_handle_ecmd_batch_release (void)
+{
+    if (httpd_ecmd_batch_buf.conn == uip_conn)
+	httpd_ecmd_batch_buf.conn = NULL;
+}
+
+
+void
+httpd_handle_ecmd_busy (void)
+{
+    if (uip_acked ()) {
+	uip_close ();
+	return;
+    }
+
+    PASTE_RESET ();
+    PASTE_P (httpd_header_503);
+    PASTE_SEND ();
+}
+
+
+/* Copy S to DST as JSON string contents, returns the length needed.
+   Only counts if DST is NULL. */
+static uint8_t
+httpd_ecmd_json_escape (char *dst, const char *s)
+{
+    uint8_t n = 0;
+
+    for (; *s; s ++) {
+	char c = *s;
+	char e = c == '\n' ? 'n' : c == '\r' ? 'r' : c == '\t' ? 't' :
+	    (c == '"' || c == '\\') ? c : 0;
+
+	if (e) {
+	    if (dst) {
+		dst[n] = '\\';
+		dst[n + 1] = e;
+	    }
+	    n += 2;
+	}
+	else {
+	    if (dst)
+		dst[n] = (c < ' ') ? ' ' : c;
+	    n ++;
+	}
+    }
+
+    return n;
+}
+
+
+/* Run commands until the next segment is full.  Each command becomes
+   one string of a JSON array, lines of ECMD_AGAIN commands are joined
+   by newlines, failed commands become null. */
+static void
+httpd_ecmd_batch_pack (void)
+{
+    char *out = httpd_ecmd_batch_buf.packed;
+    uint8_t n = 0;
+
+    if (!STATE->u.ecmd.started) {
+	out[n ++] = '[';
+	STATE->u.ecmd.started = 1;
+    }
+
+    for (;;) {
+	if (!STATE->u.ecmd.pending) {
+	    if (!STATE->u.ecmd.active) {
+		char *cmd = httpd_ecmd_batch_buf.batch
+		    + STATE->u.ecmd.batch_pos;
+		if (*cmd == 0) {
+		    if (n + 2 > HTTPD_ECMD_BATCH_LENGTH)
+			break;
+
+		    out[n ++] = ']';
+		    out[n ++] = '\n';
+		    STATE->eof = 1;
+		    break;
+		}
+
+		strcpy (STATE->u.ecmd.input, cmd);
+		STATE->u.ecmd.batch_pos += strlen (cmd) + 1;
+		STATE->u.ecmd.active = 1;
+		STATE->u.ecmd.first_line = 1;
+	    }
+
+	    int16_t len = ecmd_parse_command (STATE->u.ecmd.input,
+					      STATE->u.ecmd.output,
+					      ECMD_OUTPUTBUF_LENGTH - 1);
+	    STATE->u.ecmd.again = is_ECMD_AGAIN (len);
+	    STATE->u.ecmd.error = is_ECMD_ERR (len);
+	    if (STATE->u.ecmd.again)
+		len = ECMD_AGAIN (len);
+	    else if (STATE->u.ecmd.error)
+		len = 0;
+
+	    STATE->u.ecmd.output[len] = 0;
+	    STATE->u.ecmd.pending = 1;
+	}
+
+	/* separator and quotes included */
+	uint8_t need = STATE->u.ecmd.error ? 5 :
+	    httpd_ecmd_json_escape (NULL, STATE->u.ecmd.output) + 3;
+	if (n + need > HTTPD_ECMD_BATCH_LENGTH)
+	    break;
+
+	if (STATE->u.ecmd.first_line) {
+	    if (STATE->u.ecmd.comma)
+		out[n ++] = ',';
+	    STATE->u.ecmd.comma = 1;
+	}
+
+	if (STATE->u.ecmd.error) {
+	    if (STATE->u.ecmd.first_line) {
+		memcpy_P (out + n, PSTR ("null"), 4);
+		n += 4;
+	    }
+	    else		/* keep the lines we have got */
+		out[n ++] = '"';
+	    STATE->u.ecmd.active = 0;
+	}
+	else {
+	    if (STATE->u.ecmd.first_line)
+		out[n ++] = '"';
+	    else {
+		out[n ++] = '\\';
+		out[n ++] = 'n';
+	    }
+	    n += httpd_ecmd_json_escape (out + n, STATE->u.ecmd.output);
+
+	    if (!STATE->u.ecmd.again) {
+		out[n ++] = '"';
+		STATE->u.ecmd.active = 0;
+	    }
+	}
+
+	STATE->u.ecmd.first_line = 0;
+	STATE->u.ecmd.pending = 0;
+    }
+
+    STATE->u.ecmd.packed_len = n;
+}
+
+
+void
+httpd_handle_ecmd_batch (void)
+{
+    if (uip_acked ())
+	STATE->header_acked = 1;
+
+    /* Packed output is kept until it has been acked, anything but an
+       ack (or the request itself) must send the same data again. */
+    if (!uip_rexmit () && (uip_acked () || !STATE->u.ecmd.started)) {
+	if (STATE->eof) {
+	    uip_close ();
+	    return;
+	}
+	httpd_ecmd_batch_pack ();
+    }
+
+    PASTE_RESET ();
+    if (!STATE->header_acked) {
+	PASTE_P (httpd_header_200);
+	PASTE_P (httpd_header_close);
+	PASTE_P (httpd_header_ecmd_json);
+    }
+
+    uint16_t hdrlen = strlen (uip_appdata);
+    memcpy ((char *) uip_appdata + hdrlen, httpd_ecmd_batch_buf.packed,
+	    STATE->u.ecmd.packed_len);
+    uip_send (uip_appdata, hdrlen + STATE->u.ecmd.packed_len);
 }
+#endif	/* HTTPD_ECMD_BATCH_SUPPORT */
@@ -51,6 +51,7 @@ httpd_handle_sd_dir_send_header (void)
 {
     PASTE_RESET ();
     PASTE_P (httpd_header_200);
+    PASTE_P (httpd_header_close);
     PASTE_P (httpd_header_ct_html);
     PASTE_PF (httpd_sd_dir_header, STATE->u.dir.dirname);
 
@@ -88,6 +88,7 @@ httpd_handle_soap (void)
 	    PASTE_P (httpd_header_500_xml);
 	else
 	    PASTE_P (httpd_header_200);
+	PASTE_P (httpd_header_close);
 
 	PASTE_P (httpd_header_ct_xml);
 	soap_paste_result (&STATE->u.soap);
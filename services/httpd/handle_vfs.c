@@ -27,19 +27,56 @@
 #define READ_AHEAD_LEN 2
 #endif
 
+#ifdef HTTPD_ETAG_SUPPORT
 static void
-httpd_handle_vfs_send_header (void)
+httpd_handle_vfs_etag (uint8_t kind, uint32_t etag)
+{
+    PASTE_PF (kind == VFS_ETAG_WEAK ? httpd_header_etag_weak
+	      : httpd_header_etag, (unsigned long) etag);
+}
+#endif	/* HTTPD_ETAG_SUPPORT */
+
+/* Paste the response header to uip_appdata, returns zero if no body
+   follows. */
+static uint8_t
+httpd_handle_vfs_header (void)
 {
     PASTE_RESET ();
+
+#ifdef HTTPD_ETAG_SUPPORT
+    uint32_t etag;
+    uint8_t have_etag = vfs_etag (STATE->u.vfs.fd, &etag);
+
+    if (have_etag && STATE->if_none_match && STATE->etag == etag) {
+	/* The client's copy is still valid, no body follows. */
+	PASTE_P (httpd_header_304);
+	PASTE_CONNECTION ();
+	httpd_handle_vfs_etag (have_etag, etag);
+	PASTE_P (PSTR ("\n"));
+	return 0;
+    }
+#endif	/* HTTPD_ETAG_SUPPORT */
+
     PASTE_P (httpd_header_200);
 
     vfs_size_t len = vfs_size (STATE->u.vfs.fd);
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+    if (len == 0)		/* End of body is told by closing then. */
+	STATE->keepalive = 0;
+#endif
+    PASTE_CONNECTION ();
+
     if (len > 0) {
 	/* send content-length header */
 	PASTE_P (httpd_header_length);
 	PASTE_LEN (len);
     }
 
+#ifdef HTTPD_ETAG_SUPPORT
+    if (have_etag)
+	httpd_handle_vfs_etag (have_etag, etag);
+#endif
+
     /* Check whether the file is gzip compressed. */
     unsigned char buf[READ_AHEAD_LEN];
 #ifndef VFS_TEENSY
@@ -60,8 +97,7 @@ httpd_handle_vfs_send_header (void)
 
 #ifdef MIME_SUPPORT
     PASTE_PF (PSTR ("Content-Type: %S\n\n"), httpd_mimetype_detect (buf));
-    PASTE_SEND ();
-    return;
+    return 1;
 #endif	/* MIME_SUPPORT */
 #ifndef VFS_TEENSY
 no_gzip:
@@ -77,47 +113,63 @@ no_gzip:
     else
 	PASTE_P (httpd_header_ct_html);
 
-    PASTE_SEND ();
+    return 1;
 }
 
 
-void
-httpd_handle_vfs_send_body (void)
+/* Fill the segment behind HDRLEN bytes of header with file data. */
+static void
+httpd_handle_vfs_send_body (uint16_t hdrlen)
 {
+    uint16_t room = uip_mss () - hdrlen;
+
     vfs_fseek (STATE->u.vfs.fd, STATE->u.vfs.acked, SEEK_SET);
-    vfs_size_t len = vfs_read (STATE->u.vfs.fd, uip_appdata, uip_mss ());
+    vfs_size_t len = vfs_read (STATE->u.vfs.fd,
+			       (uint8_t *) uip_appdata + hdrlen, room);
 
-    if (len <= 0) {
+    if (len == 0 && hdrlen == 0) {
 	uip_abort ();
 	httpd_cleanup ();
 	return;
     }
 
-    if (len < uip_mss ())	/* Short read -> EOF */
+    if (len < room)		/* Short read -> EOF */
 	STATE->eof = 1;
+    else {
+	/* A file ending on a segment boundary must not wait for a
+	   zero-length read, the client knows its size already. */
+	vfs_size_t size = vfs_size (STATE->u.vfs.fd);
+	if (size > 0 && STATE->u.vfs.acked + len >= size)
+	    STATE->eof = 1;
+    }
 
     STATE->u.vfs.sent = STATE->u.vfs.acked + len;
-    uip_send (uip_appdata, len);
+    uip_send (uip_appdata, hdrlen + len);
 }
 
 void
 httpd_handle_vfs (void)
 {
     if (uip_acked ()) {
-	if (STATE->header_acked)
-	    STATE->u.vfs.acked = STATE->u.vfs.sent;
+	STATE->header_acked = 1;
+	STATE->u.vfs.acked = STATE->u.vfs.sent;
+    }
+
+    if (!STATE->header_acked) {
+	/* The first segment carries the header and as much of the file
+	   as fits, it is regenerated from scratch on retransmission. */
+	STATE->u.vfs.acked = STATE->u.vfs.sent = 0;
+	if (httpd_handle_vfs_header ())
+	    httpd_handle_vfs_send_body (strlen (uip_appdata));
 	else {
-	    STATE->header_acked = 1;
-	    STATE->u.vfs.acked = 0;
+	    STATE->eof = 1;
+	    PASTE_SEND ();
 	}
     }
 
-    if (!STATE->header_acked)
-	httpd_handle_vfs_send_header ();
-
     else if (STATE->eof && !uip_rexmit())
 	uip_close ();
 
     else
-	httpd_handle_vfs_send_body ();
+	httpd_handle_vfs_send_body (0);
 }
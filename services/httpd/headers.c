@@ -24,10 +24,33 @@
 
 
 const char PROGMEM httpd_header_200[] =
-"HTTP/1.1 200 OK\n"
+"HTTP/1.1 200 OK\n";
+
+
+const char PROGMEM httpd_header_close[] =
 "Connection: close\n";
 
 
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+const char PROGMEM httpd_header_keepalive[] =
+"Connection: keep-alive\n";
+#endif	/* HTTPD_KEEPALIVE_SUPPORT */
+
+
+#ifdef HTTPD_ETAG_SUPPORT
+const char PROGMEM httpd_header_304[] =
+"HTTP/1.1 304 Not Modified\n";
+
+
+const char PROGMEM httpd_header_etag[] =
+"ETag: \"%08lx\"\n";
+
+
+const char PROGMEM httpd_header_etag_weak[] =
+"ETag: W/\"%08lx\"\n";
+#endif	/* HTTPD_ETAG_SUPPORT */
+
+
 const char PROGMEM httpd_header_ct_css[] =
 "Content-Type: text/css; charset=utf-8\n\n";
 
@@ -49,6 +72,21 @@ const char PROGMEM httpd_header_ecmd[] =
 "Cache-Control: no-cache\n"
 "Cache-Control: must-revalidate\n"
 "Content-Type: text/plain; charset=utf-8\n\n";
+
+
+#ifdef HTTPD_ECMD_BATCH_SUPPORT
+const char PROGMEM httpd_header_ecmd_json[] =
+"Cache-Control: no-cache\n"
+"Cache-Control: must-revalidate\n"
+"Content-Type: application/json\n\n";
+
+
+const char PROGMEM httpd_header_503[] =
+"HTTP/1.1 503 Service Unavailable\n"
+"Connection: close\n"
+"Retry-After: 1\n"
+"Content-Length: 0\n\n";
+#endif	/* HTTPD_ECMD_BATCH_SUPPORT */
 #endif	/* ECMD_PARSER_SUPPORT */
 
 
@@ -40,6 +40,10 @@
 #define printf(...)   ((void)0)
 #endif
 
+/* the idle time is counted in poll intervals of 200ms */
+#if defined(HTTPD_KEEPALIVE_SUPPORT) && HTTPD_KEEPALIVE_TIMEOUT * 5 > UINT16_MAX
+#error "HTTPD_KEEPALIVE_TIMEOUT is too large"
+#endif
 
 void
 httpd_init(void)
@@ -76,10 +80,85 @@ httpd_cleanup(void)
     soap_deallocate_context(&STATE->u.soap);
 #endif /* HTTPD_SOAP_SUPPORT */
 
+#ifdef HTTPD_ECMD_BATCH_SUPPORT
+  if (STATE->handler == httpd_handle_ecmd_batch)
+    httpd_handle_ecmd_batch_release();
+#endif /* HTTPD_ECMD_BATCH_SUPPORT */
+
   STATE->handler = NULL;
 }
 
 
+/* Prepare the connection for the next request, after the response to the
+ * previous one has been acked completely. */
+void
+httpd_done(void)
+{
+  httpd_cleanup();
+  STATE->header_acked = 0;
+  STATE->eof = 0;
+#ifdef HTTPD_AUTH_SUPPORT
+  /* every request has to authenticate on its own */
+  STATE->auth_state = PAM_UNKOWN;
+#endif
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+  STATE->idle = 0;
+#endif
+#ifdef HTTPD_ETAG_SUPPORT
+  STATE->if_none_match = 0;
+#endif
+}
+
+
+#if defined(HTTPD_KEEPALIVE_SUPPORT) || defined(HTTPD_ETAG_SUPPORT)
+/* Scan the rest of the request, starting with the protocol version, for
+ * the headers we care about. */
+static void
+httpd_parse_headers(const char *p)
+{
+  const char *end = (const char *) uip_appdata + uip_len;
+
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+  /* HTTP/1.1 connections are persistent unless told otherwise */
+  STATE->keepalive = (end - p >= 8 && strncmp_P(p, PSTR("HTTP/1.1"), 8) == 0);
+#endif
+
+  while (p < end)
+  {
+    const char *nl = memchr(p, '\n', end - p);
+    if (nl == NULL)
+      break;
+
+    p = nl + 1;
+    uint16_t left = end - p;
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+    if (left > 12 && strncasecmp_P(p, PSTR("Connection: "), 12) == 0)
+    {
+      if (strncasecmp_P(p + 12, PSTR("close"), 5) == 0)
+        STATE->keepalive = 0;
+      else if (strncasecmp_P(p + 12, PSTR("keep-alive"), 10) == 0)
+        STATE->keepalive = 1;
+    }
+#endif
+#ifdef HTTPD_ETAG_SUPPORT
+    if (left > 16 && strncasecmp_P(p, PSTR("If-None-Match: "), 15) == 0)
+    {
+      /* weak comparison, a W/ prefix does not matter */
+      const char *tag = p + 15;
+      if (left > 18 && tag[0] == 'W' && tag[1] == '/')
+        tag += 2;
+      if (*tag == '"')
+      {
+        STATE->etag = strtoul(tag + 1, NULL, 16);
+        STATE->if_none_match = 1;
+      }
+    }
+#endif
+  }
+}
+#endif /* HTTPD_KEEPALIVE_SUPPORT || HTTPD_ETAG_SUPPORT */
+
+
 static void
 httpd_handle_input(void)
 {
@@ -129,6 +208,11 @@ httpd_handle_input(void)
 
   *ptr = 0;                     /* Terminate filename. */
 
+#if defined(HTTPD_KEEPALIVE_SUPPORT) || defined(HTTPD_ETAG_SUPPORT)
+  /* Must be done before filename is extended in place below. */
+  httpd_parse_headers(ptr + 1);
+#endif
+
   /*
    * Successfully parsed the GET request,
    * possibly check authentication.
@@ -243,6 +327,15 @@ after_auth:
 
 
 
+#ifdef HTTPD_ECMD_BATCH_SUPPORT
+  if (strncmp_P(filename, PSTR(ECMD_BATCH_INDEX "?"),
+                sizeof(ECMD_BATCH_INDEX)) == 0)
+  {
+    httpd_handle_ecmd_batch_setup(filename + sizeof(ECMD_BATCH_INDEX));
+    return;
+  }
+#endif /* HTTPD_ECMD_BATCH_SUPPORT */
+
 #ifdef ECMD_PARSER_SUPPORT
   uint8_t offset = strlen_P(PSTR(ECMD_INDEX "?"));
   if (strncmp_P(filename, PSTR(ECMD_INDEX "?"), offset) == 0)
@@ -346,7 +439,35 @@ httpd_main(void)
 #ifdef HTTPD_AUTH_SUPPORT
     STATE->auth_state = PAM_UNKOWN;
 #endif
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+    STATE->keepalive = 0;
+    STATE->idle = 0;
+#endif
+#ifdef HTTPD_ETAG_SUPPORT
+    STATE->if_none_match = 0;
+#endif
+  }
+
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+  if (STATE->handler == httpd_handle_vfs && STATE->eof && STATE->keepalive
+      && uip_acked())
+  {
+    /* The response has been delivered completely, a pipelined request
+     * may come along with this ack.  Swallow the ack, so the next
+     * response starts with its header. */
+    printf("httpd: response done, keeping connection\n");
+    httpd_done();
+    uip_flags &= ~UIP_ACKDATA;
+  }
+
+  if (uip_poll() && !STATE->handler
+      && ++STATE->idle >= HTTPD_KEEPALIVE_TIMEOUT * 5)
+  {
+    printf("httpd: idle connection timed out\n");
+    uip_close();
+    return;
   }
+#endif /* HTTPD_KEEPALIVE_SUPPORT */
 
   if (uip_newdata() && (!STATE->handler || STATE->header_reparse))
   {
@@ -32,11 +32,13 @@
 
 #define HTTPD_INDEX "idx.ht"
 #define ECMD_INDEX "ecmd"
+#define ECMD_BATCH_INDEX "ecmd.json"
 
 /* prototypes */
 void httpd_init (void);
 void httpd_main (void);
 void httpd_cleanup (void);
+void httpd_done (void);
 
 void httpd_handle_400 (void);
 void httpd_handle_401 (void);
@@ -49,11 +51,24 @@ void httpd_handle_soap (void);
 
 void httpd_handle_ecmd_setup (char *encoded_cmd);
 void httpd_handle_ecmd (void);
+void httpd_handle_ecmd_batch_setup (char *encoded_cmds);
+void httpd_handle_ecmd_batch (void);
+void httpd_handle_ecmd_batch_release (void);
+void httpd_handle_ecmd_busy (void);
 
 PGM_P httpd_mimetype_detect (const uint8_t *);
 
 /* headers */
 extern const char httpd_header_200[];
+extern const char httpd_header_close[];
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+extern const char httpd_header_keepalive[];
+#endif
+#ifdef HTTPD_ETAG_SUPPORT
+extern const char httpd_header_304[];
+extern const char httpd_header_etag[];
+extern const char httpd_header_etag_weak[];
+#endif
 extern const char httpd_header_ct_css[];
 extern const char httpd_header_ct_html[];
 extern const char httpd_header_ct_xhtml[];
@@ -63,6 +78,8 @@ extern const char httpd_header_ct_xicon[];
 #endif
 
 extern const char httpd_header_ecmd[];
+extern const char httpd_header_ecmd_json[];
+extern const char httpd_header_503[];
 extern const char httpd_header_400[];
 extern const char httpd_header_gzip[];
 extern const char httpd_header_401[];
@@ -95,6 +112,13 @@ extern const char httpd_header_end[];
 /* FIXME maybe check uip_mss and emit warning on debugging console. */
 #define PASTE_SEND()    uip_send(uip_appdata, strlen(uip_appdata))
 
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+#  define PASTE_CONNECTION() \
+    PASTE_P(STATE->keepalive ? httpd_header_keepalive : httpd_header_close)
+#else
+#  define PASTE_CONNECTION()  PASTE_P(httpd_header_close)
+#endif
+
 
 #define STATE (&uip_conn->appstate.httpd)
 
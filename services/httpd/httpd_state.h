@@ -38,6 +38,18 @@ struct httpd_connection_state_t {
     unsigned header_acked		: 1;
     unsigned header_reparse		: 1;
     unsigned eof			: 1;
+#ifdef HTTPD_KEEPALIVE_SUPPORT
+    unsigned keepalive			: 1;
+
+    /* Poll intervals spent waiting for the next request. */
+    uint16_t idle;
+#endif	/* HTTPD_KEEPALIVE_SUPPORT */
+#ifdef HTTPD_ETAG_SUPPORT
+    unsigned if_none_match		: 1;
+
+    /* ETag the client sent with If-None-Match. */
+    uint32_t etag;
+#endif	/* HTTPD_ETAG_SUPPORT */
 
 #ifdef HTTPD_AUTH_SUPPORT
         uint8_t auth_state;
@@ -78,6 +90,20 @@ struct httpd_connection_state_t {
 	struct {
 	    char input[ECMD_INPUTBUF_LENGTH];
 	    char output[ECMD_OUTPUTBUF_LENGTH];
+#ifdef HTTPD_ECMD_BATCH_SUPPORT
+	    /* Position in the commands and length of the segment in
+	       flight, both are kept in httpd_ecmd_batch_buf. */
+	    uint8_t batch_pos;
+	    uint8_t packed_len;
+
+	    unsigned started		: 1;
+	    unsigned active		: 1; /* input still running */
+	    unsigned pending		: 1; /* output not yet packed */
+	    unsigned again		: 1;
+	    unsigned first_line		: 1;
+	    unsigned error		: 1;
+	    unsigned comma		: 1;
+#endif	/* HTTPD_ECMD_BATCH_SUPPORT */
 	} ecmd;
 #endif	/* ECMD_PARSER_SUPPORT */
 
@@ -47,34 +47,44 @@ volatile uint8_t stella_fade_counter = 0;
 volatile stella_update_sync_e stella_sync;
 uint8_t stella_portmask[STELLA_PORT_COUNT];
 
+#ifndef STELLA_BCM_SUPPORT
 struct stella_timetable_struct timetable_1, timetable_2;
 struct stella_timetable_struct *int_table;
 struct stella_timetable_struct *cal_table;
+#endif
 #ifdef DMX_STORAGE_SUPPORT
 uint8_t stella_dmx_conn_id;
 #endif
+#ifndef STELLA_BCM_SUPPORT
 static void stella_sort(void);
+#endif
 
 
 void
 stella_init(void)
 {
+#ifndef STELLA_BCM_SUPPORT
   int_table = &timetable_1;
   cal_table = &timetable_2;
   cal_table->head = 0;
+#endif
 
   stella_sync = NOTHING_NEW;
 
   /* set stella port pins to output and save the port mask */
   stella_portmask[0] = ((1 << STELLA_PINS_PORT1) - 1) << STELLA_OFFSET_PORT1;
   STELLA_DDR_PORT1 |= stella_portmask[0];
+#ifndef STELLA_BCM_SUPPORT
   cal_table->port[0].port = &STELLA_PORT1;
   cal_table->port[0].mask = 0;
+#endif
 #ifdef STELLA_PINS_PORT2
   stella_portmask[1] = ((1 << STELLA_PINS_PORT2) - 1) << STELLA_OFFSET_PORT2;
   STELLA_DDR_PORT2 |= stella_portmask[1];
+#ifndef STELLA_BCM_SUPPORT
   cal_table->port[0].port = &STELLA_PORT2;
   cal_table->port[1].mask = 0;
+#endif
 #endif
 
   /* initialise the fade counter. Fading works like this:
@@ -94,7 +104,11 @@ stella_init(void)
   memset(stella_fade, 0, sizeof(stella_fade));
 #endif
 
+#ifdef STELLA_BCM_SUPPORT
+  stella_bcm_calc();
+#else
   stella_sort();
+#endif
 
   /* we need at least 64 ticks for the compare interrupt,
    * therefore choose a prescaler of at least 64. */
@@ -174,7 +188,11 @@ stella_process(void)
 
   /* sort if new values are available */
   if (stella_sync == UPDATE_VALUES)
+#ifdef STELLA_BCM_SUPPORT
+    stella_bcm_calc();
+#else
     stella_sort();
+#endif
 }
 
 void
@@ -274,6 +292,7 @@ stella_storeToEEROM(void)
 }
 #endif
 
+#ifndef STELLA_BCM_SUPPORT
 /* How to use:
  * Do not call this directly, but use "stella_sync = UPDATE_VALUES" instead.
  * Purpose:
@@ -425,6 +444,7 @@ stella_sort()
   /* Allow the interrupt to actually apply the calculated values */
   stella_sync = NEW_VALUES;
 }
+#endif /* STELLA_BCM_SUPPORT */
 
 /*
   -- Ethersex META --
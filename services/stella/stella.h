@@ -90,6 +90,27 @@ typedef struct stella_timetable_struct
 extern struct stella_timetable_struct *int_table;
 extern struct stella_timetable_struct *cal_table;
 
+#ifdef STELLA_BCM_SUPPORT
+/* bits 7 .. 1 of the brightness, the least significant one is dropped */
+#define STELLA_BCM_PLANES 7
+
+typedef struct stella_bcm_table
+{
+  /* channel values the bit-planes currently represent */
+  uint8_t value[STELLA_CHANNELS];
+  /* port masks per bit-plane, plane 0 is brightness bit 1 */
+  uint8_t plane[STELLA_BCM_PLANES][STELLA_PORT_COUNT];
+  /* channels at 100% brightness, kept on in the last two ticks */
+  uint8_t full[STELLA_PORT_COUNT];
+} stella_bcm_table_s;
+
+extern stella_bcm_table_s *bcm_int_table;
+extern stella_bcm_table_s *bcm_cal_table;
+
+/* stella_bcm.c */
+void stella_bcm_calc(void);
+#endif
+
 /* to update i_* variables with their counterparts */
 extern volatile stella_update_sync_e stella_sync;
 extern volatile uint8_t stella_fade_counter;
@@ -0,0 +1,182 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * For more information on the GPL, please go to:
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/* Binary code modulation backend for stella.
+ *
+ * Instead of switching each channel at its own point in time, a pwm period
+ * of 256 timer ticks is split into one slot per bit of the brightness value.
+ * Bit n is shown for 2^n ticks, so the pins of all channels are written at
+ * the same eight points in time, regardless of the number of channels and
+ * their values:
+ *
+ *   tick   0 .. 127: bit 7
+ *   tick 128 .. 191: bit 6
+ *   ...
+ *   tick 252 .. 253: bit 1
+ *   tick 254 .. 255: channels at 100%
+ *
+ * Bit 0 would last a single tick, shorter than the ISR takes at a
+ * prescaler of 64, so it is dropped: the resolution is 7 bit, 254 and 255
+ * are the only values differing in bit 0 that look different.
+ *
+ * The port masks of all planes are updated incrementally from the main loop
+ * whenever a channel value changes and handed over to the ISR by swapping
+ * the table pointers at the start of the next period.
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "config.h"
+#include "stella.h"
+#include "core/debug.h"
+
+static stella_bcm_table_s bcm_table_1, bcm_table_2;
+stella_bcm_table_s *bcm_int_table = &bcm_table_1;
+stella_bcm_table_s *bcm_cal_table = &bcm_table_2;
+
+/* brightness bit to be shown by the compare ISR, 0 means the final slot */
+static volatile uint8_t bcm_plane;
+
+static inline void
+stella_bcm_output(const uint8_t * mask)
+{
+  STELLA_PORT1 = (STELLA_PORT1 & ~stella_portmask[0]) | mask[0];
+#ifdef STELLA_PINS_PORT2
+  STELLA_PORT2 = (STELLA_PORT2 & ~stella_portmask[1]) | mask[1];
+#endif
+}
+
+/* How to use:
+ * Do not call this directly, but use "stella_sync = UPDATE_VALUES" instead.
+ * Purpose:
+ * Bring the bit-planes of the table not used by the ISR in line with
+ * stella_brightness. Each table remembers the values it represents, so only
+ * the bits of changed channels have to be toggled.
+ * */
+void
+stella_bcm_calc(void)
+{
+  stella_bcm_table_s *t = bcm_cal_table;
+
+  for (uint8_t i = 0; i < STELLA_CHANNELS; ++i)
+  {
+    uint8_t diff = t->value[i] ^ stella_brightness[i];
+    if (!diff)
+      continue;
+    diff >>= 1;                 /* bit 0 has no plane */
+
+    uint8_t port = 0;
+    uint8_t mask = _BV(i + STELLA_OFFSET_PORT1);
+#ifdef STELLA_PINS_PORT2
+    if (i >= STELLA_PINS_PORT1)
+    {
+      port = 1;
+      mask = _BV((i - STELLA_PINS_PORT1) + STELLA_OFFSET_PORT2);
+    }
+#endif
+
+    for (uint8_t b = 0; diff; ++b, diff >>= 1)
+      if (diff & 1)
+        t->plane[b][port] ^= mask;
+
+    if (stella_brightness[i] == 255)
+      t->full[port] |= mask;
+    else
+      t->full[port] &= ~mask;
+
+    t->value[i] = stella_brightness[i];
+  }
+
+  /* Allow the interrupt to actually apply the calculated values */
+  stella_sync = NEW_VALUES;
+}
+
+/* Show the next bit-plane and set the compare register to the end of its
+ * slot. Called exactly STELLA_BCM_PLANES times per pwm period.
+ * */
+#ifdef STELLA_LOW_PRIORITY
+// other interrupts can interrupt this ISR
+ISR(STELLA_TC_VECTOR_COMPARE, ISR_NOBLOCK)
+{
+  // disable the interrupt we are in
+  // makes sure we don't interrupt ourselves
+  STELLA_TC_INT_COMPARE_OFF;
+#else
+ISR(STELLA_TC_VECTOR_COMPARE)
+{
+#endif
+  uint8_t bit = bcm_plane;
+
+  if (bit)
+  {
+    stella_bcm_output(bcm_int_table->plane[bit - 1]);
+    STELLA_TC_COMPARE_REG += _BV(bit);
+    bcm_plane = bit - 1;
+  }
+  else
+    stella_bcm_output(bcm_int_table->full);
+
+#ifdef STELLA_LOW_PRIORITY
+  // enable our interrupt again
+  STELLA_TC_INT_COMPARE_ON;
+#endif
+}
+
+/* If new values are available swap the tables. Start the next pwm round
+ * with the most significant plane. */
+#ifdef STELLA_LOW_PRIORITY
+// other interrupts can interrupt this ISR
+ISR(STELLA_TC_VECTOR_OVERFLOW, ISR_NOBLOCK)
+{
+  // disable the interrupt we are in
+  // makes sure we don't interrupt ourselves
+  STELLA_TC_INT_OVERFLOW_OFF;
+#else
+ISR(STELLA_TC_VECTOR_OVERFLOW)
+{
+#endif
+  /* if new values are available, work with them */
+  if (stella_sync == NEW_VALUES)
+  {
+    // swap pointer
+    stella_bcm_table_s *temp = bcm_int_table;
+    bcm_int_table = bcm_cal_table;
+    bcm_cal_table = temp;
+
+    // reset update flag
+    stella_sync = NOTHING_NEW;
+  }
+
+  stella_bcm_output(bcm_int_table->plane[STELLA_BCM_PLANES - 1]);
+  STELLA_TC_COMPARE_REG = _BV(STELLA_BCM_PLANES);
+  bcm_plane = STELLA_BCM_PLANES - 1;
+
+  /* count down the fade_timer counter. If zero, we process
+   * stella_process from ethersex main */
+  if (stella_fade_counter)
+    stella_fade_counter--;
+
+#ifdef STELLA_LOW_PRIORITY
+  // enable our interrupt again
+  STELLA_TC_INT_OVERFLOW_ON;
+#endif
+}
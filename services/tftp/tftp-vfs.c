@@ -37,13 +37,117 @@
  */
 #define BUF ((struct uip_udpip_hdr *) (uip_appdata - UIP_IPUDPH_LEN))
 
+/* largest block that still fits into the uip buffer */
+#define TFTP_MAX_BLKSIZE  (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN - 4)
 
 
+/* Push the packet in uip_appdata out right now, so the next one can be
+ * built in its place. */
+static void
+tftp_push(void)
+{
+  uip_process(UIP_UDP_SEND_CONN);
+  router_output();
+
+  uip_slen = 0;                 /* don't send twice. */
+}
+
+/* Look for the blksize (RFC 2348) and windowsize (RFC 7440) options of a
+ * request, RFC 2347.  Returns non-zero if an option has been accepted. */
+static uint8_t
+tftp_parse_options(struct tftp_connection_state_t *state, struct tftp_hdr *pk)
+{
+  char *p = pk->u.raw;
+  char *end = (char *) uip_appdata + uip_datalen();
+  uint8_t accepted = 0;
+
+  state->blksize = 512;
+  state->window = 1;
+
+  p += strnlen(p, end - p) + 1; /* filename */
+  p += strnlen(p, end - p) + 1; /* mode */
+
+  while (p < end)
+  {
+    char *name = p;
+    p += strnlen(p, end - p) + 1;
+    if (p >= end)
+      break;
+    unsigned long value = strtoul(p, NULL, 10);
+    p += strnlen(p, end - p) + 1;
+    if (p > end)
+      break;                    /* value not terminated */
+
+    if (strcasecmp_P(name, PSTR("blksize")) == 0 && value >= 8)
+    {
+      state->blksize = value > TFTP_MAX_BLKSIZE ? TFTP_MAX_BLKSIZE : value;
+      accepted = 1;
+    }
+    else if (strcasecmp_P(name, PSTR("windowsize")) == 0 && value >= 1)
+    {
+      state->window = value > TFTP_WINDOWSIZE ? TFTP_WINDOWSIZE : value;
+      accepted = 1;
+    }
+  }
+
+  return accepted;
+}
+
+/* Acknowledge the accepted options, RFC 2347. */
+static void
+tftp_send_oack(struct tftp_connection_state_t *state, struct tftp_hdr *pk)
+{
+  char *p = pk->u.raw;
+
+  pk->type = HTONS(6);          /* option acknowledgement */
+  if (state->blksize != 512)
+  {
+    strcpy_P(p, PSTR("blksize"));
+    p += 8;
+    p += sprintf_P(p, PSTR("%u"), state->blksize) + 1;
+  }
+  if (state->window != 1)
+  {
+    strcpy_P(p, PSTR("windowsize"));
+    p += 11;
+    p += sprintf_P(p, PSTR("%u"), state->window) + 1;
+  }
+  uip_udp_send(p - (char *) pk);
+}
+
+/* Send the blocks following the one sent last, up to the window size,
+ * back to back.  Returns non-zero on read errors. */
+static uint8_t
+tftp_send_window(struct tftp_connection_state_t *state, struct tftp_hdr *pk)
+{
+  for (uint8_t i = 0; i < state->window && !state->finished; i++)
+  {
+    pk->type = HTONS(3);        /* data packet */
+    pk->u.data.block = HTONS(state->sent + 1);
+
+    vfs_size_t ret = vfs_read(state->fh, pk->u.data.data, state->blksize);
+
+    if (ret > state->blksize)
+      return 1;
+
+    if (ret < state->blksize)
+      state->finished = 1;      /* the last block is a short one */
+
+    uip_udp_send(4 + ret);
+    tftp_push();
+    state->sent++;
+  }
+  return 0;
+}
 
 void
 tftp_handle_packet(void)
 {
   struct tftp_connection_state_t *state = &uip_udp_conn->appstate.tftp;
+  uint16_t block;
+  vfs_size_t len;
+  uint8_t options;
+
   /*
    * overwrite udp connection information (i.e. take from incoming packet)
    */
@@ -63,41 +167,53 @@ tftp_handle_packet(void)
     case 1:                    /* read request */
       state->download = 1;
       state->transfered = 0;
+      state->sent = 0;
       state->finished = 0;
 
+      options = tftp_parse_options(state, pk);
+
       state->fh = vfs_open(pk->u.raw);
       if (state->fh == NULL)
         goto error_out;
 
-      goto send_data;
+      if (options)
+      {
+        /* the client acknowledges with block 0, then data follows */
+        tftp_send_oack(state, pk);
+        break;
+      }
+
+      if (tftp_send_window(state, pk))
+        goto error_out;
+      break;
 
     case 4:                    /* acknowledgement */
       if (state->download != 1)
         goto error_out;
 
-      if (HTONS(pk->u.ack.block) < state->transfered
-          || (HTONS(pk->u.ack.block) > state->transfered + 1))
-        goto error_out;         /* ack out of order */
+      block = HTONS(pk->u.ack.block);
+      /* blocks transfered + 1 .. sent are in flight */
+      if ((uint16_t) (block - state->transfered) >
+          (uint16_t) (state->sent - state->transfered))
+        break;                  /* stale ack, ignore it */
 
-      state->transfered = HTONS(pk->u.ack.block);
+      state->transfered = block;
 
-    send_data:
-      if (state->finished)
+      if (block != state->sent)
+      {
+        /* The client lost a block of the window, go on behind the
+         * last one it has got. */
+        state->sent = block;
+        state->finished = 0;
+        if (vfs_fseek(state->fh, (uint32_t) block * state->blksize,
+                      SEEK_SET))
+          goto error_out;
+      }
+      else if (state->finished)
         goto close_connection;
 
-      pk->type = HTONS(3);      /* data packet */
-      pk->u.data.block = HTONS(state->transfered + 1);
-
-      fs_size_t ret = vfs_read(state->fh, pk->u.data.data, 512);
-
-      if (ret < 0)
+      if (tftp_send_window(state, pk))
         goto error_out;
-
-      if (ret < 512)
-        state->finished = 1;
-
-      uip_udp_send(4 + ret);
-      state->transfered++;
       break;
 
       /*
@@ -107,6 +223,10 @@ tftp_handle_packet(void)
       state->download = 0;
       state->transfered = 0;
       state->finished = 0;
+      state->unacked = 0;
+      state->gap = 0;
+
+      options = tftp_parse_options(state, pk);
 
       state->fh = vfs_open_or_creat(pk->u.raw);
       if (state->fh == NULL)
@@ -115,32 +235,52 @@ tftp_handle_packet(void)
       if (vfs_truncate(state->fh, 0))
         goto error_out;
 
-      pk->u.ack.block = HTONS(0);
+      if (options)
+      {
+        /* replaces the ack of block 0 */
+        tftp_send_oack(state, pk);
+        break;
+      }
       goto send_ack;
 
     case 3:                    /* data packet */
       if (state->download != 0)
         goto error_out;
 
-      if (HTONS(pk->u.ack.block) < state->transfered)
-        goto error_out;         /* too early */
-
-      if (HTONS(pk->u.ack.block) == state->transfered)
-        goto send_ack;          /* already handled */
+      block = HTONS(pk->u.data.block);
+      if (block != (uint16_t) (state->transfered + 1))
+      {
+        /* A duplicate or a block of the window got lost.  Tell the
+         * client what we have, but only once for a gap. */
+        uint16_t ahead = block - state->transfered;
+        if (ahead >= 2 && ahead <= state->window)
+        {
+          if (state->gap)
+            break;
+          state->gap = 1;
+        }
+        goto send_ack;
+      }
+      state->gap = 0;
 
-      if (HTONS(pk->u.ack.block) > state->transfered + 1)
-        goto error_out;         /* too late */
+      len = uip_datalen() - 4;
+      if (len > state->blksize)
+        goto error_out;
 
-      if (vfs_write(state->fh, pk->u.data.data, uip_datalen() - 4) <= 0)
+      if (len && vfs_write(state->fh, pk->u.data.data, len) != len)
         goto error_out;
 
-      if (uip_datalen() < 512 + 4)
-        state->finished = 1;
+      state->transfered = block;
 
-      state->transfered = HTONS(pk->u.ack.block);
+      if (len < state->blksize)
+        state->finished = 1;
+      else if (++state->unacked < state->window)
+        break;                  /* ack the end of the window only */
 
     send_ack:
+      state->unacked = 0;
       pk->type = HTONS(4);
+      pk->u.ack.block = HTONS(state->transfered);
       uip_udp_send(4);          /* send ack */
 
       if (state->finished)
@@ -164,10 +304,7 @@ tftp_handle_packet(void)
       {
         /* there's still data that has to be sent,
          * push it immediately. */
-        uip_process(UIP_UDP_SEND_CONN);
-        router_output();
-
-        uip_slen = 0;           /* don't send twice. */
+        tftp_push();
       }
 
       /* Reset connection. */
@@ -28,6 +28,10 @@
 
 #define TFTP_FILENAME_MAXLEN   32
 
+#ifndef TFTP_WINDOWSIZE
+#define TFTP_WINDOWSIZE        8
+#endif
+
 /* prototypes */
 void tftp_net_init(void);
 void tftp_net_main(void);
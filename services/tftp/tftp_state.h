@@ -47,6 +47,14 @@ struct tftp_connection_state_t
 #endif
 
   uint16_t transfered;          /* also retry countdown */
+
+#ifdef VFS_SUPPORT
+  uint16_t sent;                /* last block sent (download) */
+  uint16_t blksize;             /* negotiated block size */
+  uint8_t window;               /* negotiated window size */
+  uint8_t unacked;              /* blocks received since the last ack */
+  unsigned gap:1;               /* a lost block has been reported */
+#endif
 };
 
 #endif /* TFTP_STATE_H */